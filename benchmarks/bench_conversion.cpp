@@ -0,0 +1,188 @@
+/**
+ * @file bench_conversion.cpp
+ * @brief Benchmarks of the conversion from infix to RPN on the shapes of expression that stress the parser
+ * 
+ * items_per_second is the number of expressions converted per second
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <benchmark/benchmark.h>
+#include "rpn_utils.hpp"
+#include "arena.hpp"
+#include "bytecode.hpp"
+#include "bench_expressions.hpp"
+
+
+static void convert(benchmark::State &state, const rpn::Context &ctx, const std::string &expr)
+{
+    std::vector<std::string> rpn_expr;
+
+    for(auto _ : state){
+        bool valid = rpn::infix_to_rpn(ctx, expr, rpn_expr);
+        benchmark::DoNotOptimize(valid);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * expr.size());
+}
+
+static void BM_Convert_Short(benchmark::State &state)
+{
+    static const char *expressions[] = {"x + 1", "sin x * 2", "-(x - y) / 3"};
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    convert(state, ctx, expressions[state.range(0)]);
+}
+BENCHMARK(BM_Convert_Short)->DenseRange(0, 2);
+
+static void BM_Convert_Long(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    convert(state, ctx, bench::long_expression(state.range(0)));
+}
+BENCHMARK(BM_Convert_Long)->RangeMultiplier(8)->Range(8, 4096);
+
+static void BM_ConvertEvaluate_Request(benchmark::State &state)  //one request: a fresh rpn expression converted and evaluated, with the heap (range(1) = 0) or an arena reset after the request (range(1) = 1)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 1.5);
+    ctx.add_operand("y", 2.5);
+    const std::string expr = bench::long_expression(state.range(0));
+    rpn::Arena arena;
+
+    for(auto _ : state){
+        if(state.range(1) == 0){
+            std::vector<std::string> rpn_expr;
+            rpn::infix_to_rpn(ctx, expr, rpn_expr);
+            benchmark::DoNotOptimize(rpn::evaluate(ctx, rpn_expr));
+        }
+        else{
+            {
+                std::pmr::vector<std::pmr::string> rpn_expr(&arena);
+                rpn::infix_to_rpn(ctx, expr, rpn_expr);
+                benchmark::DoNotOptimize(rpn::evaluate(ctx, rpn_expr));
+            }
+            arena.reset();
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ConvertEvaluate_Request)->ArgsProduct({{8, 64, 512}, {0, 1}});
+
+static void BM_Convert_DeepNesting(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+
+    convert(state, ctx, bench::nested_expression(state.range(0)));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Convert_DeepNesting)->RangeMultiplier(4)->Range(4, 4096)->Complexity(benchmark::oN);
+
+static void BM_Convert_UnaryMinus(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+
+    convert(state, ctx, bench::negated_expression(state.range(0)));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Convert_UnaryMinus)->RangeMultiplier(4)->Range(4, 4096)->Complexity(benchmark::oN);
+
+static void BM_Convert_SignRun(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+
+    std::string expr = "x";
+    for(long i = 0; i < state.range(0); ++i)
+        expr += (i % 2) ? " - -3" : " +- -x";
+    convert(state, ctx, expr);
+}
+BENCHMARK(BM_Convert_SignRun)->RangeMultiplier(8)->Range(8, 4096);
+
+static void BM_Convert_ManyVariables(benchmark::State &state)
+{
+    rpn::Context ctx;
+    std::string expr = bench::variables_expression(ctx, state.range(0));
+
+    convert(state, ctx, expr);
+}
+BENCHMARK(BM_Convert_ManyVariables)->RangeMultiplier(4)->Range(4, 4096);
+
+static void BM_Convert_Polynomial(benchmark::State &state)  //polynomial fit, dominated by numeric literals
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+
+    std::string expr = "0.318309886183791";
+    for(long k = 1; k < state.range(0); ++k)
+        expr += ((k % 2) ? " - " : " + ") + std::to_string(1.0 / (k * k + 0.5)) + " * x ^ " + std::to_string(k);
+    convert(state, ctx, expr);
+}
+BENCHMARK(BM_Convert_Polynomial)->RangeMultiplier(4)->Range(4, 256);
+
+static void BM_Startup_Bytecode(benchmark::State &state)  //range(1) formulas made ready for evaluation: range(0) = 0 converted and compiled from infix, 1 by opening a bytecode file written once before the loop
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::vector<std::string> exprs;
+    rpn::BytecodeWriter writer;
+    for(long i = 0; i < state.range(1); ++i){
+        exprs.push_back(bench::long_expression(1 + i % 8) + " + " + std::to_string(i));
+        writer.add(ctx, exprs.back());
+    }
+    const std::string path = "bench_startup.rpnb";
+    writer.write(path);
+
+    for(auto _ : state){
+        if(state.range(0)){
+            rpn::BytecodeFile file;
+            benchmark::DoNotOptimize(file.open(path));
+        }
+        else{
+            std::vector<rpn::CompiledExpr> compiled(exprs.size());
+            for(std::size_t i = 0; i < exprs.size(); ++i){
+                std::vector<rpn::Instruction> program;
+                rpn::SymbolTable symbols;
+                rpn::infix_to_rpn(ctx, exprs[i], program, symbols);
+                compiled[i].assign(program, symbols.names());
+            }
+            benchmark::DoNotOptimize(compiled.data());
+        }
+    }
+
+    std::remove(path.c_str());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+}
+BENCHMARK(BM_Startup_Bytecode)->ArgsProduct({{0, 1}, {1000, 100000}})->Unit(benchmark::kMillisecond);
+
+static void BM_Convert_Operator(benchmark::State &state, const std::string &expr)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+
+    convert(state, ctx, expr);
+}
+
+void register_conversion_benchmarks()  //one benchmark for each function operator of the registry
+{
+    for(unsigned id = 0; id < rpn::operator_count(); ++id){
+        const std::string &name = rpn::operator_name(id);
+        std::string expr = bench::operator_expression(name, rpn::operator_table[id].n_operands);
+        benchmark::RegisterBenchmark(("BM_Convert_Operator/" + name).c_str(), BM_Convert_Operator, expr);
+    }
+}
@@ -0,0 +1,472 @@
+/**
+ * @file bench_evaluation.cpp
+ * @brief Benchmarks of the evaluation of rpn expressions, as strings, compiled and on many rows at once
+ * 
+ * items_per_second is the number of evaluations per second
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <benchmark/benchmark.h>
+#include "rpn_utils.hpp"
+#include "optimizer.hpp"
+#include "expression_set.hpp"
+#include "incremental.hpp"
+#include "thread_pool.hpp"
+#include "static_expr.hpp"
+#include "autodiff.hpp"
+#include "pipeline.hpp"
+#include "bench_expressions.hpp"
+
+
+static void BM_EvaluateString_Long(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 1.5);
+    ctx.add_operand("y", 0.75);
+
+    std::vector<std::string> rpn_expr;
+    rpn::infix_to_rpn(ctx, bench::long_expression(state.range(0)), rpn_expr);
+
+    for(auto _ : state){
+        std::pair<bool, double> result = rpn::evaluate(ctx, rpn_expr);
+        benchmark::DoNotOptimize(result);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateString_Long)->RangeMultiplier(8)->Range(8, 4096);
+
+static void BM_EvaluateCompiled_Long(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 1.5);
+    ctx.add_operand("y", 0.75);
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, bench::long_expression(state.range(0)), program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+    std::vector<double> values(symbols.size(), 1.5);
+
+    for(auto _ : state){
+        std::pair<bool, double> result = compiled_expr.evaluate(values.data());
+        benchmark::DoNotOptimize(result);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateCompiled_Long)->RangeMultiplier(8)->Range(8, 4096);
+
+static void BM_EvaluateCompiled_ManyVariables(benchmark::State &state)
+{
+    rpn::Context ctx;
+    std::string expr = bench::variables_expression(ctx, state.range(0));
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, expr, program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+
+    for(auto _ : state){
+        std::pair<bool, double> result = compiled_expr.evaluate(ctx);
+        benchmark::DoNotOptimize(result);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateCompiled_ManyVariables)->RangeMultiplier(4)->Range(4, 4096);
+
+static void BM_EvaluateBatch(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, "(x * x + y * y) / (x - y) + sqrt (x * y + 4) - sqr (x - 1.5)", program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+
+    const std::size_t n_rows = static_cast<std::size_t>(state.range(0));
+    std::vector<double> x(n_rows), y(n_rows), results(n_rows);
+    std::unique_ptr<bool[]> defined(new bool[n_rows]);
+    for(std::size_t r = 0; r < n_rows; ++r){
+        x[r] = 0.25 * r;
+        y[r] = 3.0 - 0.125 * r;
+    }
+    const double *columns[] = {x.data(), y.data()};
+
+    for(auto _ : state){
+        compiled_expr.evaluate_batch(columns, n_rows, results.data(), defined.get());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * n_rows);
+}
+BENCHMARK(BM_EvaluateBatch)->RangeMultiplier(8)->Range(64, 1 << 18);
+
+static void BM_EvaluateBatch_Parallel(benchmark::State &state)  //formula of BM_EvaluateBatch on 2^20 rows, range(0) is the number of threads of the pool
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, "(x * x + y * y) / (x - y) + sqrt (x * y + 4) - sqr (x - 1.5)", program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+
+    const std::size_t n_rows = 1 << 20;
+    std::vector<double> x(n_rows), y(n_rows), results(n_rows);
+    std::unique_ptr<bool[]> defined(new bool[n_rows]);
+    for(std::size_t r = 0; r < n_rows; ++r){
+        x[r] = 0.25 * r;
+        y[r] = 3.0 - 0.125 * r;
+    }
+    const double *columns[] = {x.data(), y.data()};
+    rpn::ThreadPool pool(static_cast<unsigned>(state.range(0)));
+
+    for(auto _ : state){
+        rpn::parallel_evaluate_batch(pool, compiled_expr, columns, n_rows, results.data(), defined.get());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * n_rows);
+}
+BENCHMARK(BM_EvaluateBatch_Parallel)->DenseRange(1, std::max(1u, std::thread::hardware_concurrency()))->UseRealTime();
+
+static void BM_EvaluateStatic(benchmark::State &state)  //formula of BM_EvaluateBatch on a single row: range(0) = 0 evaluates the CompiledExpr (with FpCheck::DEFERRED, as the static_expr does), 1 the static_expr
+{
+    using Formula = rpn::static_expr<"(x * x + y * y) / (x - y) + sqrt (x * y + 4) - sqr (x - 1.5)">;
+    std::vector<rpn::Instruction> program = Formula::instructions();
+    std::vector<std::string> names = {std::string(Formula::operand_name(0)), std::string(Formula::operand_name(1))};
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, names);
+    compiled_expr.set_fp_check(rpn::FpCheck::DEFERRED);  //as the static_expr
+    const Formula formula;
+    double values[] = {1.5, 0.75};
+    state.SetLabel(state.range(0) ? "static_expr" : "compiled");
+
+    for(auto _ : state){
+        benchmark::DoNotOptimize(values);
+        std::pair<bool, double> result = state.range(0) ? formula(values) : compiled_expr.evaluate(values);
+        benchmark::DoNotOptimize(result);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateStatic)->Arg(0)->Arg(1);
+
+static void BM_EvaluateCompiled_FpCheck(benchmark::State &state)  //trigonometric formula, range(0) is the FpCheck mode, range(1) != 0 for the evaluation on many rows
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, "sin x * cos y + tan (x * 0.5) - atan (x - y) + sinh 0.5 * cosh (y * 0.25)", program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+    compiled_expr.set_fp_check(static_cast<rpn::FpCheck>(state.range(0)));
+    state.SetLabel(state.range(0) ? "deferred" : "per_operator");
+
+    const std::size_t n_rows = state.range(1) ? 4096 : 1;
+    std::vector<double> x(n_rows), y(n_rows), results(n_rows);
+    std::unique_ptr<bool[]> defined(new bool[n_rows]);
+    for(std::size_t r = 0; r < n_rows; ++r){
+        x[r] = 0.001 * r + 0.5;
+        y[r] = 1.5 - 0.0005 * r;
+    }
+    const double *columns[] = {x.data(), y.data()};
+
+    for(auto _ : state){
+        if(state.range(1))
+            compiled_expr.evaluate_batch(columns, n_rows, results.data(), defined.get());
+        else{
+            double values[] = {x[0], y[0]};
+            std::pair<bool, double> result = compiled_expr.evaluate(values);
+            benchmark::DoNotOptimize(result);
+        }
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * n_rows);
+}
+BENCHMARK(BM_EvaluateCompiled_FpCheck)->ArgsProduct({{0, 1}, {0, 1}});
+
+static void BM_EvaluateCompiled_Cse(benchmark::State &state)  //formula repeating sqrt (x*x + y*y), range(0) != 0 after eliminate_common_subexpressions
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, "sqrt (x*x + y*y) * sin (x / sqrt (x*x + y*y)) + cos (y / sqrt (x*x + y*y)) * ln (1 + sqrt (x*x + y*y)) - sqrt (x*x + y*y) / 2", program, symbols);
+    if(state.range(0)){
+        rpn::CseReport report = rpn::eliminate_common_subexpressions(program);
+        state.counters["instructions"] = static_cast<double>(report.optimized_size);
+    }
+    else
+        state.counters["instructions"] = static_cast<double>(program.size());
+
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+    const double values[] = {0.75, 1.25};
+
+    for(auto _ : state){
+        std::pair<bool, double> result = compiled_expr.evaluate(values);
+        benchmark::DoNotOptimize(result);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateCompiled_Cse)->Arg(0)->Arg(1);
+
+static void BM_EvaluateExpressionSet(benchmark::State &state)  //100 related formulas on the same operands: range(0) = 0 evaluates them one by one, 1 as an ExpressionSet, 2 as an ExpressionSet on 4096 rows
+{
+    const unsigned n_formulas = 100;
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+    ctx.add_operand("z", 0.0);
+
+    rpn::ExpressionSet set;
+    std::vector<rpn::CompiledExpr> single(n_formulas);
+    std::vector<std::vector<double>> single_values(n_formulas);
+    for(unsigned k = 0; k < n_formulas; ++k){
+        const std::string c = std::to_string(k + 1);
+        const std::string expr = (k % 2) ? "sqrt (x*x + y*y) * " + c + " + sin (x * y) / (z + " + c + ")" : "ln (1 + sqrt (x*x + y*y)) - cos (x * y) * " + c + " + z";
+        set.add(ctx, expr);
+
+        std::vector<rpn::Instruction> program;
+        rpn::SymbolTable symbols;
+        rpn::infix_to_rpn(ctx, expr, program, symbols);
+        single[k].assign(program, symbols.names());
+        for(unsigned slot = 0; slot < symbols.size(); ++slot)
+            single_values[k].push_back(0.25 * (symbols.name(slot)[0] - 'w'));
+    }
+    state.counters["instructions"] = static_cast<double>(state.range(0) ? set.instructions().size() : set.unshared_size());
+
+    const std::size_t n_rows = (state.range(0) == 2) ? 4096 : 1;
+    std::vector<double> results(n_formulas * n_rows);
+    std::unique_ptr<bool[]> defined(new bool[n_formulas * n_rows]);
+    std::vector<double *> result_columns;
+    std::vector<bool *> defined_columns;
+    for(unsigned k = 0; k < n_formulas; ++k){
+        result_columns.push_back(results.data() + k * n_rows);
+        defined_columns.push_back(defined.get() + k * n_rows);
+    }
+
+    std::vector<std::vector<double>> columns(set.symbols().size(), std::vector<double>(n_rows));
+    std::vector<const double *> column_ptrs;
+    std::vector<double> values;
+    for(unsigned slot = 0; slot < set.symbols().size(); ++slot){
+        std::fill(columns[slot].begin(), columns[slot].end(), 0.25 * (set.symbols().name(slot)[0] - 'w'));
+        column_ptrs.push_back(columns[slot].data());
+        values.push_back(columns[slot][0]);
+    }
+
+    for(auto _ : state){
+        if(state.range(0) == 0)
+            for(unsigned k = 0; k < n_formulas; ++k)
+                benchmark::DoNotOptimize(single[k].evaluate(single_values[k].data()));
+        else if(state.range(0) == 1)
+            set.evaluate(values.data(), results.data(), defined.get());
+        else
+            set.evaluate_batch(column_ptrs.data(), n_rows, result_columns.data(), defined_columns.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * n_rows);  //rows (records) per second
+}
+BENCHMARK(BM_EvaluateExpressionSet)->DenseRange(0, 2);
+
+static void BM_EvaluateIncremental(benchmark::State &state)  //sum of 50 terms with logb, root and trigonometric functions of 50 variables, one variable changed before each evaluation: range(0) = 0 evaluates the whole CompiledExpr, 1 the IncrementalExpr
+{
+    const unsigned n_variables = 50;
+    rpn::Context ctx;
+    std::string expr;
+    for(unsigned i = 0; i < n_variables; ++i){
+        const std::string name = bench::variable_name(i);
+        ctx.add_operand(name, 0.0);
+        expr += (i ? " + " : "") + std::string("logb 2 (1 + sqr ") + name + ") * sin " + name + " + root 3 (2 + cos " + name + ")";
+    }
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, expr, program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+
+    std::vector<double> values(symbols.size(), 0.5);
+    rpn::IncrementalExpr incremental;
+    incremental.assign(compiled_expr, values.data());
+    unsigned slot = 0;
+
+    for(auto _ : state){
+        slot = (slot + 1) % symbols.size();
+        values[slot] += 0.001;
+
+        if(state.range(0)){
+            incremental.set_operand(slot, values[slot]);
+            benchmark::DoNotOptimize(incremental.evaluate());
+        }
+        else
+            benchmark::DoNotOptimize(compiled_expr.evaluate(values.data()));
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateIncremental)->Arg(0)->Arg(1);
+
+static void BM_EvaluateGradient(benchmark::State &state)  //gradient of a formula with function operators of range(1) variables: range(0) = 0 by central differences (2 evaluations per variable), 1 by evaluate_gradient
+{
+    const long n_variables = state.range(1);
+    rpn::Context ctx;
+    std::string expr;
+    for(long i = 0; i < n_variables; ++i){
+        const std::string name = bench::variable_name(i);
+        ctx.add_operand(name, 0.0);
+        expr += (i ? " + " : "") + std::string("sin ") + name + " * sqrt (1 + sqr " + name + ") / (2 + cos " + name + ")";
+    }
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    rpn::infix_to_rpn(ctx, expr, program, symbols);
+    rpn::CompiledExpr compiled_expr;
+    compiled_expr.assign(program, symbols.names());
+
+    std::vector<double> values(symbols.size(), 0.5);
+    std::vector<double> gradient(symbols.size());
+
+    for(auto _ : state){
+        if(state.range(0))
+            benchmark::DoNotOptimize(rpn::evaluate_gradient(compiled_expr, values.data(), gradient.data()));
+        else{
+            for(std::size_t i = 0; i < values.size(); ++i){
+                const double value = values[i];
+                const double step = 1e-6;
+                values[i] = value + step;
+                const double forward = compiled_expr.evaluate(values.data()).second;
+                values[i] = value - step;
+                const double backward = compiled_expr.evaluate(values.data()).second;
+                values[i] = value;
+                gradient[i] = (forward - backward) / (2 * step);
+            }
+            benchmark::DoNotOptimize(gradient.data());
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_EvaluateGradient)->ArgsProduct({{0, 1}, {4, 16, 64}});
+
+static void BM_Pipeline(benchmark::State &state)  //stream of 1024 evaluation jobs of 256 rows with a new formula of 2000 terms every 64 jobs: range(0) = 0 converts and evaluates each message on the calling thread, 1 submits them to a Pipeline
+{
+    const std::size_t n_jobs = 1024;
+    const std::size_t n_rows = 256;
+    const std::vector<std::string> operand_names = {"x", "y"};
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::string long_expr = "x";
+    for(int i = 0; i < 2000; ++i)
+        long_expr += " + sin x * y";
+    const std::string short_expr = "sqrt (x * x + y * y) / (1 + y)";
+
+    std::vector<double> values(operand_names.size() * n_rows);
+    for(std::size_t r = 0; r < n_rows; ++r){
+        values[r] = 0.5 + r;
+        values[n_rows + r] = 0.25 * r;
+    }
+    std::vector<double> results(n_rows);
+    std::unique_ptr<bool[]> defined(new bool[n_rows]);
+
+    for(auto _ : state){
+        if(state.range(0)){
+            rpn::Pipeline pipeline(operand_names, [](const rpn::PipelineResult &result){ benchmark::DoNotOptimize(result.results[0]); });
+            const std::size_t formula = pipeline.add_formula(short_expr);
+            for(std::size_t k = 0; k < n_jobs; ++k){
+                if(k % 64 == 0)
+                    pipeline.add_formula(long_expr);
+                pipeline.submit(formula, values, n_rows);
+            }
+            pipeline.finish();
+        }
+        else{
+            rpn::CompiledExpr formula;
+            std::vector<rpn::Instruction> program;
+            rpn::SymbolTable symbols;
+            rpn::infix_to_rpn(ctx, short_expr, program, symbols);
+            formula.assign(program, symbols.names());
+
+            for(std::size_t k = 0; k < n_jobs; ++k){
+                if(k % 64 == 0){
+                    rpn::CompiledExpr compiled_expr;
+                    std::vector<rpn::Instruction> long_program;
+                    rpn::SymbolTable long_symbols;
+                    rpn::infix_to_rpn(ctx, long_expr, long_program, long_symbols);
+                    compiled_expr.assign(long_program, long_symbols.names());
+                    rpn::optimize(compiled_expr);
+                    rpn::eliminate_common_subexpressions(compiled_expr);
+                    benchmark::DoNotOptimize(compiled_expr.instructions().data());
+                }
+                const double *const columns[] = {values.data(), values.data() + n_rows};
+                formula.evaluate_batch(columns, n_rows, results.data(), defined.get());
+                benchmark::DoNotOptimize(results.data());
+            }
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_jobs));
+}
+BENCHMARK(BM_Pipeline)->Arg(0)->Arg(1)->UseRealTime();
+
+static void BM_Evaluate_Operator(benchmark::State &state, const std::string &expr, bool compiled)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 1.5);
+
+    std::vector<std::string> rpn_expr;
+    rpn::infix_to_rpn(ctx, expr, rpn_expr);
+    rpn::CompiledExpr compiled_expr;
+    rpn::compile(ctx, rpn_expr, compiled_expr);
+
+    if(compiled){
+        for(auto _ : state){
+            std::pair<bool, double> result = compiled_expr.evaluate(ctx);
+            benchmark::DoNotOptimize(result);
+        }
+    }
+    else{
+        for(auto _ : state){
+            std::pair<bool, double> result = rpn::evaluate(ctx, rpn_expr);
+            benchmark::DoNotOptimize(result);
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+void register_evaluation_benchmarks()  //string and compiled evaluation of each function operator of the registry
+{
+    for(unsigned id = 0; id < rpn::operator_count(); ++id){
+        const std::string &name = rpn::operator_name(id);
+        std::string expr = bench::operator_expression(name, rpn::operator_table[id].n_operands);
+        benchmark::RegisterBenchmark(("BM_EvaluateString_Operator/" + name).c_str(), BM_Evaluate_Operator, expr, false);
+        benchmark::RegisterBenchmark(("BM_EvaluateCompiled_Operator/" + name).c_str(), BM_Evaluate_Operator, expr, true);
+    }
+}
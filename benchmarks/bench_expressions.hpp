@@ -0,0 +1,87 @@
+/**
+ * @file bench_expressions.hpp
+ * @brief Generators of the expressions used by the benchmarks
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#ifndef BENCH_EXPRESSIONS_HPP
+#define BENCH_EXPRESSIONS_HPP
+
+#include <string>
+#include "rpn_utils.hpp"
+
+void register_conversion_benchmarks();  //registers the benchmarks of the function operators, once all the operators have been registered
+void register_evaluation_benchmarks();
+
+namespace bench
+{
+    inline std::string long_expression(long n_terms)  //sum/product of n_terms mixed terms on the operands x and y
+    {
+        static const char *terms[] = {"x * 2.5", "- -sin (x + 1.25)", "--+-3 / [y - 0.5]", "-(x * y)", "root 3 (x + 8)", "sqr -(y)", "-logb 2 (x * x + 1)"};
+        const std::size_t n_kinds = sizeof(terms) / sizeof(terms[0]);
+        std::string expr;
+
+        for(long i = 0; i < n_terms; ++i){
+            if(i > 0)
+                expr += (i % 2) ? " + " : " * ";
+            expr += terms[i % n_kinds];
+        }
+        return expr;
+    }
+
+    inline std::string nested_expression(long depth)  //((((x + 1) * 2) + 1) * 2 ...) with depth levels of parentheses
+    {
+        std::string expr(depth, '(');
+        expr += "x";
+        for(long i = 0; i < depth; ++i)
+            expr += (i % 2) ? " * 2)" : " + 1)";
+        return expr;
+    }
+
+    inline std::string negated_expression(long n_minus)  //-(-(-(... x))) with n_minus unary minuses
+    {
+        std::string expr;
+        for(long i = 0; i < n_minus; ++i)
+            expr += "-(";
+        expr += "x";
+        expr.append(n_minus, ')');
+        return expr;
+    }
+
+    inline std::string variable_name(long index)  //va, vb, ..., vz, vba, ... (lowercase only, never an operator name)
+    {
+        std::string name;
+        do{
+            name.insert(name.begin(), static_cast<char>('a' + index % 26));
+            index /= 26;
+        } while(index > 0);
+        return "v" + name;
+    }
+
+    inline std::string variables_expression(rpn::Context &ctx, long n_variables)  //adds n_variables operands to the context and returns their sum
+    {
+        std::string expr;
+        for(long i = 0; i < n_variables; ++i){
+            std::string name = variable_name(i);
+            ctx.add_operand(name, 0.5 + i);
+            if(i > 0)
+                expr += (i % 3) ? " + " : " * ";
+            expr += name;
+        }
+        return expr;
+    }
+
+    inline std::string operator_expression(const std::string &name, unsigned short n_operands)  //single use of a function operator on the operand x
+    {
+        if(n_operands == 2 && !islower(name.front()))  //infix operator, such as ^
+            return "(x * 0.5) " + name + " 2";
+
+        std::string expr = name;
+        for(unsigned short i = 1; i < n_operands; ++i)
+            expr += " 2";
+        return expr + " (x * 0.5)";
+    }
+}
+
+#endif
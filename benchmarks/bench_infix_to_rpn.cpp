@@ -0,0 +1,35 @@
+/**
+ * @file bench_infix_to_rpn.cpp
+ * @brief Benchmark of the conversion from infix to RPN on expressions of increasing length
+ * 
+ * The time per character must stay constant as the expression grows (linear scaling)
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "rpn_utils.hpp"
+#include "bench_expressions.hpp"
+
+
+static void BM_InfixToRpn_Length(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    const std::string expr = bench::long_expression(state.range(0));
+    std::vector<std::string> rpn_expr;
+
+    for(auto _ : state){
+        bool valid = rpn::infix_to_rpn(ctx, expr, rpn_expr);
+        benchmark::DoNotOptimize(valid);
+    }
+
+    state.SetComplexityN(static_cast<benchmark::IterationCount>(expr.size()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * expr.size());
+}
+BENCHMARK(BM_InfixToRpn_Length)->RangeMultiplier(4)->Range(16, 16 << 10)->Complexity(benchmark::oN);
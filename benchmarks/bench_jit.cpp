@@ -0,0 +1,101 @@
+/**
+ * @file bench_jit.cpp
+ * @brief Benchmark of the evaluation of a compiled expression by the interpreter and by the native code of JitExpr
+ * 
+ * BM_Evaluate_String is the evaluation of the rpn expression as strings, as reference
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "rpn_utils.hpp"
+#include "jit.hpp"
+
+
+static const char *expressions[] = {
+    "x * x * 2.5 + y * 3 - (x - y) / 7 + 1.25 * x * y",  //only basic operators
+    "sqrt (x * x + y * y) + sin x * cos y - logb 2 (x * x + 1)"  //with function operators
+};
+
+static void compiled_expression(long index, rpn::CompiledExpr &compiled_expr)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 0.0);
+    ctx.add_operand("y", 0.0);
+
+    std::vector<rpn::Instruction> program;
+    rpn::SymbolTable symbols;
+    symbols.add("x");
+    symbols.add("y");
+
+    rpn::infix_to_rpn(ctx, expressions[index], program, symbols);
+    compiled_expr.assign(program, symbols.names());
+}
+
+static void BM_Evaluate_String(benchmark::State &state)
+{
+    rpn::Context ctx;
+    ctx.add_operand("x", 1.5);
+    ctx.add_operand("y", 0.75);
+
+    std::vector<std::string> rpn_expr;
+    rpn::infix_to_rpn(ctx, expressions[state.range(0)], rpn_expr);
+
+    for(auto _ : state){
+        std::pair<bool, double> result = rpn::evaluate(ctx, rpn_expr);
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_Evaluate_String)->DenseRange(0, 1);
+
+static void BM_Evaluate_Interpreter(benchmark::State &state)
+{
+    rpn::CompiledExpr compiled_expr;
+    compiled_expression(state.range(0), compiled_expr);
+    double values[] = {1.5, 0.75};
+
+    for(auto _ : state){
+        benchmark::DoNotOptimize(values);
+        std::pair<bool, double> result = compiled_expr.evaluate(values);
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_Evaluate_Interpreter)->DenseRange(0, 1);
+
+static void BM_Evaluate_Jit(benchmark::State &state)
+{
+    rpn::CompiledExpr compiled_expr;
+    compiled_expression(state.range(0), compiled_expr);
+    rpn::JitExpr jit_expr;
+    if(!jit_expr.assign(compiled_expr))
+        state.SetLabel("interpreter fallback");
+    double values[] = {1.5, 0.75};
+
+    for(auto _ : state){
+        benchmark::DoNotOptimize(values);
+        std::pair<bool, double> result = jit_expr.evaluate(values);
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_Evaluate_Jit)->DenseRange(0, 1);
+
+static void BM_Evaluate_JitDeferred(benchmark::State &state)  //flags checked once per evaluation
+{
+    rpn::CompiledExpr compiled_expr;
+    compiled_expression(state.range(0), compiled_expr);
+    compiled_expr.set_fp_check(rpn::FpCheck::DEFERRED);
+    rpn::JitExpr jit_expr;
+    if(!jit_expr.assign(compiled_expr))
+        state.SetLabel("interpreter fallback");
+    double values[] = {1.5, 0.75};
+
+    for(auto _ : state){
+        benchmark::DoNotOptimize(values);
+        std::pair<bool, double> result = jit_expr.evaluate(values);
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_Evaluate_JitDeferred)->DenseRange(0, 1);
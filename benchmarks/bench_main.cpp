@@ -0,0 +1,27 @@
+/**
+ * @file bench_main.cpp
+ * @brief Entry point of the benchmark suite
+ * 
+ * Run with --benchmark_out=<file> --benchmark_out_format=json to store the results (see the run_benchmarks target)
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <benchmark/benchmark.h>
+#include "bench_expressions.hpp"
+
+
+int main(int argc, char **argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    register_conversion_benchmarks();
+    register_evaluation_benchmarks();
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
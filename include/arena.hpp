@@ -0,0 +1,48 @@
+/**
+ * @file arena.hpp
+ * @brief Header file for the arena module of the rpn_utils library
+ * 
+ * Memory resource for the scratch memory of conversions and evaluations (token queues, operator stack, evaluation stack,
+ * rpn strings). Everything allocated from an arena is freed at once by Arena::reset, so a program that converts and
+ * evaluates one expression per request can reuse the same memory for every request
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <memory_resource>
+
+namespace rpn
+{
+    class Arena : public std::pmr::memory_resource  //monotonic memory resource over a buffer owned by the arena. Deallocations do nothing, memory is only given back by reset. Not thread safe: each thread should use its own arena
+    {
+    public:
+        explicit Arena(std::size_t initial_size = 4096);  //initial_size is the size in bytes of the buffer allocated by the constructor
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        void reset();  //frees everything allocated from the arena. If the buffer was not big enough since the last reset, it is replaced by a single buffer big enough, so after the first few requests the arena no longer allocates from the heap
+        std::size_t capacity() const;  //size in bytes of the buffer
+        std::size_t used() const;  //bytes allocated (alignment included) since the last reset
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+        std::unique_ptr<std::byte[]> buffer;
+        std::size_t buffer_size;
+        std::size_t requested = 0;
+        std::optional<std::pmr::monotonic_buffer_resource> mono;  //allocates from buffer, then from the heap when buffer is full
+    };
+}
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @file autodiff.hpp
+ * @brief Header file for the automatic differentiation module of the rpn_utils library
+ *
+ * Evaluation of a compiled expression together with its gradient with respect to the operands, by forward-mode
+ * differentiation: every value on the stack carries the vector of its partial derivatives with respect to all the
+ * operand slots, so the whole gradient comes out of a single pass over the program
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef AUTODIFF_HPP
+#define AUTODIFF_HPP
+
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    std::pair<bool, double> evaluate_gradient(const CompiledExpr &compiled_expr, const double *operand_values, double *gradient);  //evaluates the expression as CompiledExpr::evaluate(const double *) and writes to gradient[i] the partial derivative of the result with respect to the operand in slot i (gradient must hold operand_names().size() values, and is not written if the result is not defined). The function operators are differentiated with their derivative rules (see operator_registry.hpp), the ones without a rule numerically
+    std::pair<bool, double> evaluate_gradient(const CompiledExpr &compiled_expr, const double *operand_values, double *gradient, std::pmr::memory_resource *scratch);  //as above, allocating the stacks of the values and of the gradients from scratch (for example an rpn::Arena, see arena.hpp)
+}
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * @file bytecode.hpp
+ * @brief Header file for the bytecode module of the rpn_utils library
+ *
+ * Binary file format for many compiled rpn programs, written once by a BytecodeWriter and then memory-mapped by a
+ * BytecodeFile, which evaluates the programs straight from the mapped bytes. Loading a file costs the same whatever
+ * the number of programs it holds: nothing is converted or copied
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <cstdint>
+#include <string_view>
+#include "rpn_utils.hpp"
+#include "stream_eval.hpp"
+
+namespace rpn
+{
+    /*
+        Layout of a bytecode file (version 1). All the numbers are little-endian, and every section starts at a
+        multiple of 8 bytes from the beginning of the file; the sections refer to each other only by index, so the
+        file can be mapped at any address:
+        - BytecodeHeader
+        - programs: one BytecodeProgram per program, in the order they were added
+        - code: the BytecodeInstruction of all the programs
+        - literals: the doubles pushed by the PUSH_VALUE instructions
+        - operands: for each program, the string index of the name of the operand in each slot
+        - operators: the function operators called by the programs (name and number of operands)
+        - strings: offset and length of each string in chars
+        - chars: the characters of the strings (names of the operands and of the operators, sources of the programs)
+    */
+    const char BYTECODE_MAGIC[8] = {'R', 'P', 'N', 'B', 'C', 'O', 'D', 'E'};
+    const std::uint32_t BYTECODE_VERSION = 1;
+
+    struct BytecodeSection  //position of a section in the file
+    {
+        std::uint64_t offset;  //in bytes from the beginning of the file
+        std::uint64_t count;  //number of entries
+    };
+
+    struct BytecodeHeader
+    {
+        char magic[8];  //BYTECODE_MAGIC
+        std::uint32_t version;  //BYTECODE_VERSION
+        std::uint32_t reserved;
+        std::uint64_t operators_hash;  //hash of the additional_operators table (names, number of operands and precedence values) used to convert the programs
+        BytecodeSection programs;
+        BytecodeSection code;
+        BytecodeSection literals;
+        BytecodeSection operands;
+        BytecodeSection operators;
+        BytecodeSection strings;
+        BytecodeSection chars;
+    };
+
+    struct BytecodeProgram
+    {
+        std::uint32_t first_instruction;  //index in code of the first instruction
+        std::uint32_t n_instructions;  //0 for a program that was not valid
+        std::uint32_t first_operand;  //index in operands of the name of slot 0
+        std::uint32_t n_operands;
+        std::uint32_t max_depth;  //maximum number of values on the stack
+        std::uint32_t n_temps;  //temporary slots used by STORE_TEMP and LOAD_TEMP
+        std::uint32_t source;  //string index of the expression the program was converted from
+        std::uint32_t reserved;
+    };
+
+    struct BytecodeInstruction
+    {
+        std::uint8_t opcode;  //OpCode
+        std::uint8_t reserved;
+        std::uint16_t n_operands;  //number of operands taken by a FUNC_OPERATOR
+        std::uint32_t index;  //index in literals of a PUSH_VALUE, in operators of a FUNC_OPERATOR, slot of a PUSH_OPERAND, temporary slot of a STORE_TEMP or LOAD_TEMP
+    };
+
+    struct BytecodeOperator
+    {
+        std::uint32_t name;  //string index
+        std::uint16_t n_operands;
+        std::uint16_t reserved;
+    };
+
+    struct BytecodeString
+    {
+        std::uint32_t offset;  //in chars
+        std::uint32_t length;
+    };
+
+    enum class BytecodeStatus : unsigned char  //result of BytecodeFile::open
+    {
+        OK = 0,
+        CANNOT_READ,  //the file cannot be opened
+        INVALID_FORMAT,  //not a bytecode file, or truncated
+        UNSUPPORTED_VERSION,
+        OPERATORS_CHANGED,  //the additional_operators table is not the one the programs were converted with
+        UNKNOWN_OPERATOR  //a program calls an operator that is not registered, or that takes a different number of operands
+    };
+
+    std::uint64_t additional_operators_hash();  //hash of the additional_operators table, stored in the files to detect programs converted with a different table
+
+    class BytecodeWriter  //collects compiled programs and writes them to a bytecode file
+    {
+    public:
+        bool add(const CompiledExpr &compiled_expr, const std::string &source = std::string());  //adds the program of the compiled expression (source is the expression it comes from, kept in the file). Returns false if the compiled expression is empty: an empty program is added anyway, so that the k-th program added is always the k-th program of the file
+        bool add(const Context &ctx, const std::string &infix_expr);  //converts the infix expression with the operands of the context and adds it as above. Like infix_to_rpn, it throws std::runtime_error for a name that is neither an operand nor an operator
+        std::size_t size() const;  //number of programs added
+        void clear();
+
+        bool write(const std::string &path) const;  //writes all the programs to the file, returns false if it cannot be written
+
+    private:
+        std::uint32_t string_index(const std::string &text);  //returns the index of the string, adding it if it is not already there
+        std::uint32_t literal_index(double value);  //as above, for a literal (literals with the same bits are stored once)
+        std::uint32_t operator_index(unsigned id);  //as above, for the operator of the registry with the id passed
+
+        std::vector<BytecodeProgram> programs;
+        std::vector<BytecodeInstruction> code;
+        std::vector<double> literals;
+        std::vector<std::uint32_t> operands;
+        std::vector<BytecodeOperator> operators;
+        std::vector<BytecodeString> strings;
+        std::string chars;
+        std::unordered_map<std::string, std::uint32_t> string_indexes;
+        std::unordered_map<std::uint64_t, std::uint32_t> literal_indexes;  //by the bits of the value
+        std::unordered_map<unsigned, std::uint32_t> operator_indexes;  //by id
+    };
+
+    class BytecodeFile  //bytecode file mapped in memory, whose programs are evaluated straight from the mapped bytes. After open, the const functions can be called by any number of threads
+    {
+    public:
+        BytecodeStatus open(const std::string &path);  //maps the file and checks its header and its operators (the programs are not checked, see verify). On failure the object is left empty
+        void close();
+        std::size_t size() const;  //number of programs in the file
+
+        std::string_view source(std::size_t program) const;  //expression the program was converted from
+        unsigned operands(std::size_t program) const;  //number of operand slots of the program
+        std::string_view operand_name(std::size_t program, unsigned slot) const;
+        std::pair<bool, double> evaluate(std::size_t program, const double *operand_values) const;  //evaluates the program taking the value of the operand in slot i from operand_values[i], with the same results as CompiledExpr::evaluate. A program that was not valid is never defined
+        bool load(std::size_t program, CompiledExpr &compiled_expr) const;  //copies the program into a compiled expression (for example to translate it with JitExpr), returns false if it was not valid
+
+        bool verify() const;  //checks every program of the file (indexes in range, stack never underflowing nor deeper than max_depth), as needed before evaluating the programs of a file that does not come from a BytecodeWriter
+
+    private:
+        template<typename T> const T *section(const BytecodeSection &sec) const;  //first entry of the section
+        bool verify(const BytecodeProgram &entry) const;
+        std::string_view string(std::uint32_t index) const;
+
+        MappedFile input;
+        const BytecodeHeader *header = nullptr;
+        const BytecodeProgram *programs = nullptr;
+        const BytecodeInstruction *code = nullptr;
+        const double *literals = nullptr;
+        const std::uint32_t *operand_names = nullptr;
+        const BytecodeString *strings = nullptr;
+        const char *chars = nullptr;
+        std::vector<unsigned> operator_ids;  //id in the registry of each operator of the file
+    };
+}
+
+#endif
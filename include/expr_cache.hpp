@@ -0,0 +1,65 @@
+/**
+ * @file expr_cache.hpp
+ * @brief Header file for the expression cache module of the rpn_utils library
+ * 
+ * Bounded LRU cache of compiled expressions keyed by their normalized infix form, for programs that convert the same
+ * expressions over and over. The cache can be shared by many threads
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef EXPR_CACHE_HPP
+#define EXPR_CACHE_HPP
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <string_view>
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    class ExprCache  //LRU cache of compiled expressions. All the member functions can be called concurrently
+    {
+    public:
+        explicit ExprCache(std::size_t capacity);  //capacity is the maximum number of expressions kept
+        ExprCache(const ExprCache &) = delete;
+        ExprCache &operator=(const ExprCache &) = delete;
+
+        std::shared_ptr<const CompiledExpr> get(const std::string &infix_expr);  //returns the compiled expression, converting and compiling it if it is not in the cache. Returns nullptr if the expression is not valid, including the names that are neither operands nor operators and the malformed literals for which infix_to_rpn throws (invalid expressions are cached too, until the operands change or an operator is registered with register_operator)
+        std::shared_ptr<const CompiledExpr> get(const Context &ctx, const std::string &infix_expr);  //as above, using the operands of the context instead of the additional operands. An entry is reused only with the context it was compiled for, and only until its set of operand names changes
+        void clear();  //removes all the expressions (the counters are not reset)
+
+        std::size_t size() const;  //number of expressions in the cache
+        std::size_t capacity() const;
+        unsigned long hits() const;  //number of calls to get that found the expression in the cache
+        unsigned long misses() const;  //number of calls to get that had to convert the expression
+        unsigned long evictions() const;  //number of expressions removed to make room for new ones
+
+    private:
+        struct Entry
+        {
+            std::string key;  //normalized infix expression
+            unsigned long version;  //version of the operands the expression was converted with
+            unsigned n_operators;  //operator_count() when the expression was converted
+            std::shared_ptr<const CompiledExpr> expr;
+        };
+
+        bool lookup(std::string_view key, unsigned long version, unsigned n_operators, std::shared_ptr<const CompiledExpr> &expr);  //an entry is a hit only if it was converted with the same version of the operands and the same number of registered operators. On a hit stores the expression in expr and marks it as the most recently used
+        void insert(std::string &&key, unsigned long version, unsigned n_operators, const std::shared_ptr<const CompiledExpr> &expr);  //adds (or refreshes) an entry, evicting the least recently used one if the cache is full
+
+        const std::size_t max_entries;
+        mutable std::mutex mutex;
+        std::list<Entry> entries;  //most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;  //the keys point to the strings stored in entries
+        std::atomic<unsigned long> n_hits;
+        std::atomic<unsigned long> n_misses;
+        std::atomic<unsigned long> n_evictions;
+    };
+}
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * @file expression_set.hpp
+ * @brief Header file for the expression set module of the rpn_utils library
+ *
+ * Many expressions compiled into a single program that looks up each operand by name once, computes the
+ * subexpressions the expressions have in common only once and writes all the results in one evaluation (a plain
+ * operand is still pushed by every expression that uses it, as pushing it costs no more than reading a temporary)
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef EXPRESSION_SET_HPP
+#define EXPRESSION_SET_HPP
+
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    class ExpressionSet  //set of expressions evaluated together on the same operand values. The result of each expression is defined or not independently of the others
+    {
+    public:
+        bool add(const std::string &infix_expr);  //adds an expression to the set, returns false (leaving the set as it is) if the expression is not valid. The result of the k-th expression added is written to results[k]. Each call rebuilds the shared program, so adding costs time proportional to the size of the whole set
+        bool add(const Context &ctx, const std::string &infix_expr);  //as above, using the operands of the context instead of the additional operands
+        void clear();  //removes all the expressions
+        std::size_t size() const;  //number of expressions in the set
+
+        void evaluate(double *results, bool *defined) const;  //evaluates all the expressions with the current values of the additional operands. results[k] and defined[k] receive the result of the k-th expression and whether it is defined, with the same meaning as the pair returned by rpn::evaluate
+        void evaluate(const Context &ctx, double *results, bool *defined) const;  //as above, with the current values of the operands of the context. The expressions that use an operand removed from the context are not defined
+        void evaluate(const double *operand_values, double *results, bool *defined) const;  //as above, taking the value of the operand in slot i (see symbols) from operand_values[i]
+        void evaluate_batch(const double *const *operand_columns, std::size_t n_rows, double *const *result_columns, bool *const *defined_columns) const;  //evaluates all the expressions on n_rows rows, taking the value of the operand in slot i of row r from operand_columns[i][r]. result_columns[k][r] and defined_columns[k][r] receive the result of the k-th expression on row r and whether it is defined
+
+        const SymbolTable &symbols() const;  //slots of the operands of all the expressions
+        const std::vector<Instruction> &instructions() const;  //returns the shared program: the expressions one after the other, each one ending with the STORE_RESULT of its result, after constant folding and common subexpression elimination
+        std::size_t unshared_size() const;  //number of instructions the expressions would have if compiled one by one
+        void set_fp_check(FpCheck mode);  //sets how the evaluations check the function operators (PER_OPERATOR by default), see CompiledExpr::set_fp_check
+        FpCheck fp_check() const;
+
+    private:
+        void append(const std::vector<Instruction> &expr_program, const SymbolTable &new_slots);  //adds the program of an expression, whose operands have their slots in new_slots
+        void build();  //builds the shared program from the programs of the expressions
+        void evaluate(const std::unordered_map<std::string, double> &operands, double *results, bool *defined) const;  //evaluates all the expressions with the values of the operands in the map
+        void evaluate_row(const double *operand_values, const bool *operand_defined, double *results, bool *defined) const;  //evaluates all the expressions on a single row, operand_defined[i] is false if the operand of slot i is missing (nullptr if none is)
+        void run(const double *operand_values, const bool *operand_defined, double *results, bool *defined, double *values, bool *values_defined, bool check_each) const;  //evaluates the shared program on a single row; values and values_defined hold depth + n_temps elements
+
+        std::vector<Instruction> source;  //programs of the expressions, each one followed by its STORE_RESULT
+        std::vector<Instruction> program;
+        SymbolTable operand_slots;
+        std::size_t n_expressions = 0;
+        std::size_t n_unshared = 0;
+        unsigned depth = 0;
+        unsigned n_temps = 0;
+        FpCheck check = FpCheck::PER_OPERATOR;
+        bool calls_functions = false;
+    };
+}
+
+#endif
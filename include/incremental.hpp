@@ -0,0 +1,65 @@
+/**
+ * @file incremental.hpp
+ * @brief Header file for the incremental evaluation module of the rpn_utils library
+ *
+ * Evaluation of a compiled expression that keeps the value of every subexpression, so that when only some operands
+ * change between two evaluations only the subexpressions that depend on them are computed again
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+
+#include <queue>
+#include <functional>
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    class IncrementalExpr  //compiled expression with the values of its subexpressions cached. Not thread safe, even evaluate modifies the object
+    {
+    public:
+        bool assign(const CompiledExpr &compiled_expr, const double *operand_values);  //takes the program of the compiled expression and evaluates it with the operand in slot i equal to operand_values[i]. Returns false (leaving the object empty) if the compiled expression is empty
+        void set_operand(unsigned slot, double value);  //changes the value of the operand in the slot; the subexpressions that depend on it are computed again by the next evaluate
+        void set_operands(const double *operand_values);  //changes the values of all the operands, only the ones that are different from before count as changed
+        double operand(unsigned slot) const;  //returns the current value of the operand in the slot
+        std::pair<bool, double> evaluate();  //returns the result of the expression, with the same meaning as CompiledExpr::evaluate, computing again only the subexpressions that depend on the operands changed since the last evaluation
+        void clear();  //empties the expression
+        bool empty() const;  //returns true if the object does not hold an expression
+
+        std::size_t nodes() const;  //number of subexpressions (operators, operands and literals) of the expression
+        unsigned long recomputed() const;  //number of subexpressions computed again by the evaluations so far
+
+    private:
+        struct Node  //subexpression of the program. The nodes are in the order of the program, so the operands of a node always come before it
+        {
+            OpCode opcode;
+            unsigned short n_operands;
+            unsigned index;  //slot of an operand, id of a function operator
+            unsigned first_child;  //position in children of the first operand
+            unsigned first_parent;  //position in parents of the first node that uses this one (the parents of node i are parents[first_parent ... nodes[i + 1].first_parent - 1])
+            double value;
+            bool defined;
+        };
+
+        bool compute(Node &node);  //computes the node from its operands, returns true if its value or its definedness changed
+        void changed(unsigned node);  //schedules the nodes that use the node passed
+
+        std::vector<Node> graph;  //nodes of the expression, the last one is the whole expression
+        std::vector<unsigned> children;
+        std::vector<unsigned> parents;
+        std::vector<double> operands;  //current values of the operands
+        std::vector<unsigned> first_leaf;  //the nodes that read the operand in slot i are leaves[first_leaf[i] ... first_leaf[i + 1] - 1]
+        std::vector<unsigned> leaves;
+        std::vector<double> argv;  //operands of a function operator
+        std::vector<char> scheduled;  //true for the nodes in the queue
+        std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned>> dirty;  //nodes to compute again, the operands first
+        unsigned long n_recomputed = 0;
+    };
+}
+
+#endif
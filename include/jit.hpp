@@ -0,0 +1,45 @@
+/**
+ * @file jit.hpp
+ * @brief Header file for the jit module of the rpn_utils library
+ * 
+ * Translation of compiled rpn expressions to native x86-64 machine code. On the other platforms (or for programs that
+ * need more registers than available) the expressions are evaluated by the interpreter of CompiledExpr
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    class JitExpr  //compiled expression translated to native code
+    {
+    public:
+        JitExpr() = default;
+        JitExpr(const JitExpr &) = delete;
+        JitExpr &operator=(const JitExpr &) = delete;
+        ~JitExpr();
+
+        bool assign(const CompiledExpr &compiled_expr);  //translates the compiled expression to native code. Returns false if this is not possible, in this case evaluate uses the interpreter
+        std::pair<bool, double> evaluate(const double *operand_values) const;  //same as CompiledExpr::evaluate(const double *)
+        bool native() const;  //returns true if the expression is evaluated by native code
+        void clear();  //empties the expression and releases the native code
+
+    private:
+        typedef int (*native_func) (const double *operand_values, double *result);
+
+        CompiledExpr expr;
+        void *code = nullptr;
+        std::size_t code_size = 0;
+        native_func func = nullptr;
+        bool check_each = false;  //the native code tests the flags after each function operator (and so never asks for a recheck)
+    };
+}
+
+#endif
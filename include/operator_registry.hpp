@@ -0,0 +1,53 @@
+/**
+ * @file operator_registry.hpp
+ * @brief Header file for the operator registry of the rpn_utils library
+ * 
+ * Every function operator (the ones of the additional_operators table and the ones registered at runtime) gets a small
+ * integer id, and compiled programs call it through a flat table indexed by that id
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef OPERATOR_REGISTRY_HPP
+#define OPERATOR_REGISTRY_HPP
+
+#include <string>
+#include "additional_operators.hpp"
+
+namespace rpn
+{
+    typedef double (*operator_closure) (const double *argv, void *user_data);
+
+    struct OperatorDef  //function operator of the registry. Entries are never modified nor moved once registered
+    {
+        operator_func func;  //function of the operator, nullptr if the operator is a closure
+        operator_closure closure;  //function of a closure operator, called with user_data as second argument
+        void *user_data;
+        unsigned short n_operands;
+        unsigned short precedence;  //precedence value with respect to the other function operators
+        operator_derivative derivative;  //derivative rule of the operator, nullptr if its derivatives are computed numerically
+    };
+
+    const unsigned MAX_OPERATORS = 1024;  //capacity of the registry
+    const unsigned OPERATOR_NPOS = static_cast<unsigned>(-1);
+
+    extern const OperatorDef *const operator_table;  //flat table of the registered operators, indexed by id
+
+    bool register_operator(const std::string &name, unsigned short n_operands, unsigned short precedence, operator_func func);  //registers a function operator, with the same rules of the additional_operators table (its derivatives are computed numerically). Returns false if the name is not valid or already used, n_operands is 0 or the registry is full
+    bool register_operator(const std::string &name, unsigned short n_operands, unsigned short precedence, operator_func func, operator_derivative derivative);  //as above, with the derivative rule used by rpn::evaluate_gradient (see autodiff.hpp)
+    bool register_operator(const std::string &name, unsigned short n_operands, unsigned short precedence, operator_closure closure, void *user_data);  //as above, for an operator that needs its own data (user_data must remain valid as long as the operator can be used)
+    unsigned find_operator(const std::string &name);  //returns the id of the operator, or OPERATOR_NPOS if there is no operator with that name
+    const std::string &operator_name(unsigned id);  //returns the name of the operator with the id passed
+    unsigned operator_count();  //returns the number of registered operators, their ids go from 0 to operator_count() - 1
+
+    inline double call_operator(unsigned id, const double *argv)  //evaluates the operator with the id passed on the operands in argv
+    {
+        const OperatorDef &def = operator_table[id];
+        return (def.func != nullptr) ? (*def.func)(argv) : (*def.closure)(argv, def.user_data);
+    }
+}
+
+#endif
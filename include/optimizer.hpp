@@ -0,0 +1,34 @@
+/**
+ * @file optimizer.hpp
+ * @brief Header file for the optimizer module of the rpn_utils library
+ * 
+ * Optimization passes over the rpn programs (arrays of Instruction) produced by infix_to_rpn
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    unsigned optimize(std::vector<Instruction> &rpn_program, bool simplify_identities = false);  //replaces every subexpression whose operands are all numeric literals with its value (a subexpression that is not defined is left as it is). If simplify_identities is true it also removes x * 1, 1 * x, x / 1, x + 0, 0 + x, x - 0 and sqr sqrt x (note that the last one becomes defined also for x < 0). Returns the number of instructions removed
+    unsigned optimize(CompiledExpr &compiled_expr, bool simplify_identities = false);  //as above, on the program of a compiled expression
+
+    struct CseReport  //result of eliminate_common_subexpressions
+    {
+        std::size_t original_size;  //number of instructions before the pass
+        std::size_t optimized_size;  //number of instructions after the pass
+        unsigned temps;  //number of subexpressions computed once and reused, each one in its own temporary slot
+    };
+
+    CseReport eliminate_common_subexpressions(std::vector<Instruction> &rpn_program);  //computes each subexpression that appears more than once (same operators applied to the same operands) only the first time, storing its value with STORE_TEMP and reading it back with LOAD_TEMP where it appears again. Function operators are assumed to depend only on their operands, as for the folding done by optimize. A program that already uses temporary slots, or is not valid, is left as it is
+    CseReport eliminate_common_subexpressions(CompiledExpr &compiled_expr);  //as above, on the program of a compiled expression
+}
+
+#endif
@@ -0,0 +1,264 @@
+/**
+ * @file pipeline.hpp
+ * @brief Header file for the pipeline module of the rpn_utils library
+ *
+ * Formulas and evaluation jobs processed by three stages, each one on its own thread: parsing (infix_to_rpn),
+ * validation and optimization (CompiledExpr::assign, optimize), batched evaluation. The stages pass their work to each
+ * other through bounded single-producer single-consumer ring buffers: a stage that finds the next ring full waits for
+ * it to drain, and so does the thread that submits the work. The evaluation jobs go straight to the evaluation stage,
+ * so they never wait behind the parsing of a long formula unless they need that formula
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    template<typename T>
+    class SpscRing  //bounded queue between one producer thread and one consumer thread, without locks
+    {
+    public:
+        explicit SpscRing(std::size_t min_capacity);  //the capacity is min_capacity rounded up to a power of two
+        SpscRing(const SpscRing &) = delete;
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        bool try_push(T &&value);  //moves value to the back of the queue, returns false (leaving value as it is) if the queue is full. Only the producer can call it
+        bool try_pop(T &value);  //moves the front of the queue to value, returns false if the queue is empty. Only the consumer can call it
+        std::size_t size() const;  //number of values in the queue (any thread can call it, the result may be already old when it returns)
+        std::size_t capacity() const;
+
+    private:
+        std::unique_ptr<T[]> slots;
+        std::size_t mask;  //capacity - 1
+        alignas(64) std::atomic<std::size_t> head{0};  //number of values popped, written by the consumer
+        std::size_t cached_tail = 0;  //last tail seen by the consumer, read again only when the queue looks empty
+        alignas(64) std::atomic<std::size_t> tail{0};  //number of values pushed, written by the producer
+        std::size_t cached_head = 0;  //last head seen by the producer, read again only when the queue looks full
+    };
+
+    struct PipelineResult  //result of an evaluation job, passed to the result callback of the pipeline
+    {
+        std::size_t job;  //id returned by Pipeline::submit
+        std::size_t formula;  //id returned by Pipeline::add_formula
+        std::size_t n_rows;
+        const double *results;  //results[r] and defined[r] are the result on row r and whether it is defined, valid until the callback returns
+        const bool *defined;
+        std::string_view error;  //why the formula is not valid (then no row is defined), empty if it is
+    };
+
+    struct PipelineStageMetrics
+    {
+        std::size_t processed;  //formulas (parse and compile stages) or jobs (evaluation stage) done
+        double per_second;  //processed / seconds since the pipeline was created
+        double busy_seconds;  //time spent working
+        double blocked_seconds;  //time spent waiting for room in the next queue (always 0 for the evaluation stage, which passes the results to the callback)
+    };
+
+    struct PipelineQueueMetrics
+    {
+        std::size_t depth;  //values in the queue now
+        std::size_t max_depth;  //highest depth seen by the producer
+        std::size_t capacity;
+    };
+
+    struct PipelineMetrics  //result of Pipeline::metrics
+    {
+        double seconds;  //since the pipeline was created
+        PipelineStageMetrics parse;
+        PipelineStageMetrics compile;
+        PipelineStageMetrics evaluate;
+        PipelineQueueMetrics formula_queue;  //submitter -> parse stage
+        PipelineQueueMetrics parsed_queue;  //parse stage -> compile stage
+        PipelineQueueMetrics compiled_queue;  //compile stage -> evaluation stage
+        PipelineQueueMetrics job_queue;  //submitter -> evaluation stage
+        std::size_t rows;  //rows evaluated
+        std::size_t waiting_jobs;  //jobs received by the evaluation stage before their formula
+        double submit_blocked_seconds;  //time add_formula and submit spent waiting for room in the queues
+    };
+
+    class Pipeline  //converts, checks and evaluates formulas on three threads. add_formula, submit, wait and finish must be called by one thread at a time
+    {
+    public:
+        typedef std::function<void(const PipelineResult &)> ResultCallback;
+
+        Pipeline(const std::vector<std::string> &operand_names, const ResultCallback &on_result, std::size_t queue_capacity = 1024, bool optimize_formulas = true);  //the formulas can use the operands listed (they are the columns of the values of the jobs). on_result is called on the evaluation thread once per job, in the order the jobs become ready to run (a job whose formula is still being converted waits for it, the following ones do not). Throws std::runtime_error for a name that is not a valid operand name
+        Pipeline(const Pipeline &) = delete;
+        Pipeline &operator=(const Pipeline &) = delete;
+        ~Pipeline();  //calls finish, ignoring the exceptions
+
+        std::size_t add_formula(const std::string &infix_expr);  //queues an infix expression for conversion and returns its id (0, 1, 2, ...). Waits while the queue of the parse stage is full
+        std::size_t submit(std::size_t formula, std::vector<double> values, std::size_t n_rows);  //queues the evaluation of a formula on n_rows rows and returns the id of the job (0, 1, 2, ...). values holds the rows of the first operand, then the rows of the second one, ... (values[c * n_rows + r] is operand c on row r). Waits while the queue of the evaluation stage is full. Throws std::runtime_error if the formula was not added or values has the wrong size
+        void wait();  //returns once the results of all the jobs submitted have been passed to the callback. If the callback threw, throws again its first exception
+        void finish();  //waits as above and stops the threads, after which add_formula and submit throw std::runtime_error
+
+        const std::vector<std::string> &operands() const;
+        PipelineMetrics metrics() const;  //any thread can call it
+
+    private:
+        struct FormulaMessage  //submitter -> parse stage
+        {
+            std::size_t id;
+            std::string infix_expr;
+        };
+
+        struct ParsedMessage  //parse stage -> compile stage
+        {
+            std::size_t id;
+            std::vector<Instruction> program;
+            std::vector<std::string> names;  //operands of the program, indexed by slot
+            std::string error;
+        };
+
+        struct CompiledMessage  //compile stage -> evaluation stage
+        {
+            std::size_t id;
+            CompiledExpr compiled_expr;
+            std::vector<unsigned> columns;  //column of the values of the jobs read by each operand slot
+            std::string error;
+        };
+
+        struct JobMessage  //submitter -> evaluation stage
+        {
+            std::size_t id;
+            std::size_t formula;
+            std::size_t n_rows;
+            std::vector<double> values;
+        };
+
+        struct StageCounters  //written by the thread of the stage only
+        {
+            std::atomic<std::uint64_t> processed{0};
+            std::atomic<std::uint64_t> busy_ns{0};
+            std::atomic<std::uint64_t> blocked_ns{0};
+        };
+
+        template<typename In, typename Out> void run_stage(SpscRing<In> &input, std::atomic<std::uint32_t> &signal, std::atomic<std::uint32_t> &producer_signal, const std::atomic<bool> &producer_done, void (Pipeline::*step)(In &, Out &) const, SpscRing<Out> &output, std::atomic<std::uint32_t> &consumer_signal, std::atomic<std::size_t> &output_max_depth, StageCounters &counters);  //loop of the parse and compile stages: pops each value of input, passes it to step and pushes the result to output, until the producer is done and input is empty
+
+        void parse_stage();
+        void compile_stage();
+        void evaluate_stage();
+        void parse(FormulaMessage &formula, ParsedMessage &parsed) const;  //converts the formula, parsed.error is not empty if it is not valid
+        void compile(ParsedMessage &parsed, CompiledMessage &compiled) const;  //checks and optimizes the program, compiled.error is not empty if it is not valid
+        void evaluate(const JobMessage &job);  //evaluates a job whose formula has been compiled and passes its result to the callback
+        std::size_t run_waiting_jobs();  //evaluates the waiting jobs whose formula has been compiled, returns how many
+
+        SymbolTable columns;
+        Context ctx;  //one operand per column
+        ResultCallback on_result;
+        bool optimize_formulas;
+        std::chrono::steady_clock::time_point start;
+
+        SpscRing<FormulaMessage> formula_queue;
+        SpscRing<ParsedMessage> parsed_queue;
+        SpscRing<CompiledMessage> compiled_queue;
+        SpscRing<JobMessage> job_queue;
+        std::atomic<std::size_t> formula_max_depth{0};
+        std::atomic<std::size_t> parsed_max_depth{0};
+        std::atomic<std::size_t> compiled_max_depth{0};
+        std::atomic<std::size_t> job_max_depth{0};
+
+        alignas(64) std::atomic<std::uint32_t> parse_signal{0};  //bumped when the parse stage may have work to do: a formula pushed to its input or room made in its output
+        alignas(64) std::atomic<std::uint32_t> compile_signal{0};
+        alignas(64) std::atomic<std::uint32_t> evaluate_signal{0};
+        alignas(64) std::atomic<std::uint32_t> submit_signal{0};  //bumped when a queue of the submitter gets room
+        std::atomic<bool> stopping{false};  //set by finish, once no more formulas will be added
+        std::atomic<bool> parse_done{false};
+        std::atomic<bool> compile_done{false};
+
+        StageCounters parse_counters;
+        StageCounters compile_counters;
+        StageCounters evaluate_counters;
+        std::atomic<std::uint64_t> rows_evaluated{0};
+        std::atomic<std::uint64_t> submit_blocked_ns{0};
+        std::atomic<std::size_t> n_waiting{0};
+        std::size_t n_formulas = 0;
+        std::size_t n_jobs = 0;
+        alignas(64) std::atomic<std::size_t> jobs_done{0};
+
+        std::vector<CompiledMessage> formulas;  //compiled formulas indexed by id, owned by the evaluation stage
+        std::deque<JobMessage> waiting_jobs;  //jobs received before their formula, owned by the evaluation stage
+        std::vector<double> results;  //buffers of the evaluation stage
+        std::unique_ptr<bool[]> defined;
+        std::size_t defined_size = 0;
+        std::vector<const double *> operand_columns;
+        std::mutex exception_mutex;
+        std::exception_ptr first_exception;  //first exception thrown by the callback, not rethrown yet
+
+        std::vector<std::thread> threads;
+    };
+
+
+    template<typename T>
+    SpscRing<T>::SpscRing(std::size_t min_capacity)
+    {
+        std::size_t n = 1;
+        while(n < min_capacity)
+            n <<= 1;
+
+        slots.reset(new T[n]);
+        mask = n - 1;
+    }
+
+    template<typename T>
+    bool SpscRing<T>::try_push(T &&value)
+    {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if(t - cached_head > mask){
+            cached_head = head.load(std::memory_order_acquire);
+            if(t - cached_head > mask)
+                return false;
+        }
+
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename T>
+    bool SpscRing<T>::try_pop(T &value)
+    {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if(h == cached_tail){
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(h == cached_tail)
+                return false;
+        }
+
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename T>
+    std::size_t SpscRing<T>::size() const
+    {
+        const std::size_t h = head.load(std::memory_order_acquire);
+        const std::size_t t = tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    template<typename T>
+    std::size_t SpscRing<T>::capacity() const
+    {
+        return mask + 1;
+    }
+}
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * @file profile.hpp
+ * @brief Header file for the profiling module of the rpn_utils library
+ *
+ * When the library is built with RPN_UTILS_PROFILE defined (CMake option RPN_UTILS_PROFILE), the conversion and the
+ * evaluation functions record how much time they spend in each phase, how many times each instruction and each
+ * function operator is executed and for how many cycles, why the results are not defined and how much scratch memory
+ * is taken from the heap. Each thread writes its own counters without locks or atomic read-modify-write operations;
+ * snapshot adds up the counters of all the threads. Without RPN_UTILS_PROFILE the hooks expand to nothing and the
+ * snapshots are empty.
+ * The instructions are counted by CompiledExpr (evaluate and evaluate_batch, and so the pipeline and the thread pool),
+ * ExpressionSet, IncrementalExpr (the nodes recomputed), BytecodeFile::evaluate and JitExpr when it falls back to the
+ * interpreter. rpn::evaluate on string tokens and the native code of JitExpr record only the time of their phase and
+ * the causes of their undefined results; static_expr, inlined in the caller, records nothing
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <string>
+#include <memory_resource>
+#include "rpn_utils.hpp"
+
+#if defined(RPN_UTILS_PROFILE) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(RPN_UTILS_PROFILE)
+#include <chrono>
+#endif
+
+namespace rpn
+{
+    namespace profile
+    {
+        enum class Phase : unsigned char
+        {
+            CONVERSION = 0,  //infix_to_rpn
+            LEXING,  //reading the tokens of an infix expression (part of CONVERSION)
+            LITERALS,  //parsing numeric literals (part of LEXING, VALIDATION or EVALUATION)
+            VALIDATION,  //checking rpn expressions and compiled programs
+            COMPILATION,  //compile and CompiledExpr::assign
+            EVALUATION,  //evaluate and the evaluate functions of CompiledExpr, ExpressionSet, IncrementalExpr, JitExpr and BytecodeFile (not static_expr)
+            N_PHASES
+        };
+
+        enum class Cause : unsigned char  //reason why a result is not defined
+        {
+            DIVISION_BY_ZERO = 0,
+            FE_INVALID_RAISED,  //a function operator raised FE_INVALID
+            FE_DIVBYZERO_RAISED,
+            FE_OVERFLOW_RAISED,
+            FE_UNDERFLOW_RAISED,
+            N_CAUSES
+        };
+
+        const unsigned N_OPCODES = static_cast<unsigned>(OpCode::STORE_RESULT) + 1;
+
+        struct Counter
+        {
+            std::uint64_t count;
+            std::uint64_t cycles;  //time stamp counter ticks on x86, nanoseconds elsewhere
+        };
+
+        struct Snapshot  //sum of the counters of all the threads since the start of the program (or the last reset)
+        {
+            Counter phases[static_cast<unsigned>(Phase::N_PHASES)];  //count = times the phase was entered
+            Counter opcodes[N_OPCODES];  //indexed by OpCode, count = values computed (one per row for evaluate_batch)
+            Counter operators[MAX_OPERATORS];  //indexed by operator id, count = calls
+            std::uint64_t undefined[static_cast<unsigned>(Cause::N_CAUSES)];  //results not defined, by cause (a function operator can raise more than one flag)
+            Counter rechecks;  //count = evaluations (blocks of rows for evaluate_batch) done again with FpCheck::PER_OPERATOR because the first FpCheck::DEFERRED pass raised a flag. Their instructions are not added to opcodes and operators, which count the first pass only
+            std::uint64_t allocations;  //scratch blocks taken from the heap
+            std::uint64_t allocated_bytes;
+        };
+
+        bool enabled();  //returns true if the library was built with RPN_UTILS_PROFILE
+        Snapshot snapshot();
+        std::string to_json(const Snapshot &snap);  //the snapshot as a JSON object keyed by the names of the phases, opcodes, operators (only the ones called) and causes
+        void reset();  //starts counting again from zero (the following snapshots subtract the totals at the time of the reset)
+
+        //hooks called by the library, see the RPN_PROFILE_ macros below
+        bool enter_phase(Phase phase);  //returns false if the phase is already being timed on this thread (the nested time is counted once)
+        void leave_phase(Phase phase, std::uint64_t cycles);
+        void record_instruction(OpCode opcode, unsigned op, std::uint64_t count, std::uint64_t cycles);  //op is the id of a FUNC_OPERATOR, ignored for the other opcodes
+        void record_undefined(Cause cause);
+        void record_undefined_flags();  //records the causes of the floating point exception flags currently raised
+        void enter_recheck();  //until leave_recheck, the instructions and the divisions by zero are not recorded, since the first pass already did
+        void leave_recheck(std::uint64_t cycles);
+        std::pmr::memory_resource *counting_resource();  //forwards to std::pmr::new_delete_resource, counting the allocations
+
+        inline std::pmr::memory_resource *heap_resource()  //resource of the scratch memory of the functions that are not given one
+        {
+#ifdef RPN_UTILS_PROFILE
+            return counting_resource();
+#else
+            return std::pmr::new_delete_resource();
+#endif
+        }
+
+#ifdef RPN_UTILS_PROFILE
+        inline std::uint64_t now()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        class PhaseTimer  //times a phase from construction to destruction
+        {
+        public:
+            explicit PhaseTimer(Phase timed_phase) : phase(timed_phase), active(enter_phase(timed_phase)), start(now()) {}
+            ~PhaseTimer() { if(active) leave_phase(phase, now() - start); }
+            PhaseTimer(const PhaseTimer &) = delete;
+            PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+        private:
+            Phase phase;
+            bool active;
+            std::uint64_t start;
+        };
+
+        class InstructionTimer  //times an instruction applied to count values, from construction to destruction
+        {
+        public:
+            InstructionTimer(OpCode timed_opcode, unsigned timed_op, std::uint64_t timed_count) : opcode(timed_opcode), op(timed_op), count(timed_count), start(now()) {}
+            ~InstructionTimer() { record_instruction(opcode, op, count, now() - start); }
+            InstructionTimer(const InstructionTimer &) = delete;
+            InstructionTimer &operator=(const InstructionTimer &) = delete;
+
+        private:
+            OpCode opcode;
+            unsigned op;
+            std::uint64_t count;
+            std::uint64_t start;
+        };
+
+        class RecheckTimer  //times the pass repeated after a FpCheck::DEFERRED pass raised a flag, from construction to destruction
+        {
+        public:
+            RecheckTimer() : start((enter_recheck(), now())) {}
+            ~RecheckTimer() { leave_recheck(now() - start); }
+            RecheckTimer(const RecheckTimer &) = delete;
+            RecheckTimer &operator=(const RecheckTimer &) = delete;
+
+        private:
+            std::uint64_t start;
+        };
+#endif
+    }
+}
+
+#ifdef RPN_UTILS_PROFILE
+#define RPN_PROFILE_PHASE(phase) rpn::profile::PhaseTimer rpn_profile_phase_timer(rpn::profile::Phase::phase)
+#define RPN_PROFILE_INSTRUCTION(ins, count) rpn::profile::InstructionTimer rpn_profile_instruction_timer((ins).opcode, (ins).index, (count))
+#define RPN_PROFILE_OPERATION(opcode, op, count) rpn::profile::InstructionTimer rpn_profile_instruction_timer((opcode), (op), (count))
+#define RPN_PROFILE_UNDEFINED(cause) rpn::profile::record_undefined(rpn::profile::Cause::cause)
+#define RPN_PROFILE_UNDEFINED_FLAGS() rpn::profile::record_undefined_flags()
+#define RPN_PROFILE_RECHECK() rpn::profile::RecheckTimer rpn_profile_recheck_timer
+#else
+#define RPN_PROFILE_PHASE(phase) ((void)0)
+#define RPN_PROFILE_INSTRUCTION(ins, count) ((void)0)
+#define RPN_PROFILE_OPERATION(opcode, op, count) ((void)0)
+#define RPN_PROFILE_UNDEFINED(cause) ((void)0)
+#define RPN_PROFILE_UNDEFINED_FLAGS() ((void)0)
+#define RPN_PROFILE_RECHECK() ((void)0)
+#endif
+
+#endif
@@ -14,24 +14,133 @@
 #define RPN_UTILS_HPP
 
 #include <string>
+#include <cstddef>
 #include <vector>
 #include <stack>
 #include <cmath>
 #include <cfenv>
 #include <algorithm>
 #include <stdexcept>
-#include "additional_operators.hpp"
+#include <unordered_map>
+#include <memory_resource>
+#include "operator_registry.hpp"
 
 namespace rpn
 {
+    enum class OpCode : unsigned char {PUSH_VALUE = 0, PUSH_OPERAND, ADD, SUB, MUL, DIV, FUNC_OPERATOR, STORE_TEMP, LOAD_TEMP, STORE_RESULT};  //STORE_TEMP copies the value on top of the stack to a temporary slot (without popping it), LOAD_TEMP pushes the value of a temporary slot, STORE_RESULT pops the value on top of the stack into a result of an ExpressionSet (see expression_set.hpp; not accepted by CompiledExpr)
+
+    struct Instruction  //single step of a compiled rpn expression
+    {
+        OpCode opcode;
+        unsigned short n_operands;  //number of operands taken by a FUNC_OPERATOR
+        unsigned index;  //slot of the operand pushed by a PUSH_OPERAND, id of the operator (see operator_registry.hpp) of a FUNC_OPERATOR, temporary slot of a STORE_TEMP or LOAD_TEMP, index of the result of a STORE_RESULT
+        double value;  //value pushed by a PUSH_VALUE
+        operator_func func;  //function of the operator of a FUNC_OPERATOR (operator_table[index].func, nullptr for a closure operator)
+    };
+
+    enum class FpCheck : unsigned char  //how a compiled expression finds out that a function operator is not defined for its operands
+    {
+        PER_OPERATOR = 0,  //floating point exception flags cleared before and tested after every function operator
+        DEFERRED  //flags cleared once before the evaluation and tested once at the end; only if a flag was raised the evaluation is repeated with PER_OPERATOR, so the results are the same
+    };
+
+    class Context  //owns a set of additional operands. Different threads can convert and evaluate expressions concurrently as long as each one uses its own Context (or none of them modifies a shared one)
+    {
+    public:
+        Context();
+        Context(const Context &other);  //the copy gets its own version stamp
+        Context(Context &&other) noexcept;  //as above, and other gets a new stamp too (it is left empty)
+        Context &operator=(const Context &other);
+        Context &operator=(Context &&other) noexcept;
+
+        bool add_operand(const std::string &operand_name, double operand_value);  //same as rpn::add_operand, on the operands of this context
+        bool remove_operand(const std::string &operand_name);  //same as rpn::remove_operand, on the operands of this context
+        double get_operand(const std::string &operand_name) const;  //same as rpn::get_operand, on the operands of this context
+        bool has_operand(const std::string &operand_name) const;  //returns true if the operand is in this context
+        const std::unordered_map<std::string, double> &get_all_operands() const;  //same as rpn::get_all_operands, on the operands of this context
+        void clear_all_operands();  //same as rpn::clear_all_operands, on the operands of this context
+        unsigned long version() const;  //returns a stamp that changes every time the set of operand names changes (not when a value changes). Different contexts, copies included, never get the same stamp
+
+    private:
+        std::unordered_map<std::string, double> operands;
+        unsigned long version_stamp;
+    };
+
+    class SymbolTable  //assigns a dense slot (0, 1, 2, ...) to each operand name, so that operand values can be passed to a compiled expression as a plain array
+    {
+    public:
+        static const unsigned NPOS = static_cast<unsigned>(-1);
+
+        unsigned add(const std::string &operand_name);  //returns the slot of the operand, adding it to the table if it is not already there
+        unsigned find(const std::string &operand_name) const;  //returns the slot of the operand, or NPOS if the operand is not in the table
+        const std::string &name(unsigned slot) const;  //returns the name of the operand in the slot passed
+        const std::vector<std::string> &names() const;  //returns the names of all the operands, indexed by slot
+        unsigned size() const;  //returns the number of slots assigned
+        void clear();  //removes all the operands from the table
+
+    private:
+        std::unordered_map<std::string, unsigned> slots;
+        std::vector<std::string> slot_names;
+    };
+
+    class CompiledExpr  //rpn expression validated once, with literals already parsed and operators already resolved
+    {
+    public:
+        std::pair<bool, double> evaluate() const;  //evaluates the expression with the current values of the additional operands, returns a <bool, double> pair with the same meaning as rpn::evaluate
+        std::pair<bool, double> evaluate(const Context &ctx) const;  //evaluates the expression with the current values of the operands of the context. The operands are looked up by name only when the expression or the set of operand names of the context has changed since the last evaluation on this thread; otherwise their values are read through the addresses found then
+        std::pair<bool, double> evaluate(const double *operand_values) const;  //evaluates the expression taking the value of the operand in slot i from operand_values[i]
+        std::pair<bool, double> evaluate(const double *operand_values, std::pmr::memory_resource *scratch) const;  //as above, allocating the evaluation stack from scratch (for example an rpn::Arena, see arena.hpp)
+        void evaluate_batch(const double *const *operand_columns, std::size_t n_rows, double *results, bool *defined) const;  //evaluates the expression on n_rows rows, taking the value of the operand in slot i of row r from operand_columns[i][r]. results[r] and defined[r] receive the result of row r and whether it is defined, with the same meaning as the pair returned by evaluate
+        void evaluate_batch(const double *const *operand_columns, std::size_t n_rows, double *results, bool *defined, std::pmr::memory_resource *scratch) const;  //as above, allocating the stack of the blocks of rows from scratch
+
+        bool assign(const std::vector<Instruction> &program, const std::vector<std::string> &operand_names);  //replaces the compiled program, returns false (leaving the object empty) if the program is not a valid rpn expression
+        void clear();  //empties the compiled expression
+        bool empty() const;  //returns true if the object does not hold a valid expression
+
+        const std::vector<Instruction> &instructions() const;  //returns the compiled program
+        const std::vector<std::string> &operand_names() const;  //returns the names of the operands, indexed by slot
+        unsigned max_depth() const;  //returns the maximum number of values on the stack during the evaluation
+        unsigned temps() const;  //returns the number of temporary slots used by the program (see eliminate_common_subexpressions in optimizer.hpp)
+        void set_fp_check(FpCheck mode);  //sets how the evaluations check the function operators (PER_OPERATOR by default). Evaluations on many rows in DEFERRED mode check the flags once per block of rows
+        FpCheck fp_check() const;
+        bool has_func_operators() const;  //returns true if the program contains function operators (if not, there is nothing to check)
+
+    private:
+        std::pair<bool, double> run(const double *operand_values, bool check_each, std::pmr::memory_resource *scratch) const;  //evaluates the program, testing the flags after each function operator if check_each is true
+
+        std::vector<Instruction> program;
+        std::vector<std::string> operands;
+        std::vector<unsigned> used_slots;
+        unsigned depth = 0;
+        unsigned n_temps = 0;
+        FpCheck check = FpCheck::PER_OPERATOR;
+        bool calls_functions = false;
+        unsigned long stamp = 0;  //new at every assign (copies keep it), identifies the operand names for the bindings cached by evaluate(const Context &)
+    };
+
     bool infix_to_rpn(const std::string &infix_expr, std::vector<std::string> &rpn_expr);  //convert an infix expression to postfix (rpn)
+    bool infix_to_rpn(const Context &ctx, const std::string &infix_expr, std::vector<std::string> &rpn_expr);  //as above, using the operands of the context instead of the additional operands
+    bool infix_to_rpn(const std::string &infix_expr, std::vector<Instruction> &rpn_program, SymbolTable &symbols);  //convert an infix expression to an rpn program stored in a single array of instructions (literals already parsed, operands bound to their slot in the symbol table), ready to be passed to CompiledExpr::assign together with symbols.names()
+    bool infix_to_rpn(const Context &ctx, const std::string &infix_expr, std::vector<Instruction> &rpn_program, SymbolTable &symbols);  //as above, using the operands of the context instead of the additional operands
+    bool infix_to_rpn(const std::string &infix_expr, std::pmr::vector<std::pmr::string> &rpn_expr);  //convert an infix expression to postfix (rpn), allocating the rpn expression and all the scratch memory of the conversion from the memory resource of rpn_expr (for example an rpn::Arena, see arena.hpp)
+    bool infix_to_rpn(const Context &ctx, const std::string &infix_expr, std::pmr::vector<std::pmr::string> &rpn_expr);  //as above, using the operands of the context instead of the additional operands
+    std::string normalize_infix(const std::string &infix_expr);  //returns the infix expression without unnecessary space and tab characters and with all brackets turned into round ones. Two expressions with the same normalized form are converted to the same rpn expression
     std::pair<bool, double> evaluate(const std::vector<std::string> &rpn_expr);  //evaluate an expression rpn by substituting a value passed as an argument for the variable, return a <bool, double> pair, where the bool value indicates whether the expression is defined for that passed value and the double value is the result of the evaluation
+    std::pair<bool, double> evaluate(const Context &ctx, const std::vector<std::string> &rpn_expr);  //as above, using the operands of the context instead of the additional operands
+    std::pair<bool, double> evaluate(const std::pmr::vector<std::pmr::string> &rpn_expr);  //as the evaluate functions above, allocating the evaluation stack from the memory resource of rpn_expr
+    std::pair<bool, double> evaluate(const Context &ctx, const std::pmr::vector<std::pmr::string> &rpn_expr);
+
+    bool compile(const std::vector<std::string> &rpn_expr, CompiledExpr &compiled_expr);  //compiles an rpn expression so that it can be evaluated many times without parsing it again. Returns false if the rpn expression is not valid
+    bool compile(const std::vector<std::string> &rpn_expr, SymbolTable &symbols, CompiledExpr &compiled_expr);  //as above, but the operands get their slots from the symbol table passed (operands not yet in the table are added to it), so that many expressions can share the same array of operand values
+    bool compile(const Context &ctx, const std::vector<std::string> &rpn_expr, CompiledExpr &compiled_expr);  //as the compile functions above, using the operands of the context instead of the additional operands
+    bool compile(const Context &ctx, const std::vector<std::string> &rpn_expr, SymbolTable &symbols, CompiledExpr &compiled_expr);
 
     bool add_operand(const std::string &operand_name, double operand_value);  //adds an operand to the list of the additional operands. Returns true if the operation is successful
     bool remove_operand(const std::string &operand_name);  //removes an operand from the list of the additional operands. Returns true if the operation is successful, false if the operand isn't in the list
     double get_operand(const std::string &operand_name);  //returns the value (double) associated with the operand passed. If the operand does not exist it returns a default value
     const std::unordered_map<std::string, double> &get_all_operands();  //returns a constant reference to the std::unordered_map object where all additional operands are stored
     void clear_all_operands();  //deletes all the additional operands
+    unsigned long operands_version();  //same as Context::version, on the additional operands
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,755 @@
+/**
+ * @file static_expr.hpp
+ * @brief Header file for the compile-time expressions of the rpn_utils library (requires C++20)
+ *
+ * Conversion to rpn of infix expressions written in the source code, done by the compiler: rpn::static_expr<"...">
+ * tokenizes the expression and runs the shunting-yard algorithm in constant evaluation, with the same rules as
+ * infix_to_rpn, and evaluates the resulting program with straight-line code that the compiler can inline.
+ * A syntax error in the expression is a compile error
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef STATIC_EXPR_HPP
+#define STATIC_EXPR_HPP
+
+#if __cplusplus < 202002L
+#error "static_expr.hpp requires C++20"
+#endif
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "rpn_utils.hpp"
+
+namespace rpn
+{
+    template<std::size_t N> struct StaticString  //string literal passed as a template argument
+    {
+        char text[N] = {};
+
+        constexpr StaticString(const char (&str)[N])
+        {
+            for(std::size_t i = 0; i < N; ++i)
+                text[i] = str[i];
+        }
+
+        constexpr std::string_view view() const
+        {
+            return std::string_view(text, N - 1);
+        }
+    };
+
+    enum class StaticError : unsigned char {NONE = 0, INVALID_NUMBER, UNKNOWN_SYMBOL, MISPLACED_SIGN, UNBALANCED_PARENTHESES, INVALID_EXPRESSION};
+
+    namespace detail
+    {
+        //same precedence values as infix_to_rpn
+        constexpr unsigned short PRECEDENCE_VAL_OTHER = 0;
+        constexpr unsigned short PRECEDENCE_VAL_SUM = PRECEDENCE_VAL_OTHER + 1;
+        constexpr unsigned short PRECEDENCE_VAL_MULTIPLICATION = PRECEDENCE_VAL_SUM + 1;
+        constexpr unsigned short PRECEDENCE_VAL_FUNC_OPERATOR = PRECEDENCE_VAL_MULTIPLICATION + 1;
+
+        /*
+            Copies of the function operators of the additional_operators table, defined here so that they can be
+            inlined. They must compute the same results (and raise the same floating point exceptions) as the
+            functions in additional_operators.cpp, and the table below must list the same operators. root and ^ call
+            the library functions instead: inlined, pow with a constant exponent is replaced by the compiler (e.g.
+            pow(x, 2.0) by x * x), which does not always round as the pow of the C library does. The operators
+            registered at runtime cannot be used by a static_expr.
+        */
+        inline double static_sqrt(const double *argv) { return std::sqrt(argv[0]); }
+        inline double static_cbrt(const double *argv) { return std::pow(argv[0], 1.0/3.0); }
+        inline double static_sqr(const double *argv) { return std::pow(argv[0], 2.0); }
+        inline double static_cube(const double *argv) { return argv[0] * argv[0] * argv[0]; }
+        inline double static_logb(const double *argv) { return std::log(argv[1]) / std::log(argv[0]); }
+        inline double static_log(const double *argv) { return std::log10(argv[0]); }
+        inline double static_ln(const double *argv) { return std::log(argv[0]); }
+        inline double static_sin(const double *argv) { return std::sin(argv[0]); }
+        inline double static_cos(const double *argv) { return std::cos(argv[0]); }
+        inline double static_tan(const double *argv) { return std::tan(argv[0]); }
+        inline double static_asin(const double *argv) { return std::asin(argv[0]); }
+        inline double static_acos(const double *argv) { return std::acos(argv[0]); }
+        inline double static_atan(const double *argv) { return std::atan(argv[0]); }
+        inline double static_sinh(const double *argv) { return std::sinh(argv[0]); }
+        inline double static_cosh(const double *argv) { return std::cosh(argv[0]); }
+        inline double static_tanh(const double *argv) { return std::tanh(argv[0]); }
+        inline double static_asinh(const double *argv) { return std::asinh(argv[0]); }
+        inline double static_acosh(const double *argv) { return std::acosh(argv[0]); }
+        inline double static_atanh(const double *argv) { return std::atanh(argv[0]); }
+
+        struct StaticOperator
+        {
+            std::string_view name;
+            unsigned short n_operands;
+            unsigned short precedence;
+            operator_func func;
+        };
+
+        inline constexpr StaticOperator static_operators[] = {  //acronym, number of operands, precedence value, function pointer
+            {"root", 2, 1, wfunc_root}, {"sqrt", 1, 1, static_sqrt}, {"cbrt", 1, 1, static_cbrt},
+            {"^", 2, 0, wfunc_pow}, {"sqr", 1, 1, static_sqr}, {"cube", 1, 1, static_cube},
+            {"logb", 2, 1, static_logb}, {"log", 1, 1, static_log}, {"ln", 1, 1, static_ln},
+            {"sin", 1, 1, static_sin}, {"cos", 1, 1, static_cos}, {"tan", 1, 1, static_tan},
+            {"asin", 1, 1, static_asin}, {"acos", 1, 1, static_acos}, {"atan", 1, 1, static_atan},
+            {"sinh", 1, 1, static_sinh}, {"cosh", 1, 1, static_cosh}, {"tanh", 1, 1, static_tanh},
+            {"asinh", 1, 1, static_asinh}, {"acosh", 1, 1, static_acosh}, {"atanh", 1, 1, static_atanh}
+        };
+        inline constexpr unsigned n_static_operators = sizeof(static_operators) / sizeof(static_operators[0]);
+
+        constexpr bool static_islower(char c) { return c >= 'a' && c <= 'z'; }
+        constexpr bool static_isdigit(char c) { return c >= '0' && c <= '9'; }
+        constexpr bool static_isblank(char c) { return c == ' ' || c == '\t'; }
+        constexpr bool static_issign(char c) { return c == '+' || c == '-'; }
+
+        inline void opaque(double &value)  //hides the value from the optimizer, so that a product is not fused with the sum that uses it (fused multiply-add) and a function operator is not computed by the compiler on constant operands (with a result that may differ in the last bit from the C library), which the other evaluators never do
+        {
+#if defined(__GNUC__) && defined(__SSE2__)
+            asm("" : "+x"(value));
+#elif defined(__GNUC__) && defined(__aarch64__)
+            asm("" : "+w"(value));
+#else
+            (void)value;  //elsewhere the results are the same as those of CompiledExpr only without floating point contraction
+#endif
+        }
+
+        constexpr unsigned find_static_operator(std::string_view name)  //returns the position of the operator in static_operators, or OPERATOR_NPOS
+        {
+            for(unsigned i = 0; i < n_static_operators; ++i)
+                if(static_operators[i].name == name)
+                    return i;
+            return OPERATOR_NPOS;
+        }
+
+
+        class StaticBigUint  //unsigned integer of up to 4096 bits, used to round the literals exactly as std::from_chars does
+        {
+        public:
+            constexpr void mul_add(std::uint32_t factor, std::uint32_t addend)  //*this = *this * factor + addend
+            {
+                std::uint64_t carry = addend;
+                for(std::size_t i = 0; i < n; ++i){
+                    std::uint64_t t = static_cast<std::uint64_t>(limb[i]) * factor + carry;
+                    limb[i] = static_cast<std::uint32_t>(t);
+                    carry = t >> 32;
+                }
+                if(carry != 0)
+                    limb[n++] = static_cast<std::uint32_t>(carry);
+            }
+
+            constexpr void shift_left(std::size_t bits)
+            {
+                if(n == 0)
+                    return;
+
+                const std::size_t words = bits / 32, rest = bits % 32;
+                limb[n + words] = 0;
+                for(std::size_t i = n; i-- > 0; ){
+                    if(rest != 0)
+                        limb[i + words + 1] |= limb[i] >> (32 - rest);
+                    limb[i + words] = limb[i] << rest;
+                }
+                for(std::size_t i = 0; i < words; ++i)
+                    limb[i] = 0;
+                n += words + 1;
+                trim();
+            }
+
+            constexpr void subtract(const StaticBigUint &other)  //*this -= other, with other <= *this
+            {
+                std::int64_t borrow = 0;
+                for(std::size_t i = 0; i < n; ++i){
+                    std::int64_t t = static_cast<std::int64_t>(limb[i]) - (i < other.n ? other.limb[i] : 0) - borrow;
+                    borrow = t < 0;
+                    limb[i] = static_cast<std::uint32_t>(t + (borrow << 32));
+                }
+                trim();
+            }
+
+            constexpr int compare(const StaticBigUint &other) const
+            {
+                if(n != other.n)
+                    return n < other.n ? -1 : 1;
+                for(std::size_t i = n; i-- > 0; )
+                    if(limb[i] != other.limb[i])
+                        return limb[i] < other.limb[i] ? -1 : 1;
+                return 0;
+            }
+
+            constexpr long bit_length() const
+            {
+                if(n == 0)
+                    return 0;
+                long bits = 32 * static_cast<long>(n - 1);
+                for(std::uint32_t top = limb[n - 1]; top != 0; top >>= 1)
+                    ++bits;
+                return bits;
+            }
+
+            constexpr bool zero() const
+            {
+                return n == 0;
+            }
+
+        private:
+            constexpr void trim()
+            {
+                while(n > 0 && limb[n - 1] == 0)
+                    --n;
+            }
+
+            static constexpr std::size_t LIMBS = 128;
+            std::uint32_t limb[LIMBS + 1] = {};
+            std::size_t n = 0;  //limbs in use
+        };
+
+        constexpr double scale_static(double value, long exp2)  //returns value * 2^exp2, exact if the result is representable
+        {
+            for(; exp2 > 0; --exp2)
+                value *= 2.0;
+            for(; exp2 < 0; ++exp2)
+                value *= 0.5;
+            return value;
+        }
+
+        constexpr bool parse_static_literal(std::string_view text, double &value)  //parses a literal read by the lexer (digits with at most one dot, optional exponent), with the same result as parse_literal in rpn_utils.cpp. Returns false if it is not a valid number or it is out of the range of double
+        {
+            const std::size_t MAX_DIGITS = 768;  //significant digits kept: enough to tell any double halfway point (767 digits at most) from the values next to it
+            StaticBigUint mantissa;
+            std::uint64_t small_mantissa = 0;
+            std::size_t pos = 0, n_digits = 0, n_dots = 0;
+            bool any_digit = false, sticky = false;  //sticky: a nonzero digit was dropped after the first MAX_DIGITS
+            long exp10 = 0;
+
+            for(; pos < text.size() && (static_isdigit(text[pos]) || text[pos] == '.'); ++pos){
+                if(text[pos] == '.'){
+                    ++n_dots;
+                    continue;
+                }
+
+                any_digit = true;
+                if(n_digits == MAX_DIGITS){  //dropped, only whether it is zero matters
+                    if(n_dots == 0)
+                        ++exp10;
+                    sticky = sticky || text[pos] != '0';
+                    continue;
+                }
+                if(n_dots > 0)
+                    --exp10;
+                if(n_digits == 0 && text[pos] == '0')  //leading zero
+                    continue;
+                ++n_digits;
+                mantissa.mul_add(10, text[pos] - '0');
+                if(n_digits <= 19)
+                    small_mantissa = small_mantissa * 10 + (text[pos] - '0');
+            }
+
+            if(!any_digit || n_dots > 1)
+                return false;
+            if(sticky){  //a 1 after the digits kept: the value is between the truncated one and the next one with as many digits, so it is rounded like the full literal
+                mantissa.mul_add(10, 1);
+                ++n_digits;
+                --exp10;
+            }
+
+            if(pos < text.size()){  //exponent, the lexer reads it only if digits follow
+                bool negative = false;
+                long exponent = 0;
+                if(static_issign(text[++pos]))
+                    negative = text[pos++] == '-';
+                for(; pos < text.size(); ++pos)
+                    if(exponent < 100000)
+                        exponent = exponent * 10 + (text[pos] - '0');
+                exp10 += negative ? -exponent : exponent;
+            }
+
+            if(mantissa.zero()){
+                value = 0.0;
+                return true;
+            }
+            if(static_cast<long>(n_digits) + exp10 > 310 || static_cast<long>(n_digits) + exp10 < -324)  //certainly too large, or rounded to zero
+                return false;
+
+            if(n_digits <= 19 && small_mantissa <= (std::uint64_t(1) << 53) && exp10 >= -22 && exp10 <= 22){  //both factors are exact, a single rounding
+                double power = 1.0;
+                for(long i = 0; i < (exp10 < 0 ? -exp10 : exp10); ++i)
+                    power *= 10.0;
+                value = (exp10 < 0) ? static_cast<double>(small_mantissa) / power : static_cast<double>(small_mantissa) * power;
+                return true;
+            }
+
+            //the value is num / den, rounded to the nearest double (ties to even)
+            StaticBigUint num = mantissa, den;
+            den.mul_add(0, 1);
+            for(long i = 0; i < exp10; ++i)
+                num.mul_add(10, 0);
+            for(long i = 0; i > exp10; --i)
+                den.mul_add(10, 0);
+
+            long exp2 = num.bit_length() - den.bit_length();  //2^exp2 <= num / den < 2^(exp2 + 1), once adjusted
+            StaticBigUint lhs = num, rhs = den;
+            if(exp2 >= 0)
+                rhs.shift_left(exp2);
+            else
+                lhs.shift_left(-exp2);
+            if(lhs.compare(rhs) < 0)
+                --exp2;
+            if(exp2 > 1023)
+                return false;
+
+            const long ulp = (exp2 - 52 > -1074) ? exp2 - 52 : -1074;  //exponent of the last bit of the mantissa
+            if(ulp < 0)
+                num.shift_left(-ulp);
+            else
+                den.shift_left(ulp);
+
+            std::uint64_t quotient = 0;  //less than 2^53
+            for(int bit = 53; bit >= 0; --bit){
+                StaticBigUint part = den;
+                part.shift_left(bit);
+                if(num.compare(part) >= 0){
+                    num.subtract(part);
+                    quotient |= std::uint64_t(1) << bit;
+                }
+            }
+
+            num.shift_left(1);  //twice the remainder
+            const int half = num.compare(den);
+            if(half > 0 || (half == 0 && (quotient & 1) != 0))
+                ++quotient;
+
+            if(quotient == 0 || (quotient == (std::uint64_t(1) << 53) && ulp + 53 > 1023))
+                return false;
+            value = (ulp < -1022) ? scale_static(scale_static(static_cast<double>(quotient), -1022), ulp + 1022) : scale_static(static_cast<double>(quotient), ulp);
+            return true;
+        }
+
+
+        enum class StaticTokenType : unsigned char {NO_TYPE = 0, OPERAND, OPERATOR, OPEN_PARENTHESIS, CLOSE_PARENTHESIS};
+
+        struct StaticToken  //token of an infix expression, see Token in rpn_utils.cpp
+        {
+            StaticTokenType type = StaticTokenType::NO_TYPE;
+            std::string_view text;
+            bool literal = false;  //true for a numeric operand
+            double value = 0.0;  //value of a numeric operand, already negative if preceded by a unary minus
+            unsigned short precedence = PRECEDENCE_VAL_OTHER;
+            unsigned short n_operands = 0;  //number of operands taken by a function operator
+            unsigned op = OPERATOR_NPOS;  //position of a function operator in static_operators
+        };
+
+        struct StaticInstruction  //Instruction with the function operator identified by its position in static_operators
+        {
+            OpCode opcode = OpCode::PUSH_VALUE;
+            unsigned short n_operands = 0;
+            unsigned index = 0;
+            double value = 0.0;
+        };
+
+        template<std::size_t Length> struct StaticProgram  //result of the conversion of an expression of Length characters
+        {
+            static constexpr std::size_t CAPACITY = 2 * Length + 1;  //each unary minus adds at most two instructions ("0" and "-"), and takes at least one character
+
+            StaticInstruction code[CAPACITY] = {};
+            unsigned tops[CAPACITY] = {};  //values on the stack before each instruction
+            std::size_t size = 0;
+            std::string_view names[CAPACITY] = {};  //names of the operands, indexed by slot
+            unsigned n_operands = 0;
+            unsigned depth = 0;  //maximum number of values on the stack
+            bool calls_functions = false;
+            StaticError error = StaticError::NONE;
+        };
+
+        template<std::size_t Length> class StaticLexer  //constant-evaluated copy of the Lexer of rpn_utils.cpp: reads all the tokens of the expression, resolving the unary signs in the same way
+        {
+        public:
+            static constexpr std::size_t CAPACITY = 4 * Length + 4;  //a unary minus adds at most "(", "0", "-" and ")"
+
+            StaticToken tokens[CAPACITY] = {};
+            std::size_t n_tokens = 0;
+            StaticError error = StaticError::NONE;
+
+            constexpr explicit StaticLexer(std::string_view infix_expr) : expr(infix_expr)
+            {
+                const StaticToken zero = {StaticTokenType::OPERAND, "0", true, 0.0, PRECEDENCE_VAL_OTHER, 0, OPERATOR_NPOS};
+                const StaticToken minus = {StaticTokenType::OPERATOR, "-", false, 0.0, PRECEDENCE_VAL_SUM, 0, OPERATOR_NPOS};
+                const StaticToken plus = {StaticTokenType::OPERATOR, "+", false, 0.0, PRECEDENCE_VAL_SUM, 0, OPERATOR_NPOS};
+                const StaticToken open = {StaticTokenType::OPEN_PARENTHESIS, "(", false, 0.0, PRECEDENCE_VAL_OTHER, 0, OPERATOR_NPOS};
+                StaticToken curr, following;
+
+                while(error == StaticError::NONE && read(curr)){
+                    if(curr.type != StaticTokenType::OPERATOR || !static_issign(curr.text.front())){
+                        emit(curr, true);
+                        continue;
+                    }
+
+                    bool is_minus = curr.text.front() == '-';
+                    for(; pos < expr.size() && (static_issign(expr[pos]) || static_isblank(expr[pos])); ++pos)
+                        if(expr[pos] == '-')
+                            is_minus = !is_minus;
+
+                    const StaticTokenType prev_type = (n_tokens > 0) ? tokens[n_tokens - 1].type : StaticTokenType::NO_TYPE;
+                    if(prev_type == StaticTokenType::OPERAND || prev_type == StaticTokenType::CLOSE_PARENTHESIS){  //binary operator
+                        emit(is_minus ? minus : plus, true);
+                        continue;
+                    }
+
+                    if(!is_minus)  //unary plus
+                        continue;
+
+                    if(!read(following)){
+                        if(error == StaticError::NONE)
+                            error = StaticError::MISPLACED_SIGN;
+                        break;
+                    }
+
+                    if(following.literal){  //negative number
+                        following.value = -following.value;
+                        emit(following, true);
+                    }
+                    else if(following.type == StaticTokenType::OPERAND || following.type == StaticTokenType::OPEN_PARENTHESIS || (following.type == StaticTokenType::OPERATOR && following.n_operands > 0)){
+                        negatives[n_negatives++] = {(following.type == StaticTokenType::OPERATOR) ? following.n_operands : 1u, depth};
+                        emit(open, false);
+                        emit(zero, false);
+                        emit(minus, false);
+                        emit(following, true);
+                    }
+                    else
+                        error = StaticError::MISPLACED_SIGN;
+                }
+
+                if(error == StaticError::NONE)  //end of the expression, closes the negative blocks still open
+                    for(; n_negatives > 0; --n_negatives)
+                        tokens[n_tokens++] = {StaticTokenType::CLOSE_PARENTHESIS, ")"};
+            }
+
+        private:
+            struct NegativeBlock
+            {
+                unsigned remaining = 0;
+                std::size_t depth = 0;
+            };
+
+            constexpr bool read(StaticToken &token)  //reads the next token, returns false at the end of the expression or on an error
+            {
+                while(pos < expr.size() && static_isblank(expr[pos]))
+                    ++pos;
+                if(pos >= expr.size())
+                    return false;
+
+                const std::size_t begin = pos;
+                token = StaticToken();
+
+                if(static_islower(expr[pos])){
+                    while(pos < expr.size() && static_islower(expr[pos]))
+                        ++pos;
+                    token.text = expr.substr(begin, pos - begin);
+                }
+                else if(static_isdigit(expr[pos]) || expr[pos] == '.'){
+                    while(pos < expr.size() && (static_isdigit(expr[pos]) || expr[pos] == '.'))
+                        ++pos;
+
+                    if(pos < expr.size() && (expr[pos] == 'e' || expr[pos] == 'E')){  //exponent, only if digits follow
+                        std::size_t exp = pos + 1;
+                        if(exp < expr.size() && static_issign(expr[exp]))
+                            ++exp;
+                        if(exp < expr.size() && static_isdigit(expr[exp]))
+                            for(pos = exp; pos < expr.size() && static_isdigit(expr[pos]); ++pos)
+                                ;
+                    }
+
+                    token.text = expr.substr(begin, pos - begin);
+                    token.type = StaticTokenType::OPERAND;
+                    token.literal = true;
+                    if(!parse_static_literal(token.text, token.value)){
+                        error = StaticError::INVALID_NUMBER;
+                        return false;
+                    }
+                    return true;
+                }
+                else
+                    token.text = expr.substr(pos++, 1);
+
+                switch(token.text.front()){
+                    case '(': case '[': case '{':
+                        token.type = StaticTokenType::OPEN_PARENTHESIS;
+                        return true;
+                    case ')': case ']': case '}':
+                        token.type = StaticTokenType::CLOSE_PARENTHESIS;
+                        return true;
+                    case '+': case '-':
+                        token.type = StaticTokenType::OPERATOR;
+                        token.precedence = PRECEDENCE_VAL_SUM;
+                        return true;
+                    case '*': case '/':
+                        token.type = StaticTokenType::OPERATOR;
+                        token.precedence = PRECEDENCE_VAL_MULTIPLICATION;
+                        return true;
+                }
+
+                const unsigned op = find_static_operator(token.text);
+                if(op != OPERATOR_NPOS){
+                    token.type = StaticTokenType::OPERATOR;
+                    token.precedence = PRECEDENCE_VAL_FUNC_OPERATOR + static_operators[op].precedence;
+                    token.n_operands = static_operators[op].n_operands;
+                    token.op = op;
+                }
+                else if(static_islower(token.text.front()))  //every other name is an operand
+                    token.type = StaticTokenType::OPERAND;
+                else{
+                    error = StaticError::UNKNOWN_SYMBOL;
+                    return false;
+                }
+                return true;
+            }
+
+            constexpr void emit(const StaticToken &token, bool real)  //appends a token, real is false for the tokens added by the lexer
+            {
+                tokens[n_tokens++] = token;
+                if(!real)
+                    return;
+
+                switch(token.type){
+                    case StaticTokenType::OPERAND:
+                        operand_read(depth);
+                        break;
+                    case StaticTokenType::OPEN_PARENTHESIS:
+                        ++depth;
+                        break;
+                    case StaticTokenType::CLOSE_PARENTHESIS:
+                        if(depth > 0)
+                            operand_read(--depth);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            constexpr void operand_read(std::size_t at_depth)  //closes the negative blocks completed by an operand (or a block in parentheses) ending at the depth passed
+            {
+                for(std::size_t i = 0; i < n_negatives; ++i)
+                    if(negatives[i].depth == at_depth && negatives[i].remaining > 0)
+                        --negatives[i].remaining;
+
+                for(; n_negatives > 0 && negatives[n_negatives - 1].remaining == 0; --n_negatives)
+                    tokens[n_tokens++] = {StaticTokenType::CLOSE_PARENTHESIS, ")"};
+            }
+
+            std::string_view expr;
+            std::size_t pos = 0;
+            std::size_t depth = 0;  //number of open parentheses
+            NegativeBlock negatives[Length + 1] = {};
+            std::size_t n_negatives = 0;
+        };
+
+        template<std::size_t Length> constexpr void output_static(StaticProgram<Length> &program, const StaticToken &token)  //appends the instruction of the token, see token_instruction in rpn_utils.cpp
+        {
+            StaticInstruction &ins = program.code[program.size++];
+
+            if(token.type == StaticTokenType::OPERAND){
+                if(token.literal){
+                    ins.value = token.value;
+                    return;
+                }
+
+                ins.opcode = OpCode::PUSH_OPERAND;
+                for(ins.index = 0; ins.index < program.n_operands && program.names[ins.index] != token.text; ++ins.index)
+                    ;
+                if(ins.index == program.n_operands)
+                    program.names[program.n_operands++] = token.text;
+            }
+            else if(token.n_operands > 0){
+                ins.opcode = OpCode::FUNC_OPERATOR;
+                ins.n_operands = token.n_operands;
+                ins.index = token.op;
+                program.calls_functions = true;
+            }
+            else
+                ins.opcode = (token.text.front() == '+') ? OpCode::ADD : (token.text.front() == '-') ? OpCode::SUB : (token.text.front() == '*') ? OpCode::MUL : OpCode::DIV;
+        }
+
+        template<std::size_t N> consteval StaticProgram<N - 1> parse_static(const StaticString<N> &infix_expr)  //converts the expression with the shunting-yard algorithm of infix_to_rpn and checks the program
+        {
+            StaticProgram<N - 1> program;
+            StaticLexer<N - 1> lexer(infix_expr.view());
+            StaticToken op[StaticLexer<N - 1>::CAPACITY] = {};
+            std::size_t n_op = 0;
+
+            if(lexer.error != StaticError::NONE){
+                program.error = lexer.error;
+                return program;
+            }
+
+            for(std::size_t i = 0; i < lexer.n_tokens; ++i){
+                const StaticToken &token = lexer.tokens[i];
+
+                switch(token.type){
+                    case StaticTokenType::OPERAND:
+                        output_static(program, token);
+                        break;
+
+                    case StaticTokenType::OPERATOR:
+                        for(; n_op > 0 && token.precedence < op[n_op - 1].precedence; --n_op)
+                            output_static(program, op[n_op - 1]);
+                        op[n_op++] = token;
+                        break;
+
+                    case StaticTokenType::OPEN_PARENTHESIS:
+                        op[n_op++] = token;
+                        break;
+
+                    default:
+                        for(; n_op > 0 && op[n_op - 1].type != StaticTokenType::OPEN_PARENTHESIS; --n_op)
+                            output_static(program, op[n_op - 1]);
+                        if(n_op == 0){  //there is no corresponding open parenthesis
+                            program.error = StaticError::UNBALANCED_PARENTHESES;
+                            return program;
+                        }
+                        --n_op;
+                        break;
+                }
+            }
+
+            for(; n_op > 0; --n_op){
+                if(op[n_op - 1].type == StaticTokenType::OPEN_PARENTHESIS){  //there is no corresponding close parenthesis
+                    program.error = StaticError::UNBALANCED_PARENTHESES;
+                    return program;
+                }
+                output_static(program, op[n_op - 1]);
+            }
+
+            long checker = 0;  //same check as the one of the compiled programs
+            for(std::size_t i = 0; i < program.size; ++i){
+                program.tops[i] = static_cast<unsigned>(checker);
+                switch(program.code[i].opcode){
+                    case OpCode::PUSH_VALUE: case OpCode::PUSH_OPERAND:
+                        ++checker;
+                        break;
+                    case OpCode::FUNC_OPERATOR:
+                        checker -= program.code[i].n_operands - 1;
+                        break;
+                    default:
+                        --checker;
+                        break;
+                }
+
+                if(checker <= 0)
+                    break;
+                if(static_cast<unsigned long>(checker) > program.depth)
+                    program.depth = checker;
+            }
+
+            if(checker != 1)
+                program.error = StaticError::INVALID_EXPRESSION;
+            return program;
+        }
+    }
+
+
+    template<StaticString Expr> class static_expr  //infix expression converted to rpn at compile time. Its operands are all the lowercase names that are not function operators, with their slots in order of first appearance
+    {
+        static constexpr detail::StaticProgram<sizeof(Expr.text) - 1> program = detail::parse_static(Expr);
+
+        static_assert(program.error != StaticError::INVALID_NUMBER, "static_expr: invalid numeric literal");
+        static_assert(program.error != StaticError::UNKNOWN_SYMBOL, "static_expr: unknown symbol, only lowercase names, numbers, + - * / ^, parentheses and blanks are accepted");
+        static_assert(program.error != StaticError::MISPLACED_SIGN, "static_expr: a unary minus must be followed by an operand, a function operator or a parenthesis");
+        static_assert(program.error != StaticError::UNBALANCED_PARENTHESES, "static_expr: unbalanced parentheses");
+        static_assert(program.error != StaticError::INVALID_EXPRESSION, "static_expr: the operators do not have the right number of operands");
+
+    public:
+        static constexpr std::size_t operands = program.n_operands;  //number of operands
+
+        static constexpr std::string_view operand_name(unsigned slot)  //returns the name of the operand in the slot passed
+        {
+            return program.names[slot];
+        }
+
+        std::pair<bool, double> operator()(const double *operand_values) const  //evaluates the expression taking the value of the operand in slot i from operand_values[i], with the same results as CompiledExpr::evaluate
+        {
+            if constexpr(!program.calls_functions)
+                return run<true>(operand_values, std::make_index_sequence<program.size>());
+            else{  //the flags are checked once, as by FpCheck::DEFERRED
+                std::feclearexcept(FE_ALL_EXCEPT);
+                const std::pair<bool, double> result = run<false>(operand_values, std::make_index_sequence<program.size>());
+                if(!std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW))
+                    return result;
+                return run<true>(operand_values, std::make_index_sequence<program.size>());
+            }
+        }
+
+        template<typename... Values> requires (sizeof...(Values) == operands && (std::is_convertible_v<Values, double> && ...))
+        std::pair<bool, double> operator()(Values... values) const  //as above, with the values of the operands in the order of their slots
+        {
+            const std::array<double, sizeof...(Values)> operand_values = {static_cast<double>(values)...};
+            return (*this)(operand_values.data());
+        }
+
+        static std::vector<Instruction> instructions()  //returns the program as the instructions of a CompiledExpr, with the slots of operand_name
+        {
+            std::vector<Instruction> rpn_program;
+            for(std::size_t i = 0; i < program.size; ++i){
+                const detail::StaticInstruction &ins = program.code[i];
+                Instruction converted = {ins.opcode, ins.n_operands, ins.index, ins.value, nullptr};
+                if(ins.opcode == OpCode::FUNC_OPERATOR){
+                    converted.index = find_operator(std::string(detail::static_operators[ins.index].name));
+                    converted.func = operator_table[converted.index].func;
+                }
+                rpn_program.push_back(converted);
+            }
+            return rpn_program;
+        }
+
+    private:
+        template<std::size_t I, bool CheckEach> static bool step(double *stack, const double *operand_values)  //executes instruction I, returns false if the expression is not defined
+        {
+            constexpr detail::StaticInstruction ins = program.code[I];
+            constexpr unsigned top = program.tops[I];
+
+            if constexpr(ins.opcode == OpCode::PUSH_VALUE)
+                stack[top] = ins.value;
+            else if constexpr(ins.opcode == OpCode::PUSH_OPERAND)
+                stack[top] = operand_values[ins.index];
+            else if constexpr(ins.opcode == OpCode::ADD)
+                stack[top - 2] += stack[top - 1];
+            else if constexpr(ins.opcode == OpCode::SUB)
+                stack[top - 2] -= stack[top - 1];
+            else if constexpr(ins.opcode == OpCode::MUL){
+                stack[top - 2] *= stack[top - 1];
+                detail::opaque(stack[top - 2]);
+            }
+            else if constexpr(ins.opcode == OpCode::DIV){
+                if(stack[top - 1] == 0)
+                    return false;
+                stack[top - 2] /= stack[top - 1];
+            }
+            else{
+                constexpr operator_func func = detail::static_operators[ins.index].func;
+                for(unsigned short j = top - ins.n_operands; j < top; ++j)
+                    detail::opaque(stack[j]);
+                if constexpr(CheckEach)
+                    std::feclearexcept(FE_ALL_EXCEPT);
+                stack[top - ins.n_operands] = func(stack + top - ins.n_operands);
+                detail::opaque(stack[top - ins.n_operands]);  //cube, for instance, ends with a product
+                if constexpr(CheckEach)
+                    if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW))
+                        return false;
+            }
+            return true;
+        }
+
+        template<bool CheckEach, std::size_t... I> static std::pair<bool, double> run(const double *operand_values, std::index_sequence<I...>)
+        {
+            double stack[program.depth > 0 ? program.depth : 1];
+            if(!(step<I, CheckEach>(stack, operand_values) && ...))
+                return std::make_pair(false, 0.0);
+            return std::make_pair(true, stack[0]);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @file stream_eval.hpp
+ * @brief Header file for the streaming evaluation module of the rpn_utils library
+ *
+ * Evaluation of infix expressions over all the rows of a CSV file or of a file of raw little-endian doubles. The input
+ * is memory-mapped and parsed in place, block after block of rows, and the columns are bound to the variables of the
+ * expressions by name
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef STREAM_EVAL_HPP
+#define STREAM_EVAL_HPP
+
+#include <ostream>
+#include "rpn_utils.hpp"
+#include "expression_set.hpp"
+
+namespace rpn
+{
+    class MappedFile  //read-only view of the contents of a whole file, memory-mapped where the platform allows it
+    {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+        bool open(const std::string &path);  //maps the file, returns false if it cannot be opened
+        void close();
+        const char *data() const;
+        std::size_t size() const;
+
+    private:
+        const char *bytes = nullptr;
+        std::size_t length = 0;
+        bool mapped = false;
+        std::vector<char> buffer;  //contents of the file when it cannot be mapped
+    };
+
+    enum class StreamFormat : unsigned char
+    {
+        CSV = 0,  //comma separated values, the first line holds the names of the columns
+        BINARY  //little-endian doubles, all the columns of the first row, then all the columns of the second row, ...
+    };
+
+    struct StreamStats  //result of StreamEvaluator::run
+    {
+        std::size_t rows;  //number of rows evaluated
+        double seconds;  //time spent reading, evaluating and writing
+        double rows_per_second;
+    };
+
+    class StreamEvaluator  //evaluates a set of expressions on every row of an input file
+    {
+    public:
+        static const std::size_t BLOCK_ROWS = 4096;  //rows parsed and evaluated together
+
+        bool open(const std::string &path);  //opens a CSV file and reads the names of the columns from its first line. Returns false if the file cannot be opened or has no header
+        bool open(const std::string &path, const std::vector<std::string> &column_names);  //opens a BINARY file with the columns passed. Returns false if the file cannot be opened or its size is not a whole number of rows
+        const std::vector<std::string> &columns() const;  //names of the columns of the input (only the ones that are valid operand names, see rpn::add_operand, can be used by the expressions)
+
+        bool add_expression(const std::string &infix_expr);  //adds an expression whose variables are columns of the input, returns false if it is not valid (like infix_to_rpn, it throws std::runtime_error for a name that is neither a column nor an operator)
+        std::size_t expressions() const;  //number of expressions added
+
+        StreamStats run(std::ostream &out, StreamFormat output_format = StreamFormat::CSV);  //evaluates the expressions on all the rows and writes one row of results per input row. In CSV a header with the expressions comes first and an undefined result is an empty field; in BINARY an undefined result is a NaN. Throws std::runtime_error if a row of a CSV file has the wrong number of fields or a field is not a number
+
+    private:
+        std::size_t parse_csv_block(std::size_t &pos, std::size_t &line, std::vector<std::vector<double>> &block) const;  //parses the rows starting at byte pos into block (one vector per column), returns the number of rows parsed (0 at the end of the file)
+        std::size_t read_binary_block(std::size_t &pos, std::vector<std::vector<double>> &block) const;  //as above, for a BINARY file
+
+        MappedFile input;
+        StreamFormat format = StreamFormat::CSV;
+        std::size_t data_start = 0;  //first byte after the header
+        std::vector<std::string> column_names;
+        std::vector<char> used;  //true for the columns read by at least one expression
+        Context ctx;  //one operand per column
+        ExpressionSet set;
+        std::vector<std::string> texts;  //the expressions as they were added
+    };
+}
+
+#endif
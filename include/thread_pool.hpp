@@ -0,0 +1,75 @@
+/**
+ * @file thread_pool.hpp
+ * @brief Header file for the parallel evaluation module of the rpn_utils library
+ *
+ * A pool of threads that share the iterations of a loop by work stealing, and the evaluation of compiled expressions
+ * on many rows split over the threads of a pool
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "rpn_utils.hpp"
+#include "expression_set.hpp"
+
+namespace rpn
+{
+    class ThreadPool  //fixed set of threads running the iterations of parallel_for. Each thread starts from its own range of iterations and, once it is over, steals half of the range of another thread
+    {
+    public:
+        explicit ThreadPool(unsigned n_threads = 0);  //n_threads threads in all, counting the one that calls parallel_for (0 = std::thread::hardware_concurrency). With 1 the iterations run on the calling thread only
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        ~ThreadPool();
+
+        unsigned threads() const;  //number of threads, counting the calling one
+        void parallel_for(std::size_t n_tasks, const std::function<void(std::size_t)> &task);  //calls task(i) for i = 0 ... n_tasks - 1, in any order and on any thread, and returns when all the calls are over. If calls throw, all the other calls still run and the first exception is thrown again once they are over. Calls from different threads are run one after the other; a call made by a task running on the pool (on any pool) runs its iterations serially on the calling thread
+
+    private:
+        struct Queue  //range of iterations not started yet of a thread, aligned so that two queues never share a cache line
+        {
+            alignas(64) std::mutex mutex;
+            std::size_t first = 0;
+            std::size_t last = 0;
+        };
+
+        void worker(unsigned self);  //loop of the threads of the pool
+        void run_tasks(unsigned self);  //runs iterations until there are none left to take or to steal
+        bool take(unsigned self, std::size_t &task_index);  //takes the next iteration of the own range, or steals half of the range of another thread
+        void task_done();
+
+        std::unique_ptr<Queue[]> queues;
+        std::vector<std::thread> workers;
+        unsigned n_threads;
+
+        std::mutex run_mutex;  //serializes the calls to parallel_for
+        std::mutex state_mutex;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+        unsigned long generation = 0;  //number of parallel_for started, the workers wait for it to change
+        bool stopping = false;
+
+        const std::function<void(std::size_t)> *current_task = nullptr;
+        std::atomic<std::size_t> remaining{0};  //iterations not finished yet
+        std::exception_ptr first_exception;
+    };
+
+    const std::size_t PARALLEL_CHUNK_ROWS = 2048;  //rows evaluated by each iteration of the parallel evaluations. A multiple of 64, so the chunks of the results and of the defined flags always start on a new cache line of arrays aligned to 64 bytes
+
+    void parallel_evaluate_batch(ThreadPool &pool, const CompiledExpr &compiled_expr, const double *const *operand_columns, std::size_t n_rows, double *results, bool *defined);  //as CompiledExpr::evaluate_batch, with the rows split in chunks of PARALLEL_CHUNK_ROWS over the threads of the pool. The results are the same as those of the serial evaluation
+    void parallel_evaluate_batch(ThreadPool &pool, const ExpressionSet &expression_set, const double *const *operand_columns, std::size_t n_rows, double *const *result_columns, bool *const *defined_columns);  //as ExpressionSet::evaluate_batch, split in the same way
+}
+
+#endif
@@ -11,15 +11,20 @@
 
 /*
     Here you can add or remove the function operators supported.
-    To add a function operator, place in the unordered_map a string of lowercase
-    only characters with which to represent the function operator and a tuple
-    consisting of the number of operands the operator requires, the precedence
-    value of the operator (>= 0) and a pointer to a function wrapper that takes
-    a pointer to constant double as an argument, and returns a double.
+    To add a function operator, place in the array a string of lowercase
+    only characters with which to represent the function operator, the number
+    of operands the operator requires, the precedence value of the operator (>= 0)
+    a pointer to a function wrapper that takes a pointer to constant double
+    as an argument, and returns a double, and a pointer to its derivative rule
+    (or nullptr, in which case the derivative is computed numerically).
+    Operators can also be added at runtime with rpn::register_operator (operator_registry.hpp).
     The body of the function wrapper must contain the code necessary to
     produce the result (double) intended to be produced by the chosen operator
     (appropriately using the cfenv library to throw exceptions in case the operator
     is not defined for the passed values).
+    The derivative rule receives the same arguments and the result of the
+    function wrapper, and writes the partial derivative with respect to each
+    operand (it is used by rpn::evaluate_gradient, see autodiff.hpp).
 */
 
 
@@ -31,7 +36,7 @@ double wfunc_root(const double *argv)
 
 double wfunc_sqrt(const double *argv)
 {
-    return pow(argv[0], 1.0/2.0);
+    return sqrt(argv[0]);
 }
 
 double wfunc_cbrt(const double *argv)
@@ -55,7 +60,7 @@ double wfunc_sqr(const double *argv)
 
 double wfunc_cube(const double *argv)
 {
-    return pow(argv[0], 3.0);
+    return argv[0] * argv[0] * argv[0];
 }
 
 
@@ -145,33 +150,160 @@ double wfunc_atanh(const double *argv)
 
 
 
-const std::unordered_map<std::string, std::tuple<unsigned short, unsigned short, operator_func>> additional_operators = {  //acronym, number of operands, precedence value, function pointer
-    {"root", {2, 1, wfunc_root}},
-    {"sqrt", {1, 1, wfunc_sqrt}},
-    {"cbrt", {1, 1, wfunc_cbrt}},
+//derivative rules, called only where the function operator is defined
 
-    {"^", {2, 0, wfunc_pow}},
-    {"sqr", {1, 1, wfunc_sqr}},
-    {"cube", {1, 1, wfunc_cube}},
+void dfunc_root(const double *argv, double result, double *partials)
+{
+    partials[0] = -result * log(argv[1]) / (argv[0] * argv[0]);
+    partials[1] = pow(argv[1], 1.0/argv[0] - 1.0) / argv[0];
+}
+
+void dfunc_sqrt(const double *, double result, double *partials)
+{
+    partials[0] = 0.5 / result;
+}
+
+void dfunc_cbrt(const double *, double result, double *partials)
+{
+    partials[0] = 1.0 / (3.0 * result * result);
+}
+
+
+
+void dfunc_pow(const double *argv, double result, double *partials)
+{
+    partials[0] = argv[1] * pow(argv[0], argv[1] - 1.0);
+    partials[1] = (argv[0] == 0) ? 0.0 : result * log(argv[0]);  //for a base of 0 the limit from the right
+}
+
+void dfunc_sqr(const double *argv, double, double *partials)
+{
+    partials[0] = 2.0 * argv[0];
+}
+
+void dfunc_cube(const double *argv, double, double *partials)
+{
+    partials[0] = 3.0 * argv[0] * argv[0];
+}
+
+
+
+void dfunc_logb(const double *argv, double result, double *partials)
+{
+    const double ln_base = log(argv[0]);
+    partials[0] = -result / (argv[0] * ln_base);
+    partials[1] = 1.0 / (argv[1] * ln_base);
+}
+
+void dfunc_log(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / (argv[0] * log(10.0));
+}
+
+void dfunc_ln(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / argv[0];
+}
+
+
+
+void dfunc_sin(const double *argv, double, double *partials)
+{
+    partials[0] = cos(argv[0]);
+}
+
+void dfunc_cos(const double *argv, double, double *partials)
+{
+    partials[0] = -sin(argv[0]);
+}
+
+void dfunc_tan(const double *, double result, double *partials)
+{
+    partials[0] = 1.0 + result * result;
+}
 
-    {"logb", {2, 1, wfunc_logb}},
-    {"log", {1, 1, wfunc_log}},
-    {"ln", {1, 1, wfunc_ln}},
+
+
+void dfunc_asin(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / sqrt(1.0 - argv[0] * argv[0]);
+}
+
+void dfunc_acos(const double *argv, double, double *partials)
+{
+    partials[0] = -1.0 / sqrt(1.0 - argv[0] * argv[0]);
+}
+
+void dfunc_atan(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / (1.0 + argv[0] * argv[0]);
+}
+
+
+
+void dfunc_sinh(const double *argv, double, double *partials)
+{
+    partials[0] = cosh(argv[0]);
+}
+
+void dfunc_cosh(const double *argv, double, double *partials)
+{
+    partials[0] = sinh(argv[0]);
+}
+
+void dfunc_tanh(const double *, double result, double *partials)
+{
+    partials[0] = 1.0 - result * result;
+}
+
+
+
+void dfunc_asinh(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / sqrt(argv[0] * argv[0] + 1.0);
+}
+
+void dfunc_acosh(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / sqrt(argv[0] * argv[0] - 1.0);
+}
+
+void dfunc_atanh(const double *argv, double, double *partials)
+{
+    partials[0] = 1.0 / (1.0 - argv[0] * argv[0]);
+}
+
+
+
+const AdditionalOperator additional_operators[] = {  //acronym, number of operands, precedence value, function pointer, derivative rule
+    {"root", 2, 1, wfunc_root, dfunc_root},
+    {"sqrt", 1, 1, wfunc_sqrt, dfunc_sqrt},
+    {"cbrt", 1, 1, wfunc_cbrt, dfunc_cbrt},
+
+    {"^", 2, 0, wfunc_pow, dfunc_pow},
+    {"sqr", 1, 1, wfunc_sqr, dfunc_sqr},
+    {"cube", 1, 1, wfunc_cube, dfunc_cube},
+
+    {"logb", 2, 1, wfunc_logb, dfunc_logb},
+    {"log", 1, 1, wfunc_log, dfunc_log},
+    {"ln", 1, 1, wfunc_ln, dfunc_ln},
 
     //trigonometric functions
-    {"sin", {1, 1, wfunc_sin}},
-    {"cos", {1, 1, wfunc_cos}},
-    {"tan", {1, 1, wfunc_tan}},
-
-    {"asin", {1, 1, wfunc_asin}},
-    {"acos", {1, 1, wfunc_acos}},
-    {"atan", {1, 1, wfunc_atan}},
-
-    {"sinh", {1, 1, wfunc_sinh}},
-    {"cosh", {1, 1, wfunc_cosh}},
-    {"tanh", {1, 1, wfunc_tanh}},
-
-    {"asin", {1, 1, wfunc_asinh}},
-    {"acos", {1, 1, wfunc_acosh}},
-    {"atan", {1, 1, wfunc_atanh}}
-};
\ No newline at end of file
+    {"sin", 1, 1, wfunc_sin, dfunc_sin},
+    {"cos", 1, 1, wfunc_cos, dfunc_cos},
+    {"tan", 1, 1, wfunc_tan, dfunc_tan},
+
+    {"asin", 1, 1, wfunc_asin, dfunc_asin},
+    {"acos", 1, 1, wfunc_acos, dfunc_acos},
+    {"atan", 1, 1, wfunc_atan, dfunc_atan},
+
+    {"sinh", 1, 1, wfunc_sinh, dfunc_sinh},
+    {"cosh", 1, 1, wfunc_cosh, dfunc_cosh},
+    {"tanh", 1, 1, wfunc_tanh, dfunc_tanh},
+
+    {"asinh", 1, 1, wfunc_asinh, dfunc_asinh},
+    {"acosh", 1, 1, wfunc_acosh, dfunc_acosh},
+    {"atanh", 1, 1, wfunc_atanh, dfunc_atanh}
+};
+
+const std::size_t n_additional_operators = sizeof(additional_operators) / sizeof(additional_operators[0]);
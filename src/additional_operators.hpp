@@ -13,13 +13,28 @@
 #ifndef ADDITIONAL_OPERATORS_HPP
 #define ADDITIONAL_OPERATORS_HPP
 
-#include <string>
-#include <tuple>
-#include <unordered_map>
+#include <cstddef>
 #include <cmath>
 #include <cfenv>
 
 typedef double (*operator_func) (const double *argv);
-extern const std::unordered_map<std::string, std::tuple<unsigned short, unsigned short, operator_func>> additional_operators;
+typedef void (*operator_derivative) (const double *argv, double result, double *partials);  //derivative rule of a function operator: writes to partials[j] the partial derivative with respect to argv[j], given the result of the operator on argv
+double wfunc_sqrt(const double *argv);  //these function operators are also evaluated by the vector kernels of simd_kernels, so they must give the same result
+double wfunc_sqr(const double *argv);
+double wfunc_cube(const double *argv);
+double wfunc_root(const double *argv);  //called out of line by static_expr.hpp, so that pow never sees a constant exponent there
+double wfunc_pow(const double *argv);
+
+struct AdditionalOperator  //entry of the table of the additional operators, registered when the operator registry is first used
+{
+    const char *name;
+    unsigned short n_operands;
+    unsigned short precedence;
+    operator_func func;
+    operator_derivative derivative;  //nullptr if the derivative has to be computed numerically
+};
+
+extern const AdditionalOperator additional_operators[];  //constant-initialized, so it can be read during static initialization
+extern const std::size_t n_additional_operators;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+/**
+ * @file arena.cpp
+ * @brief Implementation file for the arena module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "arena.hpp"
+#include "profile.hpp"
+
+namespace rpn
+{
+    Arena::Arena(std::size_t initial_size) : buffer(new std::byte[initial_size > 0 ? initial_size : 1]), buffer_size(initial_size > 0 ? initial_size : 1)
+    {
+        mono.emplace(buffer.get(), buffer_size, profile::heap_resource());
+    }
+
+    void Arena::reset()
+    {
+        mono.reset();  //gives back the memory taken from the heap
+
+        if(requested > buffer_size){
+            std::size_t new_size = buffer_size;
+            while(new_size < requested)
+                new_size *= 2;
+
+            buffer.reset(new std::byte[new_size]);
+            buffer_size = new_size;
+        }
+
+        requested = 0;
+        mono.emplace(buffer.get(), buffer_size, profile::heap_resource());
+    }
+
+    std::size_t Arena::capacity() const
+    {
+        return buffer_size;
+    }
+
+    std::size_t Arena::used() const
+    {
+        return requested;
+    }
+
+    void *Arena::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        requested += bytes + alignment;  //upper bound of the space taken in the buffer
+        return mono->allocate(bytes, alignment);
+    }
+
+    void Arena::do_deallocate(void *, std::size_t, std::size_t)
+    {
+    }
+
+    bool Arena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+    {
+        return this == &other;
+    }
+}
@@ -0,0 +1,193 @@
+/**
+ * @file autodiff.cpp
+ * @brief Implementation file for the automatic differentiation module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "autodiff.hpp"
+#include "simd_kernels.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace rpn
+{
+    namespace
+    {
+        const std::size_t LOCAL_BUFFER_SIZE = 256;  //evaluations that need no more doubles than this use a buffer on the call stack
+        const double NUMERIC_STEP = 6.055454452393343e-06;  //cube root of the machine epsilon, the step of the central differences relative to the operand
+
+        bool call_defined(unsigned id, const double *argv, double &result);  //evaluates the operator, returns false if it is not defined for argv
+        void numeric_partials(unsigned id, unsigned short n_operands, const double *argv, double result, double *partials, double *shifted);  //writes to partials the derivatives of the operator computed by central differences (one-sided near the border of its domain, NaN where it is not defined on either side). shifted holds n_operands values
+
+
+        bool call_defined(unsigned id, const double *argv, double &result)
+        {
+            std::feclearexcept(FE_ALL_EXCEPT);
+            result = call_operator(id, argv);
+            return !std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW);
+        }
+
+        void numeric_partials(unsigned id, unsigned short n_operands, const double *argv, double result, double *partials, double *shifted)
+        {
+            std::copy(argv, argv + n_operands, shifted);
+
+            for(unsigned short j = 0; j < n_operands; ++j){
+                const double step = NUMERIC_STEP * std::max(1.0, std::fabs(argv[j]));
+                double forward, backward;
+
+                shifted[j] = argv[j] + step;
+                const double forward_step = shifted[j] - argv[j];  //the steps actually taken, after rounding
+                const bool forward_defined = call_defined(id, shifted, forward);
+
+                shifted[j] = argv[j] - step;
+                const double backward_step = argv[j] - shifted[j];
+                const bool backward_defined = call_defined(id, shifted, backward);
+
+                shifted[j] = argv[j];
+
+                if(forward_defined && backward_defined)
+                    partials[j] = (forward - backward) / (forward_step + backward_step);
+                else if(forward_defined)
+                    partials[j] = (forward - result) / forward_step;
+                else if(backward_defined)
+                    partials[j] = (result - backward) / backward_step;
+                else
+                    partials[j] = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+    }
+
+
+    std::pair<bool, double> evaluate_gradient(const CompiledExpr &compiled_expr, const double *operand_values, double *gradient)
+    {
+        return evaluate_gradient(compiled_expr, operand_values, gradient, profile::heap_resource());
+    }
+
+    std::pair<bool, double> evaluate_gradient(const CompiledExpr &compiled_expr, const double *operand_values, double *gradient, std::pmr::memory_resource *scratch)
+    {
+        if(compiled_expr.empty())
+            return std::make_pair(false, 0.0);
+
+        const std::vector<Instruction> &program = compiled_expr.instructions();
+        const std::size_t k = compiled_expr.operand_names().size();  //length of the gradients
+        const std::size_t depth = compiled_expr.max_depth();
+        const std::size_t levels = depth + compiled_expr.temps();
+
+        unsigned short max_operands = 0;
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it)
+            if(it->opcode == OpCode::FUNC_OPERATOR)
+                max_operands = std::max(max_operands, it->n_operands);
+
+        /*
+            Layout of the buffer: the values of the stack and of the temporary slots, then their gradients (k values
+            each, in the same order), then the partial derivatives of a function operator and the shifted operands of
+            the numeric derivatives
+        */
+        const std::size_t size = levels + levels * k + 2 * static_cast<std::size_t>(max_operands);
+        double local_buffer[LOCAL_BUFFER_SIZE];
+        std::pmr::vector<double> heap_buffer(scratch);
+        double *buffer = local_buffer;
+
+        if(size > LOCAL_BUFFER_SIZE){
+            heap_buffer.resize(size);
+            buffer = heap_buffer.data();
+        }
+
+        double *top = buffer;  //points one position past the value on top of the stack
+        double *temp_values = buffer + depth;
+        double *gtop = buffer + levels;  //points one gradient past the gradient of the value on top of the stack
+        double *temp_gradients = gtop + depth * k;
+        double *partials = buffer + levels + levels * k;
+        double *shifted = partials + max_operands;
+
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            switch(it->opcode){
+                case OpCode::PUSH_VALUE:
+                    *top++ = it->value;
+                    std::fill(gtop, gtop + k, 0.0);
+                    gtop += k;
+                    break;
+
+                case OpCode::PUSH_OPERAND:
+                    *top++ = operand_values[it->index];
+                    std::fill(gtop, gtop + k, 0.0);
+                    gtop[it->index] = 1.0;
+                    gtop += k;
+                    break;
+
+                case OpCode::ADD:
+                    --top;
+                    gtop -= k;
+                    top[-1] += top[0];
+                    simd::add(gtop - k, gtop, k);
+                    break;
+
+                case OpCode::SUB:
+                    --top;
+                    gtop -= k;
+                    top[-1] -= top[0];
+                    simd::sub(gtop - k, gtop, k);
+                    break;
+
+                case OpCode::MUL:  //(a * b)' = b * a' + a * b'
+                    --top;
+                    gtop -= k;
+                    simd::axpby(gtop - k, top[0], gtop, top[-1], k);
+                    top[-1] *= top[0];
+                    break;
+
+                case OpCode::DIV:  //(a / b)' = (a' - (a / b) * b') / b
+                    --top;
+                    gtop -= k;
+                    if(top[0] == 0)
+                        return std::make_pair(false, 0.0);
+                    top[-1] /= top[0];
+                    simd::axpby(gtop - k, 1.0 / top[0], gtop, -top[-1] / top[0], k);
+                    break;
+
+                case OpCode::FUNC_OPERATOR:{  //f(u, v, ...)' = f_u * u' + f_v * v' + ...
+                    const unsigned short n = it->n_operands;
+                    top -= n - 1;  //top[-1] is now the first operand of the function
+                    gtop -= (n - 1) * k;  //gtop - k is now the gradient of the first operand
+
+                    double result;
+                    if(!call_defined(it->index, top - 1, result))
+                        return std::make_pair(false, 0.0);
+
+                    const operator_derivative derivative = operator_table[it->index].derivative;
+                    if(derivative != nullptr)
+                        (*derivative)(top - 1, result, partials);
+                    else
+                        numeric_partials(it->index, n, top - 1, result, partials, shifted);
+
+                    simd::scale(gtop - k, partials[0], k);
+                    for(unsigned short j = 1; j < n; ++j)
+                        simd::axpby(gtop - k, 1.0, gtop + (j - 1) * k, partials[j], k);
+                    top[-1] = result;
+                    break;
+                }
+
+                case OpCode::STORE_TEMP:
+                    temp_values[it->index] = top[-1];
+                    std::copy(gtop - k, gtop, temp_gradients + it->index * k);
+                    break;
+
+                case OpCode::LOAD_TEMP:
+                    *top++ = temp_values[it->index];
+                    std::copy(temp_gradients + it->index * k, temp_gradients + (it->index + 1) * k, gtop);
+                    gtop += k;
+                    break;
+
+                case OpCode::STORE_RESULT:  //not accepted by assign
+                    break;
+            }
+        }
+
+        std::copy(gtop - k, gtop, gradient);
+        return std::make_pair(true, top[-1]);
+    }
+}
@@ -0,0 +1,186 @@
+/**
+ * @file batch_evaluation.cpp
+ * @brief Implementation file for the batch (columnar) evaluation of the compiled expressions of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "rpn_utils.hpp"
+#include "simd_kernels.hpp"
+#include "profile.hpp"
+
+namespace rpn
+{
+    namespace
+    {
+        const std::size_t BLOCK_ROWS = 256;  //rows evaluated together by each instruction; a stack level of a block fits in the L1 cache
+
+        void eval_func_block(const Instruction &ins, double *args, std::size_t n, bool *defined, double *tmp, double *argv, bool check_each);  //evaluates a function operator on a block, args[j * BLOCK_ROWS + i] is the operand j of the row i. argv receives the operands of a single row. The results are written to args. If check_each is false the flags are left to the caller
+        const double *eval_block(const std::vector<Instruction> &program, const double *const *operand_columns, std::size_t first, std::size_t n, double *stack, double *temp_values, double *tmp, double *argv, bool *defined, bool check_each);  //evaluates the rows first ... first + n - 1 and returns the level of the stack that holds their results. Temporary slot k of the block is temp_values[k * BLOCK_ROWS ... k * BLOCK_ROWS + BLOCK_ROWS - 1]
+
+
+        void eval_func_block(const Instruction &ins, double *args, std::size_t n, bool *defined, double *tmp, double *argv, bool check_each)
+        {
+            simd::func_kernel kernel = (ins.n_operands == 1) ? simd::find_kernel(ins.func) : nullptr;
+
+            if(kernel != nullptr){
+                if(check_each)
+                    std::feclearexcept(FE_ALL_EXCEPT);
+                (*kernel)(args, tmp, n);
+
+                if(check_each && std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){  //at least one row is not defined, find out which ones
+                    for(std::size_t i = 0; i < n; ++i){
+                        if(!defined[i])
+                            continue;
+                        std::feclearexcept(FE_ALL_EXCEPT);
+                        tmp[i] = (*ins.func)(args + i);
+                        if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){
+                            RPN_PROFILE_UNDEFINED_FLAGS();
+                            defined[i] = false;
+                        }
+                    }
+                }
+
+                std::copy(tmp, tmp + n, args);
+                return;
+            }
+
+            for(std::size_t i = 0; i < n; ++i){
+                if(!defined[i])
+                    continue;
+
+                for(unsigned short j = 0; j < ins.n_operands; ++j)
+                    argv[j] = args[j * BLOCK_ROWS + i];
+
+                if(!check_each){
+                    args[i] = call_operator(ins.index, argv);
+                    continue;
+                }
+
+                std::feclearexcept(FE_ALL_EXCEPT);
+                args[i] = call_operator(ins.index, argv);
+                if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){
+                    RPN_PROFILE_UNDEFINED_FLAGS();
+                    defined[i] = false;
+                }
+            }
+        }
+
+        const double *eval_block(const std::vector<Instruction> &program, const double *const *operand_columns, std::size_t first, std::size_t n, double *stack, double *temp_values, double *tmp, double *argv, bool *defined, bool check_each)
+        {
+            std::size_t levels = 0;  //number of levels on the stack
+            double *top = stack;  //points to the level on top of the stack
+
+            std::fill(defined, defined + n, true);
+
+            for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+                RPN_PROFILE_INSTRUCTION(*it, n);
+
+                switch(it->opcode){
+                    case OpCode::PUSH_VALUE:
+                        top = stack + levels++ * BLOCK_ROWS;
+                        std::fill(top, top + n, it->value);
+                        break;
+
+                    case OpCode::PUSH_OPERAND:
+                        top = stack + levels++ * BLOCK_ROWS;
+                        std::copy(operand_columns[it->index] + first, operand_columns[it->index] + first + n, top);
+                        break;
+
+                    case OpCode::ADD:
+                        top = stack + --levels * BLOCK_ROWS - BLOCK_ROWS;
+                        simd::add(top, top + BLOCK_ROWS, n);
+                        break;
+
+                    case OpCode::SUB:
+                        top = stack + --levels * BLOCK_ROWS - BLOCK_ROWS;
+                        simd::sub(top, top + BLOCK_ROWS, n);
+                        break;
+
+                    case OpCode::MUL:
+                        top = stack + --levels * BLOCK_ROWS - BLOCK_ROWS;
+                        simd::mul(top, top + BLOCK_ROWS, n);
+                        break;
+
+                    case OpCode::DIV:
+                        top = stack + --levels * BLOCK_ROWS - BLOCK_ROWS;
+#ifdef RPN_UTILS_PROFILE
+                        for(std::size_t i = 0; i < n; ++i)
+                            if(defined[i] && top[BLOCK_ROWS + i] == 0)
+                                RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+#endif
+                        simd::div(top, top + BLOCK_ROWS, n, defined);
+                        break;
+
+                    case OpCode::FUNC_OPERATOR:
+                        levels -= it->n_operands - 1;
+                        top = stack + (levels - 1) * BLOCK_ROWS;  //top now points to the level of the first operand
+                        eval_func_block(*it, top, n, defined, tmp, argv, check_each);
+                        break;
+
+                    case OpCode::STORE_TEMP:
+                        std::copy(top, top + n, temp_values + it->index * BLOCK_ROWS);
+                        break;
+
+                    case OpCode::LOAD_TEMP:
+                        top = stack + levels++ * BLOCK_ROWS;
+                        std::copy(temp_values + it->index * BLOCK_ROWS, temp_values + it->index * BLOCK_ROWS + n, top);
+                        break;
+
+                    case OpCode::STORE_RESULT:  //not accepted by assign
+                        break;
+                }
+            }
+
+            return top;
+        }
+    }
+
+
+    void CompiledExpr::evaluate_batch(const double *const *operand_columns, std::size_t n_rows, double *results, bool *defined) const
+    {
+        evaluate_batch(operand_columns, n_rows, results, defined, profile::heap_resource());
+    }
+
+    void CompiledExpr::evaluate_batch(const double *const *operand_columns, std::size_t n_rows, double *results, bool *defined, std::pmr::memory_resource *scratch) const
+    {
+        RPN_PROFILE_PHASE(EVALUATION);
+
+        if(program.empty()){
+            std::fill(results, results + n_rows, 0.0);
+            std::fill(defined, defined + n_rows, false);
+            return;
+        }
+
+        unsigned short max_operands = 0;
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it)
+            if(it->opcode == OpCode::FUNC_OPERATOR)
+                max_operands = std::max(max_operands, it->n_operands);
+
+        std::pmr::vector<double> stack((depth + n_temps) * BLOCK_ROWS, scratch);  //stack level k of the block is stack[k * BLOCK_ROWS ... k * BLOCK_ROWS + BLOCK_ROWS - 1], the temporary slots follow the levels
+        std::pmr::vector<double> tmp(BLOCK_ROWS, scratch);
+        std::pmr::vector<double> argv(max_operands, scratch);  //operands of a function operator on a single row
+
+        for(std::size_t first = 0; first < n_rows; first += BLOCK_ROWS){
+            const std::size_t n = std::min(BLOCK_ROWS, n_rows - first);
+            bool *block_defined = defined + first;
+            const double *top;
+
+            if(check == FpCheck::DEFERRED && calls_functions){  //a raised flag is attributed to the rows by evaluating the block again
+                std::feclearexcept(FE_ALL_EXCEPT);
+                top = eval_block(program, operand_columns, first, n, stack.data(), stack.data() + depth * BLOCK_ROWS, tmp.data(), argv.data(), block_defined, false);
+                if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){
+                    RPN_PROFILE_RECHECK();
+                    top = eval_block(program, operand_columns, first, n, stack.data(), stack.data() + depth * BLOCK_ROWS, tmp.data(), argv.data(), block_defined, true);
+                }
+            }
+            else
+                top = eval_block(program, operand_columns, first, n, stack.data(), stack.data() + depth * BLOCK_ROWS, tmp.data(), argv.data(), block_defined, true);
+
+            for(std::size_t i = 0; i < n; ++i)
+                results[first + i] = block_defined[i] ? top[i] : 0.0;
+        }
+    }
+}
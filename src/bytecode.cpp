@@ -0,0 +1,507 @@
+/**
+ * @file bytecode.cpp
+ * @brief Implementation file for the bytecode module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "bytecode.hpp"
+#include "profile.hpp"
+#include <cstring>
+#include <fstream>
+
+namespace rpn
+{
+    namespace
+    {
+        const std::size_t LOCAL_STACK_SIZE = 64;  //programs whose stack and temporary slots never hold more values than this are evaluated on a buffer on the call stack
+        const std::size_t SECTION_ALIGNMENT = 8;
+
+        std::uint64_t aligned(std::uint64_t offset);  //returns the first multiple of SECTION_ALIGNMENT not less than offset
+        template<typename T> BytecodeSection place(std::uint64_t &offset, const std::vector<T> &entries);  //returns the section of the entries placed at offset, and moves offset past them
+        bool write_section(std::ostream &out, std::uint64_t &pos, const BytecodeSection &sec, const void *data, std::size_t bytes);  //writes the padding up to the section and the section
+
+
+        std::uint64_t aligned(std::uint64_t offset)
+        {
+            return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        }
+
+        template<typename T> BytecodeSection place(std::uint64_t &offset, const std::vector<T> &entries)
+        {
+            BytecodeSection sec = {aligned(offset), entries.size()};
+            offset = sec.offset + entries.size() * sizeof(T);
+            return sec;
+        }
+
+        bool write_section(std::ostream &out, std::uint64_t &pos, const BytecodeSection &sec, const void *data, std::size_t bytes)
+        {
+            static const char padding[SECTION_ALIGNMENT] = {};
+
+            out.write(padding, sec.offset - pos);
+            out.write(static_cast<const char *>(data), bytes);
+            pos = sec.offset + bytes;
+            return static_cast<bool>(out);
+        }
+    }
+
+
+    std::uint64_t additional_operators_hash()
+    {
+        std::uint64_t hash = 14695981039346656037ULL;  //64 bit FNV-1a
+        const auto mix = [&hash](unsigned char byte){
+            hash ^= byte;
+            hash *= 1099511628211ULL;
+        };
+
+        for(std::size_t i = 0; i < n_additional_operators; ++i){
+            const AdditionalOperator &op = additional_operators[i];
+            for(const char *c = op.name; *c != '\0'; ++c)
+                mix(static_cast<unsigned char>(*c));
+            mix(0);
+            mix(static_cast<unsigned char>(op.n_operands));
+            mix(static_cast<unsigned char>(op.n_operands >> 8));
+            mix(static_cast<unsigned char>(op.precedence));
+            mix(static_cast<unsigned char>(op.precedence >> 8));
+        }
+        return hash;
+    }
+
+
+    bool BytecodeWriter::add(const CompiledExpr &compiled_expr, const std::string &source)
+    {
+        BytecodeProgram entry = {static_cast<std::uint32_t>(code.size()), 0, static_cast<std::uint32_t>(operands.size()), 0, 0, 0, string_index(source), 0};
+        if(compiled_expr.empty()){
+            programs.push_back(entry);
+            return false;
+        }
+
+        const std::vector<std::string> &names = compiled_expr.operand_names();
+        for(std::vector<std::string>::const_iterator it = names.cbegin(); it != names.cend(); ++it)
+            operands.push_back(string_index(*it));
+
+        const std::vector<Instruction> &program = compiled_expr.instructions();
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            BytecodeInstruction instruction = {static_cast<std::uint8_t>(it->opcode), 0, it->n_operands, it->index};
+            if(it->opcode == OpCode::PUSH_VALUE)
+                instruction.index = literal_index(it->value);
+            else if(it->opcode == OpCode::FUNC_OPERATOR)
+                instruction.index = operator_index(it->index);
+            code.push_back(instruction);
+        }
+
+        entry.n_instructions = static_cast<std::uint32_t>(program.size());
+        entry.n_operands = static_cast<std::uint32_t>(names.size());
+        entry.max_depth = compiled_expr.max_depth();
+        entry.n_temps = compiled_expr.temps();
+        programs.push_back(entry);
+        return true;
+    }
+
+    bool BytecodeWriter::add(const Context &ctx, const std::string &infix_expr)
+    {
+        std::vector<Instruction> program;
+        SymbolTable symbols;
+        CompiledExpr compiled_expr;
+
+        if(infix_to_rpn(ctx, infix_expr, program, symbols))
+            compiled_expr.assign(program, symbols.names());
+        return add(compiled_expr, infix_expr);
+    }
+
+    std::size_t BytecodeWriter::size() const
+    {
+        return programs.size();
+    }
+
+    void BytecodeWriter::clear()
+    {
+        programs.clear();
+        code.clear();
+        literals.clear();
+        operands.clear();
+        operators.clear();
+        strings.clear();
+        chars.clear();
+        string_indexes.clear();
+        literal_indexes.clear();
+        operator_indexes.clear();
+    }
+
+    bool BytecodeWriter::write(const std::string &path) const
+    {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return false;  //the sections are written as they are in memory
+#else
+        BytecodeHeader header;
+        std::memcpy(header.magic, BYTECODE_MAGIC, sizeof(header.magic));
+        header.version = BYTECODE_VERSION;
+        header.reserved = 0;
+        header.operators_hash = additional_operators_hash();
+
+        std::uint64_t offset = sizeof(header);
+        header.programs = place(offset, programs);
+        header.code = place(offset, code);
+        header.literals = place(offset, literals);
+        header.operands = place(offset, operands);
+        header.operators = place(offset, operators);
+        header.strings = place(offset, strings);
+        header.chars = {aligned(offset), chars.size()};
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if(!out)
+            return false;
+
+        std::uint64_t pos = 0;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        pos = sizeof(header);
+
+        return write_section(out, pos, header.programs, programs.data(), programs.size() * sizeof(BytecodeProgram))
+            && write_section(out, pos, header.code, code.data(), code.size() * sizeof(BytecodeInstruction))
+            && write_section(out, pos, header.literals, literals.data(), literals.size() * sizeof(double))
+            && write_section(out, pos, header.operands, operands.data(), operands.size() * sizeof(std::uint32_t))
+            && write_section(out, pos, header.operators, operators.data(), operators.size() * sizeof(BytecodeOperator))
+            && write_section(out, pos, header.strings, strings.data(), strings.size() * sizeof(BytecodeString))
+            && write_section(out, pos, header.chars, chars.data(), chars.size())
+            && out.flush();
+#endif
+    }
+
+    std::uint32_t BytecodeWriter::string_index(const std::string &text)
+    {
+        std::unordered_map<std::string, std::uint32_t>::const_iterator it = string_indexes.find(text);
+        if(it != string_indexes.cend())
+            return it->second;
+
+        const std::uint32_t index = static_cast<std::uint32_t>(strings.size());
+        strings.push_back({static_cast<std::uint32_t>(chars.size()), static_cast<std::uint32_t>(text.size())});
+        chars += text;
+        string_indexes.emplace(text, index);
+        return index;
+    }
+
+    std::uint32_t BytecodeWriter::literal_index(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        std::unordered_map<std::uint64_t, std::uint32_t>::const_iterator it = literal_indexes.find(bits);
+        if(it != literal_indexes.cend())
+            return it->second;
+
+        const std::uint32_t index = static_cast<std::uint32_t>(literals.size());
+        literals.push_back(value);
+        literal_indexes.emplace(bits, index);
+        return index;
+    }
+
+    std::uint32_t BytecodeWriter::operator_index(unsigned id)
+    {
+        std::unordered_map<unsigned, std::uint32_t>::const_iterator it = operator_indexes.find(id);
+        if(it != operator_indexes.cend())
+            return it->second;
+
+        const std::uint32_t index = static_cast<std::uint32_t>(operators.size());
+        operators.push_back({string_index(operator_name(id)), operator_table[id].n_operands, 0});
+        operator_indexes.emplace(id, index);
+        return index;
+    }
+
+
+    BytecodeStatus BytecodeFile::open(const std::string &path)
+    {
+        close();
+        if(!input.open(path))
+            return BytecodeStatus::CANNOT_READ;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        close();
+        return BytecodeStatus::INVALID_FORMAT;
+#else
+        if(input.size() < sizeof(BytecodeHeader) || std::memcmp(input.data(), BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) != 0){
+            close();
+            return BytecodeStatus::INVALID_FORMAT;
+        }
+
+        header = reinterpret_cast<const BytecodeHeader *>(input.data());
+        if(header->version != BYTECODE_VERSION){
+            close();
+            return BytecodeStatus::UNSUPPORTED_VERSION;
+        }
+
+        programs = section<BytecodeProgram>(header->programs);
+        code = section<BytecodeInstruction>(header->code);
+        literals = section<double>(header->literals);
+        operand_names = section<std::uint32_t>(header->operands);
+        strings = section<BytecodeString>(header->strings);
+        chars = section<char>(header->chars);
+        const BytecodeOperator *operators = section<BytecodeOperator>(header->operators);
+        if(programs == nullptr || code == nullptr || literals == nullptr || operand_names == nullptr || strings == nullptr || chars == nullptr || operators == nullptr){
+            close();
+            return BytecodeStatus::INVALID_FORMAT;
+        }
+
+        if(header->operators_hash != additional_operators_hash()){
+            close();
+            return BytecodeStatus::OPERATORS_CHANGED;
+        }
+
+        for(std::uint64_t i = 0; i < header->operators.count; ++i){
+            const BytecodeOperator &op = operators[i];
+            if(op.name >= header->strings.count || strings[op.name].offset + static_cast<std::uint64_t>(strings[op.name].length) > header->chars.count){
+                close();
+                return BytecodeStatus::INVALID_FORMAT;
+            }
+
+            const unsigned id = find_operator(std::string(string(op.name)));
+            if(id == OPERATOR_NPOS || operator_table[id].n_operands != op.n_operands){
+                close();
+                return BytecodeStatus::UNKNOWN_OPERATOR;
+            }
+            operator_ids.push_back(id);
+        }
+
+        return BytecodeStatus::OK;
+#endif
+    }
+
+    void BytecodeFile::close()
+    {
+        input.close();
+        header = nullptr;
+        programs = nullptr;
+        code = nullptr;
+        literals = nullptr;
+        operand_names = nullptr;
+        strings = nullptr;
+        chars = nullptr;
+        operator_ids.clear();
+    }
+
+    std::size_t BytecodeFile::size() const
+    {
+        return (header != nullptr) ? header->programs.count : 0;
+    }
+
+    std::string_view BytecodeFile::source(std::size_t program) const
+    {
+        return string(programs[program].source);
+    }
+
+    unsigned BytecodeFile::operands(std::size_t program) const
+    {
+        return programs[program].n_operands;
+    }
+
+    std::string_view BytecodeFile::operand_name(std::size_t program, unsigned slot) const
+    {
+        return string(operand_names[programs[program].first_operand + slot]);
+    }
+
+    std::pair<bool, double> BytecodeFile::evaluate(std::size_t program, const double *operand_values) const
+    {
+        RPN_PROFILE_PHASE(EVALUATION);
+        const BytecodeProgram &entry = programs[program];
+        if(entry.n_instructions == 0)
+            return std::make_pair(false, 0.0);
+
+        double local_stack[LOCAL_STACK_SIZE];
+        std::vector<double> heap_stack;
+        double *stack = local_stack;
+
+        if(entry.max_depth + static_cast<std::size_t>(entry.n_temps) > LOCAL_STACK_SIZE){
+            heap_stack.resize(entry.max_depth + static_cast<std::size_t>(entry.n_temps));
+            stack = heap_stack.data();
+        }
+
+        double *temp_values = stack + entry.max_depth;  //values of the temporary slots
+        double *top = stack;  //points one position past the value on top of the stack
+        const BytecodeInstruction *last = code + entry.first_instruction + entry.n_instructions;
+
+        for(const BytecodeInstruction *it = code + entry.first_instruction; it != last; ++it){
+            RPN_PROFILE_OPERATION(static_cast<OpCode>(it->opcode), (static_cast<OpCode>(it->opcode) == OpCode::FUNC_OPERATOR) ? operator_ids[it->index] : 0, 1);  //the index of a FUNC_OPERATOR is its position in the operators of the file
+
+            switch(static_cast<OpCode>(it->opcode)){
+                case OpCode::PUSH_VALUE:
+                    *top++ = literals[it->index];
+                    break;
+
+                case OpCode::PUSH_OPERAND:
+                    *top++ = operand_values[it->index];
+                    break;
+
+                case OpCode::ADD:
+                    --top;
+                    top[-1] += top[0];
+                    break;
+
+                case OpCode::SUB:
+                    --top;
+                    top[-1] -= top[0];
+                    break;
+
+                case OpCode::MUL:
+                    --top;
+                    top[-1] *= top[0];
+                    break;
+
+                case OpCode::DIV:
+                    --top;
+                    if(top[0] == 0){
+                        RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+                        return std::make_pair(false, 0.0);
+                    }
+                    top[-1] /= top[0];
+                    break;
+
+                case OpCode::FUNC_OPERATOR:
+                    top -= it->n_operands - 1;  //top[-1] is now the first operand of the function
+                    std::feclearexcept(FE_ALL_EXCEPT);
+                    top[-1] = call_operator(operator_ids[it->index], top - 1);
+                    if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){
+                        RPN_PROFILE_UNDEFINED_FLAGS();
+                        return std::make_pair(false, 0.0);
+                    }
+                    break;
+
+                case OpCode::STORE_TEMP:
+                    temp_values[it->index] = top[-1];
+                    break;
+
+                case OpCode::LOAD_TEMP:
+                    *top++ = temp_values[it->index];
+                    break;
+
+                case OpCode::STORE_RESULT:  //not written by BytecodeWriter
+                    break;
+            }
+        }
+
+        return std::make_pair(true, top[-1]);
+    }
+
+    bool BytecodeFile::load(std::size_t program, CompiledExpr &compiled_expr) const
+    {
+        const BytecodeProgram &entry = programs[program];
+        compiled_expr.clear();
+        if(entry.n_instructions == 0)
+            return false;
+
+        std::vector<Instruction> instructions;
+        std::vector<std::string> names;
+        const BytecodeInstruction *last = code + entry.first_instruction + entry.n_instructions;
+
+        for(const BytecodeInstruction *it = code + entry.first_instruction; it != last; ++it){
+            Instruction instruction = {static_cast<OpCode>(it->opcode), it->n_operands, it->index, 0.0, nullptr};
+            if(instruction.opcode == OpCode::PUSH_VALUE){
+                instruction.index = 0;
+                instruction.value = literals[it->index];
+            }
+            else if(instruction.opcode == OpCode::FUNC_OPERATOR){
+                instruction.index = operator_ids[it->index];
+                instruction.func = operator_table[instruction.index].func;
+            }
+            instructions.push_back(instruction);
+        }
+
+        for(unsigned slot = 0; slot < entry.n_operands; ++slot)
+            names.emplace_back(operand_name(program, slot));
+
+        return compiled_expr.assign(instructions, names);
+    }
+
+    bool BytecodeFile::verify() const
+    {
+        if(header == nullptr)
+            return false;
+
+        for(std::uint64_t i = 0; i < header->strings.count; ++i)
+            if(strings[i].offset + static_cast<std::uint64_t>(strings[i].length) > header->chars.count)
+                return false;
+
+        for(std::uint64_t i = 0; i < header->programs.count; ++i)
+            if(!verify(programs[i]))
+                return false;
+        return true;
+    }
+
+    template<typename T> const T *BytecodeFile::section(const BytecodeSection &sec) const
+    {
+        if(sec.offset % SECTION_ALIGNMENT != 0 || sec.offset > input.size() || sec.count > (input.size() - sec.offset) / sizeof(T))
+            return nullptr;
+        return reinterpret_cast<const T *>(input.data() + sec.offset);
+    }
+
+    bool BytecodeFile::verify(const BytecodeProgram &entry) const
+    {
+        const BytecodeOperator *operators = section<BytecodeOperator>(header->operators);
+
+        if(entry.source >= header->strings.count || entry.first_operand + static_cast<std::uint64_t>(entry.n_operands) > header->operands.count)
+            return false;
+        for(std::uint32_t slot = 0; slot < entry.n_operands; ++slot)
+            if(operand_names[entry.first_operand + slot] >= header->strings.count)
+                return false;
+
+        if(entry.n_instructions == 0)
+            return true;
+        if(entry.first_instruction + static_cast<std::uint64_t>(entry.n_instructions) > header->code.count)
+            return false;
+
+        std::uint64_t depth = 0;
+        const BytecodeInstruction *last = code + entry.first_instruction + entry.n_instructions;
+
+        for(const BytecodeInstruction *it = code + entry.first_instruction; it != last; ++it){
+            switch(static_cast<OpCode>(it->opcode)){
+                case OpCode::PUSH_VALUE:
+                    if(it->index >= header->literals.count)
+                        return false;
+                    ++depth;
+                    break;
+
+                case OpCode::PUSH_OPERAND:
+                    if(it->index >= entry.n_operands)
+                        return false;
+                    ++depth;
+                    break;
+
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+                    if(depth < 2)
+                        return false;
+                    --depth;
+                    break;
+
+                case OpCode::FUNC_OPERATOR:
+                    if(it->index >= header->operators.count || it->n_operands != operators[it->index].n_operands || depth < it->n_operands)
+                        return false;
+                    depth -= it->n_operands - 1;
+                    break;
+
+                case OpCode::STORE_TEMP:
+                    if(it->index >= entry.n_temps || depth < 1)
+                        return false;
+                    break;
+
+                case OpCode::LOAD_TEMP:
+                    if(it->index >= entry.n_temps)
+                        return false;
+                    ++depth;
+                    break;
+
+                default:
+                    return false;
+            }
+
+            if(depth > entry.max_depth)
+                return false;
+        }
+
+        return depth == 1;
+    }
+
+    std::string_view BytecodeFile::string(std::uint32_t index) const
+    {
+        return std::string_view(chars + strings[index].offset, strings[index].length);
+    }
+}
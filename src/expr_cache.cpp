@@ -0,0 +1,153 @@
+/**
+ * @file expr_cache.cpp
+ * @brief Implementation file for the expression cache module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "expr_cache.hpp"
+#include <stdexcept>
+
+namespace rpn
+{
+    namespace
+    {
+        std::shared_ptr<const CompiledExpr> make_expr(const std::vector<Instruction> &program, const SymbolTable &symbols);  //returns a compiled expression owning the program
+
+
+        std::shared_ptr<const CompiledExpr> make_expr(const std::vector<Instruction> &program, const SymbolTable &symbols)
+        {
+            std::shared_ptr<CompiledExpr> expr = std::make_shared<CompiledExpr>();
+            expr->assign(program, symbols.names());
+            return expr;
+        }
+    }
+
+
+    ExprCache::ExprCache(std::size_t capacity) : max_entries(capacity), n_hits(0), n_misses(0), n_evictions(0)
+    {
+    }
+
+    std::shared_ptr<const CompiledExpr> ExprCache::get(const std::string &infix_expr)
+    {
+        std::string key = normalize_infix(infix_expr);
+        unsigned long version = operands_version();
+        unsigned n_operators = operator_count();  //read before the conversion, so an operator registered meanwhile makes the entry stale
+        std::shared_ptr<const CompiledExpr> expr;
+
+        if(lookup(key, version, n_operators, expr))
+            return expr;
+
+        std::vector<Instruction> program;
+        SymbolTable symbols;
+        try{
+            if(infix_to_rpn(key, program, symbols))
+                expr = make_expr(program, symbols);
+        }
+        catch(const std::runtime_error &){  //unknown name or malformed literal: cached as not valid, until the operands change or an operator is registered
+        }
+
+        insert(std::move(key), version, n_operators, expr);
+        return expr;
+    }
+
+    std::shared_ptr<const CompiledExpr> ExprCache::get(const Context &ctx, const std::string &infix_expr)
+    {
+        std::string key = normalize_infix(infix_expr);
+        unsigned long version = ctx.version();
+        unsigned n_operators = operator_count();  //read before the conversion, so an operator registered meanwhile makes the entry stale
+        std::shared_ptr<const CompiledExpr> expr;
+
+        if(lookup(key, version, n_operators, expr))
+            return expr;
+
+        std::vector<Instruction> program;
+        SymbolTable symbols;
+        try{
+            if(infix_to_rpn(ctx, key, program, symbols))
+                expr = make_expr(program, symbols);
+        }
+        catch(const std::runtime_error &){  //unknown name or malformed literal: cached as not valid, until the operands change or an operator is registered
+        }
+
+        insert(std::move(key), version, n_operators, expr);
+        return expr;
+    }
+
+    void ExprCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.clear();
+        entries.clear();
+    }
+
+    std::size_t ExprCache::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    std::size_t ExprCache::capacity() const
+    {
+        return max_entries;
+    }
+
+    unsigned long ExprCache::hits() const
+    {
+        return n_hits.load(std::memory_order_relaxed);
+    }
+
+    unsigned long ExprCache::misses() const
+    {
+        return n_misses.load(std::memory_order_relaxed);
+    }
+
+    unsigned long ExprCache::evictions() const
+    {
+        return n_evictions.load(std::memory_order_relaxed);
+    }
+
+    bool ExprCache::lookup(std::string_view key, unsigned long version, unsigned n_operators, std::shared_ptr<const CompiledExpr> &expr)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<std::string_view, std::list<Entry>::iterator>::const_iterator it = index.find(key);
+        if(it == index.cend() || it->second->version != version || it->second->n_operators != n_operators){
+            n_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        expr = it->second->expr;
+        n_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void ExprCache::insert(std::string &&key, unsigned long version, unsigned n_operators, const std::shared_ptr<const CompiledExpr> &expr)
+    {
+        if(max_entries == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unordered_map<std::string_view, std::list<Entry>::iterator>::iterator it = index.find(key);
+        if(it != index.end()){  //converted by another thread in the meantime, or stale
+            it->second->version = version;
+            it->second->n_operators = n_operators;
+            it->second->expr = expr;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+
+        if(entries.size() >= max_entries){
+            index.erase(entries.back().key);
+            entries.pop_back();
+            n_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        entries.push_front({std::move(key), version, n_operators, expr});
+        index.emplace(entries.front().key, entries.begin());
+    }
+}
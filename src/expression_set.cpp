@@ -0,0 +1,472 @@
+/**
+ * @file expression_set.cpp
+ * @brief Implementation file for the expression set module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "expression_set.hpp"
+#include "optimizer.hpp"
+#include "simd_kernels.hpp"
+#include "profile.hpp"
+#include <memory>
+
+namespace rpn
+{
+    namespace
+    {
+        const unsigned LOCAL_VALUES = 64;  //sets whose stack and temporary slots never hold more values than this are evaluated on buffers on the call stack
+        const std::size_t BLOCK_ROWS = 256;  //rows evaluated together by evaluate_batch, as in CompiledExpr::evaluate_batch
+
+        bool func_flags_raised();  //returns true if a function operator called after the last feclearexcept was not defined for its operands
+        void eval_func_rows(const Instruction &ins, double *args, bool *args_defined, std::size_t n, double *tmp, double *argv, bool check_each);  //evaluates a function operator on a block, args[j * BLOCK_ROWS + i] is the operand j of the row i and args_defined[j * BLOCK_ROWS + i] says if it is defined. Results and their defined flags are written to the level of the first operand
+
+
+        bool func_flags_raised()
+        {
+            return std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW) != 0;
+        }
+
+        void eval_func_rows(const Instruction &ins, double *args, bool *args_defined, std::size_t n, double *tmp, double *argv, bool check_each)
+        {
+            for(unsigned short j = 1; j < ins.n_operands; ++j)  //the result is defined only where all the operands are
+                for(std::size_t i = 0; i < n; ++i)
+                    args_defined[i] = args_defined[i] && args_defined[j * BLOCK_ROWS + i];
+
+            simd::func_kernel kernel = (ins.n_operands == 1) ? simd::find_kernel(ins.func) : nullptr;
+
+            if(kernel != nullptr){
+                if(check_each)
+                    std::feclearexcept(FE_ALL_EXCEPT);
+                (*kernel)(args, tmp, n);
+
+                if(check_each && func_flags_raised()){  //find out which rows are not defined
+                    for(std::size_t i = 0; i < n; ++i){
+                        if(!args_defined[i])
+                            continue;
+                        std::feclearexcept(FE_ALL_EXCEPT);
+                        tmp[i] = (*ins.func)(args + i);
+                        if(func_flags_raised()){
+                            RPN_PROFILE_UNDEFINED_FLAGS();
+                            args_defined[i] = false;
+                        }
+                    }
+                }
+
+                std::copy(tmp, tmp + n, args);
+                return;
+            }
+
+            for(std::size_t i = 0; i < n; ++i){
+                if(!args_defined[i])
+                    continue;
+
+                for(unsigned short j = 0; j < ins.n_operands; ++j)
+                    argv[j] = args[j * BLOCK_ROWS + i];
+
+                if(check_each)
+                    std::feclearexcept(FE_ALL_EXCEPT);
+                args[i] = call_operator(ins.index, argv);
+                if(check_each && func_flags_raised()){
+                    RPN_PROFILE_UNDEFINED_FLAGS();
+                    args_defined[i] = false;
+                }
+            }
+        }
+    }
+
+
+    bool ExpressionSet::add(const std::string &infix_expr)
+    {
+        std::vector<Instruction> expr_program;
+        SymbolTable new_slots(operand_slots);  //the conversion may add slots before finding out that the expression is not valid
+
+        if(!infix_to_rpn(infix_expr, expr_program, new_slots))
+            return false;
+
+        append(expr_program, new_slots);
+        return true;
+    }
+
+    bool ExpressionSet::add(const Context &ctx, const std::string &infix_expr)
+    {
+        std::vector<Instruction> expr_program;
+        SymbolTable new_slots(operand_slots);
+
+        if(!infix_to_rpn(ctx, infix_expr, expr_program, new_slots))
+            return false;
+
+        append(expr_program, new_slots);
+        return true;
+    }
+
+    void ExpressionSet::clear()
+    {
+        source.clear();
+        program.clear();
+        operand_slots.clear();
+        n_expressions = 0;
+        n_unshared = 0;
+        depth = 0;
+        n_temps = 0;
+        calls_functions = false;
+    }
+
+    std::size_t ExpressionSet::size() const
+    {
+        return n_expressions;
+    }
+
+    void ExpressionSet::evaluate(double *results, bool *defined) const
+    {
+        evaluate(get_all_operands(), results, defined);
+    }
+
+    void ExpressionSet::evaluate(const Context &ctx, double *results, bool *defined) const
+    {
+        evaluate(ctx.get_all_operands(), results, defined);
+    }
+
+    void ExpressionSet::evaluate(const std::unordered_map<std::string, double> &operands, double *results, bool *defined) const
+    {
+        std::vector<double> values(operand_slots.size(), 0.0);
+        std::unique_ptr<bool[]> found;  //allocated only if an operand is missing
+
+        for(unsigned slot = 0; slot < operand_slots.size(); ++slot){
+            std::unordered_map<std::string, double>::const_iterator it = operands.find(operand_slots.name(slot));
+            if(it != operands.cend()){
+                values[slot] = it->second;
+                continue;
+            }
+
+            if(!found){  //the operand has been removed after the expression was added
+                found.reset(new bool[operand_slots.size()]);
+                std::fill(found.get(), found.get() + operand_slots.size(), true);
+            }
+            found[slot] = false;
+        }
+
+        evaluate_row(values.data(), found.get(), results, defined);
+    }
+
+    void ExpressionSet::evaluate(const double *operand_values, double *results, bool *defined) const
+    {
+        evaluate_row(operand_values, nullptr, results, defined);
+    }
+
+    void ExpressionSet::evaluate_row(const double *operand_values, const bool *operand_defined, double *results, bool *defined) const
+    {
+        RPN_PROFILE_PHASE(EVALUATION);
+        double local_values[LOCAL_VALUES];
+        bool local_defined[LOCAL_VALUES];
+        std::vector<double> heap_values;
+        std::unique_ptr<bool[]> heap_defined;
+        double *stack = local_values;
+        bool *stack_defined = local_defined;
+
+        if(depth + n_temps > LOCAL_VALUES){
+            heap_values.resize(depth + n_temps);
+            heap_defined.reset(new bool[depth + n_temps]);
+            stack = heap_values.data();
+            stack_defined = heap_defined.get();
+        }
+
+        if(check == FpCheck::DEFERRED && calls_functions){
+            std::feclearexcept(FE_ALL_EXCEPT);
+            run(operand_values, operand_defined, results, defined, stack, stack_defined, false);
+            if(!func_flags_raised())
+                return;
+
+            RPN_PROFILE_RECHECK();
+            run(operand_values, operand_defined, results, defined, stack, stack_defined, true);
+            return;
+        }
+
+        run(operand_values, operand_defined, results, defined, stack, stack_defined, true);
+    }
+
+    void ExpressionSet::run(const double *operand_values, const bool *operand_defined, double *results, bool *defined, double *values, bool *values_defined, bool check_each) const
+    {
+        double *top = values;  //points one position past the value on top of the stack
+        bool *top_defined = values_defined;
+        double *temp_values = values + depth;
+        bool *temp_defined = values_defined + depth;
+
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            RPN_PROFILE_INSTRUCTION(*it, 1);
+
+            switch(it->opcode){
+                case OpCode::PUSH_VALUE:
+                    *top++ = it->value;
+                    *top_defined++ = true;
+                    break;
+
+                case OpCode::PUSH_OPERAND:
+                    *top++ = operand_values[it->index];
+                    *top_defined++ = (operand_defined == nullptr) || operand_defined[it->index];
+                    break;
+
+                case OpCode::ADD:
+                    --top;
+                    --top_defined;
+                    top[-1] += top[0];
+                    top_defined[-1] = top_defined[-1] && top_defined[0];
+                    break;
+
+                case OpCode::SUB:
+                    --top;
+                    --top_defined;
+                    top[-1] -= top[0];
+                    top_defined[-1] = top_defined[-1] && top_defined[0];
+                    break;
+
+                case OpCode::MUL:
+                    --top;
+                    --top_defined;
+                    top[-1] *= top[0];
+                    top_defined[-1] = top_defined[-1] && top_defined[0];
+                    break;
+
+                case OpCode::DIV:
+                    --top;
+                    --top_defined;
+                    if(top[0] == 0){  //also keeps FE_DIVBYZERO from asking for a second evaluation in DEFERRED mode
+                        if(top_defined[-1] && top_defined[0])
+                            RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+                        top_defined[-1] = false;
+                    }
+                    else{
+                        top[-1] /= top[0];
+                        top_defined[-1] = top_defined[-1] && top_defined[0];
+                    }
+                    break;
+
+                case OpCode::FUNC_OPERATOR:{
+                    const unsigned short n_operands = it->n_operands;
+                    top -= n_operands - 1;  //top[-1] is now the first operand of the function
+                    top_defined -= n_operands - 1;
+
+                    bool args_defined = true;
+                    for(unsigned short j = 0; j < n_operands; ++j)
+                        args_defined = args_defined && top_defined[j - 1];
+                    top_defined[-1] = args_defined;
+
+                    if(!args_defined)  //the result is not defined anyway, the function is not called
+                        break;
+
+                    if(check_each)
+                        std::feclearexcept(FE_ALL_EXCEPT);
+                    top[-1] = call_operator(it->index, top - 1);
+                    if(check_each && func_flags_raised()){
+                        RPN_PROFILE_UNDEFINED_FLAGS();
+                        top_defined[-1] = false;
+                    }
+                    break;
+                }
+
+                case OpCode::STORE_TEMP:
+                    temp_values[it->index] = top[-1];
+                    temp_defined[it->index] = top_defined[-1];
+                    break;
+
+                case OpCode::LOAD_TEMP:
+                    *top++ = temp_values[it->index];
+                    *top_defined++ = temp_defined[it->index];
+                    break;
+
+                case OpCode::STORE_RESULT:
+                    --top;
+                    --top_defined;
+                    results[it->index] = *top_defined ? *top : 0.0;
+                    defined[it->index] = *top_defined;
+                    break;
+            }
+        }
+    }
+
+    void ExpressionSet::evaluate_batch(const double *const *operand_columns, std::size_t n_rows, double *const *result_columns, bool *const *defined_columns) const
+    {
+        RPN_PROFILE_PHASE(EVALUATION);
+        const std::size_t levels = depth + n_temps;  //the temporary slots follow the stack levels
+        unsigned short max_operands = 0;
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it)
+            if(it->opcode == OpCode::FUNC_OPERATOR)
+                max_operands = std::max(max_operands, it->n_operands);
+
+        std::vector<double> values(levels * BLOCK_ROWS);  //level k of the block is values[k * BLOCK_ROWS ... k * BLOCK_ROWS + BLOCK_ROWS - 1]
+        std::unique_ptr<bool[]> values_defined(new bool[levels * BLOCK_ROWS + 1]);
+        std::vector<double> tmp(BLOCK_ROWS);
+        std::vector<double> argv(max_operands);
+
+        for(std::size_t first = 0; first < n_rows; first += BLOCK_ROWS){
+            const std::size_t n = std::min(BLOCK_ROWS, n_rows - first);
+            const auto run_block = [&](bool check_each){  //evaluates the rows first ... first + n - 1
+                std::size_t level = 0;  //number of levels on the stack
+                double *top = values.data();  //level on top of the stack
+                bool *top_defined = values_defined.get();
+
+                for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+                    RPN_PROFILE_INSTRUCTION(*it, n);
+
+                    switch(it->opcode){
+                        case OpCode::PUSH_VALUE:
+                            top = values.data() + level * BLOCK_ROWS;
+                            top_defined = values_defined.get() + level++ * BLOCK_ROWS;
+                            std::fill(top, top + n, it->value);
+                            std::fill(top_defined, top_defined + n, true);
+                            break;
+
+                        case OpCode::PUSH_OPERAND:
+                            top = values.data() + level * BLOCK_ROWS;
+                            top_defined = values_defined.get() + level++ * BLOCK_ROWS;
+                            std::copy(operand_columns[it->index] + first, operand_columns[it->index] + first + n, top);
+                            std::fill(top_defined, top_defined + n, true);
+                            break;
+
+                        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:{
+                            --level;
+                            top = values.data() + (level - 1) * BLOCK_ROWS;
+                            top_defined = values_defined.get() + (level - 1) * BLOCK_ROWS;
+                            const double *second = top + BLOCK_ROWS;
+                            const bool *second_defined = top_defined + BLOCK_ROWS;
+
+                            for(std::size_t i = 0; i < n; ++i)
+                                top_defined[i] = top_defined[i] && second_defined[i];
+#ifdef RPN_UTILS_PROFILE
+                            if(it->opcode == OpCode::DIV)
+                                for(std::size_t i = 0; i < n; ++i)
+                                    if(top_defined[i] && second[i] == 0)
+                                        RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+#endif
+
+                            if(it->opcode == OpCode::ADD)
+                                simd::add(top, second, n);
+                            else if(it->opcode == OpCode::SUB)
+                                simd::sub(top, second, n);
+                            else if(it->opcode == OpCode::MUL)
+                                simd::mul(top, second, n);
+                            else
+                                simd::div(top, second, n, top_defined);
+                            break;
+                        }
+
+                        case OpCode::FUNC_OPERATOR:
+                            level -= it->n_operands - 1;
+                            top = values.data() + (level - 1) * BLOCK_ROWS;  //top now points to the level of the first operand
+                            top_defined = values_defined.get() + (level - 1) * BLOCK_ROWS;
+                            eval_func_rows(*it, top, top_defined, n, tmp.data(), argv.data(), check_each);
+                            break;
+
+                        case OpCode::STORE_TEMP:
+                            std::copy(top, top + n, values.data() + (depth + it->index) * BLOCK_ROWS);
+                            std::copy(top_defined, top_defined + n, values_defined.get() + (depth + it->index) * BLOCK_ROWS);
+                            break;
+
+                        case OpCode::LOAD_TEMP:
+                            top = values.data() + level * BLOCK_ROWS;
+                            top_defined = values_defined.get() + level++ * BLOCK_ROWS;
+                            std::copy(values.data() + (depth + it->index) * BLOCK_ROWS, values.data() + (depth + it->index) * BLOCK_ROWS + n, top);
+                            std::copy(values_defined.get() + (depth + it->index) * BLOCK_ROWS, values_defined.get() + (depth + it->index) * BLOCK_ROWS + n, top_defined);
+                            break;
+
+                        case OpCode::STORE_RESULT:
+                            for(std::size_t i = 0; i < n; ++i){
+                                result_columns[it->index][first + i] = top_defined[i] ? top[i] : 0.0;
+                                defined_columns[it->index][first + i] = top_defined[i];
+                            }
+                            if(--level > 0){  //when the stack is empty the next instruction pushes and sets top
+                                top = values.data() + (level - 1) * BLOCK_ROWS;
+                                top_defined = values_defined.get() + (level - 1) * BLOCK_ROWS;
+                            }
+                            break;
+                    }
+                }
+            };
+
+            if(check == FpCheck::PER_OPERATOR || !calls_functions)
+                run_block(true);
+            else{  //a raised flag is attributed to the rows by evaluating the block again
+                std::feclearexcept(FE_ALL_EXCEPT);
+                run_block(false);
+                if(func_flags_raised()){
+                    RPN_PROFILE_RECHECK();
+                    run_block(true);
+                }
+            }
+        }
+    }
+
+    const SymbolTable &ExpressionSet::symbols() const
+    {
+        return operand_slots;
+    }
+
+    const std::vector<Instruction> &ExpressionSet::instructions() const
+    {
+        return program;
+    }
+
+    std::size_t ExpressionSet::unshared_size() const
+    {
+        return n_unshared;
+    }
+
+    void ExpressionSet::set_fp_check(FpCheck mode)
+    {
+        check = mode;
+    }
+
+    FpCheck ExpressionSet::fp_check() const
+    {
+        return check;
+    }
+
+    void ExpressionSet::append(const std::vector<Instruction> &expr_program, const SymbolTable &new_slots)
+    {
+        operand_slots = new_slots;
+        source.insert(source.end(), expr_program.cbegin(), expr_program.cend());
+        source.push_back({OpCode::STORE_RESULT, 0, static_cast<unsigned>(n_expressions), 0.0, nullptr});
+        ++n_expressions;
+        n_unshared += expr_program.size();
+
+        build();
+    }
+
+    void ExpressionSet::build()
+    {
+        program = source;
+        optimize(program);
+        eliminate_common_subexpressions(program);
+
+        long levels = 0;
+        depth = 0;
+        n_temps = 0;
+        calls_functions = false;
+
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            switch(it->opcode){
+                case OpCode::PUSH_VALUE: case OpCode::PUSH_OPERAND: case OpCode::LOAD_TEMP:
+                    ++levels;
+                    break;
+
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::STORE_RESULT:
+                    --levels;
+                    break;
+
+                case OpCode::FUNC_OPERATOR:
+                    levels -= it->n_operands - 1;
+                    calls_functions = true;
+                    break;
+
+                case OpCode::STORE_TEMP:
+                    n_temps = std::max(n_temps, it->index + 1);
+                    break;
+            }
+
+            if(static_cast<unsigned long>(levels) > depth)
+                depth = levels;
+        }
+    }
+}
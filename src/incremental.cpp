@@ -0,0 +1,239 @@
+/**
+ * @file incremental.cpp
+ * @brief Implementation file for the incremental evaluation module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "incremental.hpp"
+#include "profile.hpp"
+#include <cstring>
+
+namespace rpn
+{
+    bool IncrementalExpr::assign(const CompiledExpr &compiled_expr, const double *operand_values)
+    {
+        clear();
+        if(compiled_expr.empty())
+            return false;
+
+        const std::vector<Instruction> &program = compiled_expr.instructions();
+        std::vector<unsigned> stack;  //nodes of the values on the stack
+        std::vector<unsigned> temps(compiled_expr.temps());  //nodes stored in the temporary slots
+        std::vector<unsigned> n_parents;
+        unsigned short max_operands = 0;
+
+        operands.assign(operand_values, operand_values + compiled_expr.operand_names().size());
+        first_leaf.assign(operands.size() + 1, 0);
+
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            Node node = {it->opcode, 0, it->index, static_cast<unsigned>(children.size()), 0, it->value, true};
+
+            switch(it->opcode){
+                case OpCode::STORE_TEMP:
+                    temps[it->index] = stack.back();
+                    continue;
+
+                case OpCode::LOAD_TEMP:  //the same node, used by one more parent
+                    stack.push_back(temps[it->index]);
+                    continue;
+
+                case OpCode::PUSH_OPERAND:
+                    node.value = operands[it->index];
+                    ++first_leaf[it->index + 1];
+                    break;
+
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+                    node.n_operands = 2;
+                    break;
+
+                case OpCode::FUNC_OPERATOR:
+                    node.n_operands = it->n_operands;
+                    max_operands = std::max(max_operands, it->n_operands);
+                    break;
+
+                default:
+                    break;
+            }
+
+            children.insert(children.end(), stack.end() - node.n_operands, stack.end());
+            stack.resize(stack.size() - node.n_operands);
+            stack.push_back(graph.size());
+            graph.push_back(node);
+        }
+
+        //parents and leaves, grouped by node and by slot
+        n_parents.assign(graph.size() + 1, 0);
+        for(std::vector<unsigned>::const_iterator it = children.cbegin(); it != children.cend(); ++it)
+            ++n_parents[*it + 1];
+        for(std::vector<Node>::size_type i = 0; i < graph.size(); ++i){
+            n_parents[i + 1] += n_parents[i];
+            graph[i].first_parent = n_parents[i];
+        }
+        parents.resize(children.size());
+        for(std::vector<Node>::size_type i = 0; i < graph.size(); ++i)
+            for(unsigned c = 0; c < graph[i].n_operands; ++c)
+                parents[n_parents[children[graph[i].first_child + c]]++] = i;
+
+        for(std::vector<unsigned>::size_type slot = 0; slot < operands.size(); ++slot)
+            first_leaf[slot + 1] += first_leaf[slot];
+        leaves.resize(first_leaf.back());
+        std::vector<unsigned> next_leaf(first_leaf.cbegin(), first_leaf.cend() - 1);
+        for(std::vector<Node>::size_type i = 0; i < graph.size(); ++i)
+            if(graph[i].opcode == OpCode::PUSH_OPERAND)
+                leaves[next_leaf[graph[i].index]++] = i;
+
+        argv.resize(max_operands);
+        scheduled.assign(graph.size(), false);
+
+        for(std::vector<Node>::iterator it = graph.begin(); it != graph.end(); ++it)  //first evaluation, every node in order
+            compute(*it);
+        return true;
+    }
+
+    void IncrementalExpr::set_operand(unsigned slot, double value)
+    {
+        if(std::memcmp(&operands[slot], &value, sizeof(value)) == 0)  //same bits, nothing to compute (also for NaN)
+            return;
+
+        operands[slot] = value;
+        for(unsigned i = first_leaf[slot]; i < first_leaf[slot + 1]; ++i){
+            graph[leaves[i]].value = value;
+            changed(leaves[i]);
+        }
+    }
+
+    void IncrementalExpr::set_operands(const double *operand_values)
+    {
+        for(unsigned slot = 0; slot < operands.size(); ++slot)
+            set_operand(slot, operand_values[slot]);
+    }
+
+    double IncrementalExpr::operand(unsigned slot) const
+    {
+        return operands[slot];
+    }
+
+    std::pair<bool, double> IncrementalExpr::evaluate()
+    {
+        RPN_PROFILE_PHASE(EVALUATION);
+        if(graph.empty())
+            return std::make_pair(false, 0.0);
+
+        while(!dirty.empty()){  //in increasing order, so the operands of a node are computed before it
+            unsigned node = dirty.top();
+            dirty.pop();
+            scheduled[node] = false;
+
+            ++n_recomputed;
+            if(compute(graph[node]))
+                changed(node);
+        }
+
+        const Node &root = graph.back();
+        return root.defined ? std::make_pair(true, root.value) : std::make_pair(false, 0.0);
+    }
+
+    void IncrementalExpr::clear()
+    {
+        graph.clear();
+        children.clear();
+        parents.clear();
+        operands.clear();
+        first_leaf.clear();
+        leaves.clear();
+        argv.clear();
+        scheduled.clear();
+        dirty = std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned>>();
+        n_recomputed = 0;
+    }
+
+    bool IncrementalExpr::empty() const
+    {
+        return graph.empty();
+    }
+
+    std::size_t IncrementalExpr::nodes() const
+    {
+        return graph.size();
+    }
+
+    unsigned long IncrementalExpr::recomputed() const
+    {
+        return n_recomputed;
+    }
+
+    bool IncrementalExpr::compute(Node &node)
+    {
+        const double old_value = node.value;
+        const bool old_defined = node.defined;
+        const unsigned *args = children.data() + node.first_child;
+        RPN_PROFILE_INSTRUCTION(node, 1);
+
+        switch(node.opcode){
+            case OpCode::PUSH_VALUE: case OpCode::PUSH_OPERAND:  //the value is already in the node
+                return true;
+
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:{
+                const Node &op1 = graph[args[0]];
+                const Node &op2 = graph[args[1]];
+                node.defined = op1.defined && op2.defined;
+
+                if(node.opcode == OpCode::ADD)
+                    node.value = op1.value + op2.value;
+                else if(node.opcode == OpCode::SUB)
+                    node.value = op1.value - op2.value;
+                else if(node.opcode == OpCode::MUL)
+                    node.value = op1.value * op2.value;
+                else if(op2.value == 0){
+                    if(node.defined)
+                        RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+                    node.defined = false;
+                }
+                else
+                    node.value = op1.value / op2.value;
+                break;
+            }
+
+            case OpCode::FUNC_OPERATOR:{
+                node.defined = true;
+                for(unsigned short j = 0; j < node.n_operands; ++j){
+                    node.defined = node.defined && graph[args[j]].defined;
+                    argv[j] = graph[args[j]].value;
+                }
+
+                if(!node.defined)  //the operator is not called, the result is not defined anyway
+                    break;
+
+                std::feclearexcept(FE_ALL_EXCEPT);
+                node.value = call_operator(node.index, argv.data());
+                if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){
+                    RPN_PROFILE_UNDEFINED_FLAGS();
+                    node.defined = false;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        if(node.defined != old_defined)
+            return true;
+        return node.defined && std::memcmp(&node.value, &old_value, sizeof(old_value)) != 0;  //an undefined node does not change while it stays undefined
+    }
+
+    void IncrementalExpr::changed(unsigned node)
+    {
+        const unsigned last = (node + 1 < graph.size()) ? graph[node + 1].first_parent : parents.size();
+
+        for(unsigned i = graph[node].first_parent; i < last; ++i){
+            if(!scheduled[parents[i]]){
+                scheduled[parents[i]] = true;
+                dirty.push(parents[i]);
+            }
+        }
+    }
+}
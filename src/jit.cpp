@@ -0,0 +1,415 @@
+/**
+ * @file jit.cpp
+ * @brief Implementation file for the jit module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "jit.hpp"
+#include "profile.hpp"
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__))
+#define RPN_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+namespace rpn
+{
+    namespace
+    {
+        //values returned by the generated function
+        const int STATUS_UNDEFINED = 0;
+        const int STATUS_DEFINED = 1;
+        const int STATUS_RECHECK = 2;  //FpCheck::DEFERRED only: a flag was raised, the expression must be evaluated again checking each operator
+    }
+
+#ifdef RPN_JIT_X86_64
+    namespace
+    {
+        /*
+            The generated function has the signature int f(const double *operand_values, double *result) (System V ABI):
+            operand_values is kept in rbx, result in r12. The stack level i of the rpn program lives in the register
+            xmm(i + FIRST_STACK_REG); xmm0 and xmm1 are scratch registers.
+            All the xmm registers are caller-saved, so before calling a function operator every level is spilled
+            to the frame at [rsp + 8 * level]: the operands of the function are then contiguous in memory and
+            their address is passed as argv. The temporary slots of the program follow the spilled levels, slot k
+            is at [rsp + 8 * (N_STACK_REGS + k)].
+        */
+        const unsigned FIRST_STACK_REG = 2;
+        const unsigned N_STACK_REGS = 16 - FIRST_STACK_REG;
+
+        void jit_clear_flags();  //called by the native code before a function operator
+        int jit_test_flags();  //called by the native code after a function operator, returns non zero if the operator is not defined for its operands
+
+
+        void jit_clear_flags()
+        {
+            std::feclearexcept(FE_ALL_EXCEPT);
+        }
+
+        int jit_test_flags()
+        {
+            return std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW);
+        }
+
+        class Assembler  //emits the few x86-64 instructions used by the jit
+        {
+        public:
+            const std::vector<unsigned char> &code() const { return bytes; }
+
+            void prologue(unsigned n_temps)
+            {
+                frame_size = static_cast<std::int32_t>(8 * (N_STACK_REGS + n_temps + (n_temps % 2)) + 8);  //keeps rsp aligned to 16 bytes at the calls
+                emit({0x53});  //push rbx
+                emit({0x41, 0x54});  //push r12
+                emit({0x48, 0x89, 0xFB});  //mov rbx, rdi
+                emit({0x49, 0x89, 0xF4});  //mov r12, rsi
+                emit({0x48, 0x81, 0xEC});  //sub rsp, frame_size
+                imm32(frame_size);
+            }
+
+            void epilogue(int status)  //status < 0 returns the value already in eax
+            {
+                if(status >= 0){
+                    emit({0xB8});  //mov eax, status
+                    imm32(status);
+                }
+                emit({0x48, 0x81, 0xC4});  //add rsp, frame_size
+                imm32(frame_size);
+                emit({0x41, 0x5C});  //pop r12
+                emit({0x5B});  //pop rbx
+                emit({0xC3});  //ret
+            }
+
+            void load_constant(unsigned xmm, double value)
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                emit({0x48, 0xB8});  //mov rax, imm64
+                for(unsigned i = 0; i < 8; ++i)
+                    emit({static_cast<unsigned char>(bits >> (8 * i))});
+                emit({0x66, static_cast<unsigned char>(0x48 | rex_r(xmm)), 0x0F, 0x6E, modrm(3, xmm, 0)});  //movq xmm, rax
+            }
+
+            void load_operand(unsigned xmm, unsigned index)  //movsd xmm, [rbx + 8 * index]
+            {
+                sse_mem(0xF2, 0x10, xmm, 3, 8 * index);
+            }
+
+            void spill(unsigned xmm, unsigned level)  //movsd [rsp + 8 * level], xmm
+            {
+                sse_mem(0xF2, 0x11, xmm, 4, 8 * level);
+            }
+
+            void reload(unsigned xmm, unsigned level)  //movsd xmm, [rsp + 8 * level]
+            {
+                sse_mem(0xF2, 0x10, xmm, 4, 8 * level);
+            }
+
+            void arith(unsigned char opcode, unsigned dst, unsigned src)  //addsd (0x58), mulsd (0x59), subsd (0x5C), divsd (0x5E) dst, src
+            {
+                sse_reg(0xF2, opcode, dst, src);
+            }
+
+            void move(unsigned dst, unsigned src)  //movsd dst, src
+            {
+                sse_reg(0xF2, 0x10, dst, src);
+            }
+
+            void store_result(unsigned xmm)  //movsd [r12], xmm
+            {
+                emit({0xF2, static_cast<unsigned char>(0x41 | rex_r(xmm)), 0x0F, 0x11, modrm(0, xmm, 4), 0x24});
+            }
+
+            void jump_if_zero(unsigned xmm)  //jumps to the undefined exit if xmm == 0
+            {
+                sse_reg(0x66, 0x57, 0, 0);  //xorpd xmm0, xmm0
+                sse_reg(0x66, 0x2E, xmm, 0);  //ucomisd xmm, xmm0
+                emit({0x7A, 0x06});  //jp over the je (xmm is NaN)
+                emit({0x0F, 0x84});  //je undefined
+                undefined_jump();
+            }
+
+            void call(const void *function)  //mov rax, function; call rax
+            {
+                std::uint64_t address = reinterpret_cast<std::uint64_t>(function);
+                emit({0x48, 0xB8});
+                for(unsigned i = 0; i < 8; ++i)
+                    emit({static_cast<unsigned char>(address >> (8 * i))});
+                emit({0xFF, 0xD0});
+            }
+
+            void argv(unsigned level)  //lea rdi, [rsp + 8 * level]
+            {
+                emit({0x48, 0x8D, 0xBC, 0x24});
+                imm32(8 * level);
+            }
+
+            void user_data(const void *data)  //mov rsi, data
+            {
+                std::uint64_t address = reinterpret_cast<std::uint64_t>(data);
+                emit({0x48, 0xBE});
+                for(unsigned i = 0; i < 8; ++i)
+                    emit({static_cast<unsigned char>(address >> (8 * i))});
+            }
+
+            void flags_status()  //eax = (eax != 0) ? 2 : 1
+            {
+                emit({0x85, 0xC0});  //test eax, eax
+                emit({0x0F, 0x95, 0xC0});  //setnz al
+                emit({0x0F, 0xB6, 0xC0});  //movzx eax, al
+                emit({0xFF, 0xC0});  //inc eax
+            }
+
+            void jump_if_eax()  //test eax, eax; jnz undefined
+            {
+                emit({0x85, 0xC0, 0x0F, 0x85});
+                undefined_jump();
+            }
+
+            void undefined_exit()  //binds the jumps to the undefined exit
+            {
+                for(std::vector<std::size_t>::const_iterator it = fixups.cbegin(); it != fixups.cend(); ++it){
+                    std::int32_t rel = static_cast<std::int32_t>(bytes.size() - (*it + 4));
+                    std::memcpy(&bytes[*it], &rel, sizeof(rel));
+                }
+                epilogue(STATUS_UNDEFINED);
+            }
+
+        private:
+            static unsigned char rex_r(unsigned reg) { return (reg & 8) ? 0x44 : 0x40; }
+            static unsigned char rex_b(unsigned reg) { return (reg & 8) ? 0x41 : 0x40; }
+            static unsigned char modrm(unsigned mod, unsigned reg, unsigned rm) { return static_cast<unsigned char>((mod << 6) | ((reg & 7) << 3) | (rm & 7)); }
+
+            void emit(std::initializer_list<unsigned char> list)
+            {
+                bytes.insert(bytes.end(), list);
+            }
+
+            void imm32(std::int32_t value)
+            {
+                for(unsigned i = 0; i < 4; ++i)
+                    emit({static_cast<unsigned char>(static_cast<std::uint32_t>(value) >> (8 * i))});
+            }
+
+            void sse_reg(unsigned char prefix, unsigned char opcode, unsigned reg, unsigned rm)
+            {
+                emit({prefix});
+                unsigned char rex = rex_r(reg) | (rex_b(rm) & 0x01);
+                if(rex != 0x40)
+                    emit({rex});
+                emit({0x0F, opcode, modrm(3, reg, rm)});
+            }
+
+            void sse_mem(unsigned char prefix, unsigned char opcode, unsigned reg, unsigned base, std::int32_t disp)  //base is rbx (3) or rsp (4)
+            {
+                emit({prefix});
+                if(reg & 8)
+                    emit({rex_r(reg)});
+                emit({0x0F, opcode, modrm(2, reg, base)});
+                if(base == 4)
+                    emit({0x24});  //SIB: base rsp, no index
+                imm32(disp);
+            }
+
+            void undefined_jump()
+            {
+                fixups.push_back(bytes.size());
+                imm32(0);
+            }
+
+            std::vector<unsigned char> bytes;
+            std::vector<std::size_t> fixups;  //positions of the rel32 of the jumps to the undefined exit
+            std::int32_t frame_size = 0;  //bytes reserved below rsp by the prologue for the spilled stack levels and the temporary slots (plus padding for the alignment)
+        };
+
+        bool generate(const CompiledExpr &compiled_expr, Assembler &as);  //generates the native code of the expression, returns false if the program cannot be translated
+
+
+        bool generate(const CompiledExpr &compiled_expr, Assembler &as)
+        {
+            if(compiled_expr.empty() || compiled_expr.max_depth() > N_STACK_REGS || compiled_expr.temps() > 0x0FFFFFFF / 8 - N_STACK_REGS)
+                return false;
+
+            unsigned levels = 0;  //number of levels on the stack
+            bool check_each = compiled_expr.fp_check() == FpCheck::PER_OPERATOR || !compiled_expr.has_func_operators();
+            as.prologue(compiled_expr.temps());
+            if(!check_each)
+                as.call(reinterpret_cast<const void *>(&jit_clear_flags));
+
+            const std::vector<Instruction> &program = compiled_expr.instructions();
+            for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+                switch(it->opcode){
+                    case OpCode::PUSH_VALUE:
+                        as.load_constant(FIRST_STACK_REG + levels++, it->value);
+                        break;
+
+                    case OpCode::PUSH_OPERAND:
+                        as.load_operand(FIRST_STACK_REG + levels++, it->index);
+                        break;
+
+                    case OpCode::ADD:
+                        --levels;
+                        as.arith(0x58, FIRST_STACK_REG + levels - 1, FIRST_STACK_REG + levels);
+                        break;
+
+                    case OpCode::SUB:
+                        --levels;
+                        as.arith(0x5C, FIRST_STACK_REG + levels - 1, FIRST_STACK_REG + levels);
+                        break;
+
+                    case OpCode::MUL:
+                        --levels;
+                        as.arith(0x59, FIRST_STACK_REG + levels - 1, FIRST_STACK_REG + levels);
+                        break;
+
+                    case OpCode::DIV:
+                        --levels;
+                        as.jump_if_zero(FIRST_STACK_REG + levels);
+                        as.arith(0x5E, FIRST_STACK_REG + levels - 1, FIRST_STACK_REG + levels);
+                        break;
+
+                    case OpCode::FUNC_OPERATOR:{
+                        unsigned first = levels - it->n_operands;  //level of the first operand, and of the result
+
+                        for(unsigned level = 0; level < levels; ++level)
+                            as.spill(FIRST_STACK_REG + level, level);
+                        if(check_each)
+                            as.call(reinterpret_cast<const void *>(&jit_clear_flags));
+                        as.argv(first);
+                        const OperatorDef &def = operator_table[it->index];
+                        if(def.func != nullptr)
+                            as.call(reinterpret_cast<const void *>(def.func));
+                        else{
+                            as.user_data(def.user_data);
+                            as.call(reinterpret_cast<const void *>(def.closure));
+                        }
+                        as.spill(0, first);
+                        if(check_each){
+                            as.call(reinterpret_cast<const void *>(&jit_test_flags));
+                            as.jump_if_eax();
+                        }
+
+                        levels = first + 1;
+                        for(unsigned level = 0; level < levels; ++level)
+                            as.reload(FIRST_STACK_REG + level, level);
+                        break;
+                    }
+
+                    case OpCode::STORE_TEMP:
+                        as.spill(FIRST_STACK_REG + levels - 1, N_STACK_REGS + it->index);
+                        break;
+
+                    case OpCode::LOAD_TEMP:
+                        as.reload(FIRST_STACK_REG + levels++, N_STACK_REGS + it->index);
+                        break;
+
+                    default:
+                        return false;
+                }
+            }
+
+            as.store_result(FIRST_STACK_REG);
+            if(check_each)
+                as.epilogue(STATUS_DEFINED);
+            else{
+                as.call(reinterpret_cast<const void *>(&jit_test_flags));
+                as.flags_status();
+                as.epilogue(-1);
+            }
+            as.undefined_exit();
+            return true;
+        }
+    }
+#endif
+
+
+    JitExpr::~JitExpr()
+    {
+        clear();
+    }
+
+    bool JitExpr::assign(const CompiledExpr &compiled_expr)
+    {
+        clear();
+        expr = compiled_expr;
+
+#ifdef RPN_JIT_X86_64
+        Assembler as;
+        if(!generate(expr, as))
+            return false;
+
+        const std::vector<unsigned char> &bytes = as.code();
+        void *mem = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED)
+            return false;
+
+        std::memcpy(mem, bytes.data(), bytes.size());
+        if(mprotect(mem, bytes.size(), PROT_READ | PROT_EXEC) != 0){
+            munmap(mem, bytes.size());
+            return false;
+        }
+
+        code = mem;
+        code_size = bytes.size();
+        func = reinterpret_cast<native_func>(mem);
+        check_each = expr.fp_check() == FpCheck::PER_OPERATOR || !expr.has_func_operators();
+        expr.set_fp_check(FpCheck::PER_OPERATOR);  //the native code only falls back to the interpreter to check each operator
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    std::pair<bool, double> JitExpr::evaluate(const double *operand_values) const
+    {
+        if(func == nullptr)
+            return expr.evaluate(operand_values);
+
+        RPN_PROFILE_PHASE(EVALUATION);  //the native code does not count its instructions
+#ifdef RPN_UTILS_PROFILE
+        if(check_each)  //so that a flag raised at the undefined exit comes from the operator that failed
+            std::feclearexcept(FE_ALL_EXCEPT);
+#endif
+
+        double result;
+        switch((*func)(operand_values, &result)){
+            case STATUS_DEFINED:
+                return std::make_pair(true, result);
+            case STATUS_RECHECK:{
+                RPN_PROFILE_RECHECK();
+                return expr.evaluate(operand_values);
+            }
+            default:
+#ifdef RPN_UTILS_PROFILE
+                if(check_each && std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW))
+                    RPN_PROFILE_UNDEFINED_FLAGS();
+                else  //with FpCheck::DEFERRED the native code leaves early only on a division by zero
+                    RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+#endif
+                return std::make_pair(false, 0.0);
+        }
+    }
+
+    bool JitExpr::native() const
+    {
+        return func != nullptr;
+    }
+
+    void JitExpr::clear()
+    {
+#ifdef RPN_JIT_X86_64
+        if(code != nullptr)
+            munmap(code, code_size);
+#endif
+        code = nullptr;
+        code_size = 0;
+        func = nullptr;
+        check_each = false;
+        expr.clear();
+    }
+}
@@ -0,0 +1,184 @@
+/**
+ * @file operator_registry.cpp
+ * @brief Implementation file for the operator registry of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "operator_registry.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rpn
+{
+    namespace
+    {
+        /*
+            The table is a plain array of trivial structs (constant-initialized, so it can be used at any time during
+            static initialization), while the names live in the Registry, created on first use. An entry is written
+            before its id is published under the lock, and is never modified afterwards: the readers that got an id
+            can use operator_table without locking.
+            The lookup by name does not lock either: add copies the current name index, adds the new name and publishes
+            the copy through an atomic pointer. A published index is never modified, and is kept until the registry is
+            destroyed since a reader may still be using it
+        */
+        OperatorDef definitions[MAX_OPERATORS];
+
+        class Registry  //names of the operators, with the additional_operators table registered on construction
+        {
+        public:
+            Registry();
+            unsigned add(const std::string &name, const OperatorDef &def);  //returns the id of the new operator, OPERATOR_NPOS if the name is already used or the registry is full
+            unsigned find(const std::string &name) const;
+            const std::string &name(unsigned id) const;
+            unsigned size() const;
+
+        private:
+            typedef std::unordered_map<std::string_view, unsigned> NameIndex;  //the keys point to the strings of names
+
+            std::mutex mutex;  //taken by add only
+            std::atomic<const NameIndex *> index;  //last index published
+            std::vector<std::unique_ptr<const NameIndex>> indexes;  //every index published
+            std::string names[MAX_OPERATORS];
+            std::atomic<unsigned> count;
+        };
+
+        Registry &registry();  //returns the registry, creating it on first use
+        bool isValidName(const std::string &name);  //returns true if the name contains only lowercase characters
+        bool add_operator(const std::string &name, const OperatorDef &def);
+
+
+        Registry::Registry() : index(nullptr), count(0)
+        {
+            std::unique_ptr<NameIndex> first(new NameIndex);  //the additional operators are published with a single index
+            unsigned id = 0;
+
+            for(std::size_t i = 0; i < n_additional_operators && id < MAX_OPERATORS; ++i){
+                const AdditionalOperator &op = additional_operators[i];
+                if(first->find(op.name) != first->cend())
+                    continue;
+
+                definitions[id] = {op.func, nullptr, nullptr, op.n_operands, op.precedence, op.derivative};
+                names[id] = op.name;
+                first->emplace(names[id], id);
+                ++id;
+            }
+
+            count.store(id, std::memory_order_release);
+            index.store(first.get(), std::memory_order_release);
+            indexes.push_back(std::move(first));
+        }
+
+        unsigned Registry::add(const std::string &name, const OperatorDef &def)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            const NameIndex *current = index.load(std::memory_order_relaxed);
+            unsigned id = count.load(std::memory_order_relaxed);
+            if(id >= MAX_OPERATORS || current->find(name) != current->cend())
+                return OPERATOR_NPOS;
+
+            definitions[id] = def;
+            names[id] = name;
+
+            std::unique_ptr<NameIndex> next(new NameIndex(*current));
+            next->emplace(names[id], id);
+            indexes.reserve(indexes.size() + 1);  //so that push_back cannot throw after the index is published
+            count.store(id + 1, std::memory_order_release);  //before the index, so a reader that finds the id sees it below operator_count()
+            index.store(next.get(), std::memory_order_release);
+            indexes.push_back(std::move(next));
+            return id;
+        }
+
+        unsigned Registry::find(const std::string &name) const
+        {
+            const NameIndex *current = index.load(std::memory_order_acquire);
+
+            NameIndex::const_iterator it = current->find(name);
+            return (it != current->cend()) ? it->second : OPERATOR_NPOS;
+        }
+
+        const std::string &Registry::name(unsigned id) const
+        {
+            return names[id];
+        }
+
+        unsigned Registry::size() const
+        {
+            return count.load(std::memory_order_acquire);
+        }
+
+        Registry &registry()
+        {
+            static Registry instance;
+            return instance;
+        }
+
+        bool isValidName(const std::string &name)
+        {
+            if(name.empty())
+                return false;
+
+            for(std::string::const_iterator it = name.cbegin(); it != name.cend(); ++it)
+                if(!islower(*it))
+                    return false;
+            return true;
+        }
+
+        bool add_operator(const std::string &name, const OperatorDef &def)
+        {
+            if(!isValidName(name) || def.n_operands == 0)
+                return false;
+
+            return registry().add(name, def) != OPERATOR_NPOS;
+        }
+    }
+
+    const OperatorDef *const operator_table = definitions;
+
+
+    bool register_operator(const std::string &name, unsigned short n_operands, unsigned short precedence, operator_func func)
+    {
+        if(func == nullptr)
+            return false;
+
+        return add_operator(name, {func, nullptr, nullptr, n_operands, precedence, nullptr});
+    }
+
+    bool register_operator(const std::string &name, unsigned short n_operands, unsigned short precedence, operator_func func, operator_derivative derivative)
+    {
+        if(func == nullptr)
+            return false;
+
+        return add_operator(name, {func, nullptr, nullptr, n_operands, precedence, derivative});
+    }
+
+    bool register_operator(const std::string &name, unsigned short n_operands, unsigned short precedence, operator_closure closure, void *user_data)
+    {
+        if(closure == nullptr)
+            return false;
+
+        return add_operator(name, {nullptr, closure, user_data, n_operands, precedence, nullptr});
+    }
+
+    unsigned find_operator(const std::string &name)
+    {
+        return registry().find(name);
+    }
+
+    const std::string &operator_name(unsigned id)
+    {
+        return registry().name(id);
+    }
+
+    unsigned operator_count()
+    {
+        return registry().size();
+    }
+}
@@ -0,0 +1,359 @@
+/**
+ * @file optimizer.cpp
+ * @brief Implementation file for the optimizer module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "optimizer.hpp"
+#include <cstring>
+#include <cstdint>
+
+namespace rpn
+{
+    namespace
+    {
+        struct Node  //subexpression already written to the optimized program
+        {
+            std::vector<Instruction>::size_type start;  //index of its first instruction
+            bool literal;  //true if it is a single PUSH_VALUE
+            double value;  //value of the literal
+            operator_func func;  //function operator that computes it (nullptr if it is not computed by a function operator)
+        };
+
+        struct DagKey  //an instruction together with the nodes of its operands; two subexpressions are the same node if they have the same key
+        {
+            OpCode opcode;
+            unsigned index;
+            std::uint64_t value_bits;  //bits of the value of a PUSH_VALUE, so that 0.0 and -0.0 are different nodes
+            std::vector<unsigned> children;
+
+            bool operator==(const DagKey &other) const
+            {
+                return opcode == other.opcode && index == other.index && value_bits == other.value_bits && children == other.children;
+            }
+        };
+
+        struct DagKeyHash
+        {
+            std::size_t operator()(const DagKey &key) const
+            {
+                std::size_t h = std::hash<std::uint64_t>()(key.value_bits);
+                h = h * 1099511628211ULL ^ static_cast<unsigned>(key.opcode);  //mixed in as the children, so that nothing is shifted past the width of size_t
+                h = h * 1099511628211ULL ^ key.index;
+                for(std::vector<unsigned>::const_iterator it = key.children.cbegin(); it != key.children.cend(); ++it)
+                    h = h * 1099511628211ULL ^ *it;
+                return h;
+            }
+        };
+
+        const unsigned NO_TEMP = static_cast<unsigned>(-1);
+
+        bool fold_basic_operator(OpCode opcode, double op1, double op2, double &result);  //computes a basic operator, returns false if it is not defined for the operands
+        bool fold_func_operator(const Instruction &ins, const double *operands, double &result);  //computes a function operator, returns false if it is not defined for the operands
+        bool is_identity(OpCode opcode, const Node &op1, const Node &op2, bool &keep_first);  //returns true if the basic operator applied to the two operands gives one of them (keep_first says which one)
+
+
+        bool fold_basic_operator(OpCode opcode, double op1, double op2, double &result)
+        {
+            switch(opcode){
+                case OpCode::ADD:
+                    result = op1 + op2;
+                    return true;
+                case OpCode::SUB:
+                    result = op1 - op2;
+                    return true;
+                case OpCode::MUL:
+                    result = op1 * op2;
+                    return true;
+                case OpCode::DIV:
+                    if(op2 == 0)
+                        return false;
+                    result = op1 / op2;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool fold_func_operator(const Instruction &ins, const double *operands, double &result)
+        {
+            std::feclearexcept(FE_ALL_EXCEPT);
+            result = call_operator(ins.index, operands);
+            return !std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW);
+        }
+
+        bool is_identity(OpCode opcode, const Node &op1, const Node &op2, bool &keep_first)
+        {
+            switch(opcode){
+                case OpCode::ADD:
+                    keep_first = op2.literal && op2.value == 0;
+                    return keep_first || (op1.literal && op1.value == 0);
+                case OpCode::MUL:
+                    keep_first = op2.literal && op2.value == 1;
+                    return keep_first || (op1.literal && op1.value == 1);
+                case OpCode::SUB:
+                    keep_first = true;
+                    return op2.literal && op2.value == 0;
+                case OpCode::DIV:
+                    keep_first = true;
+                    return op2.literal && op2.value == 1;
+                default:
+                    return false;
+            }
+        }
+    }
+
+
+    unsigned optimize(std::vector<Instruction> &program, bool simplify_identities)
+    {
+        std::vector<Instruction> out;
+        std::vector<Node> nodes;
+        std::vector<double> operands;
+
+        out.reserve(program.size());
+
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            switch(it->opcode){
+                case OpCode::PUSH_VALUE: case OpCode::PUSH_OPERAND:
+                    nodes.push_back({out.size(), it->opcode == OpCode::PUSH_VALUE, it->value, nullptr});
+                    out.push_back(*it);
+                    break;
+
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:{
+                    if(nodes.size() < 2)  //not a valid program, leave it as it is
+                        return 0;
+
+                    Node op2 = nodes.back();
+                    nodes.pop_back();
+                    Node op1 = nodes.back();
+                    double result;
+                    bool keep_first;
+
+                    if(op1.literal && op2.literal && fold_basic_operator(it->opcode, op1.value, op2.value, result)){
+                        out.resize(op1.start);
+                        out.push_back({OpCode::PUSH_VALUE, 0, 0, result, nullptr});
+                        nodes.back() = {op1.start, true, result, nullptr};
+                    }
+                    else if(simplify_identities && is_identity(it->opcode, op1, op2, keep_first)){
+                        if(keep_first)
+                            out.resize(op2.start);  //removes the literal pushed as second operand
+                        else{
+                            out.erase(out.begin() + op1.start);  //removes the literal pushed as first operand
+                            op2.start = op1.start;
+                            nodes.back() = op2;
+                        }
+                    }
+                    else{
+                        nodes.back() = {op1.start, false, 0.0, nullptr};
+                        out.push_back(*it);
+                    }
+                    break;
+                }
+
+                case OpCode::FUNC_OPERATOR:{
+                    if(it->n_operands == 0 || nodes.size() < it->n_operands)
+                        return 0;
+
+                    std::vector<Node>::size_type first = nodes.size() - it->n_operands;
+                    bool all_literals = true;
+                    double result;
+
+                    operands.clear();
+                    for(std::vector<Node>::size_type i = first; i < nodes.size(); ++i){
+                        all_literals = all_literals && nodes[i].literal;
+                        operands.push_back(nodes[i].value);
+                    }
+
+                    const Node arg = nodes[first];
+                    Node node = {arg.start, false, 0.0, it->func};
+                    nodes.resize(first);
+
+                    if(all_literals && fold_func_operator(*it, operands.data(), result)){
+                        out.resize(node.start);
+                        out.push_back({OpCode::PUSH_VALUE, 0, 0, result, nullptr});
+                        node = {node.start, true, result, nullptr};
+                    }
+                    else if(simplify_identities && it->n_operands == 1 && it->func == wfunc_sqr && arg.func == wfunc_sqrt){  //sqr sqrt x = x
+                        out.pop_back();  //removes the sqrt, the last instruction of the operand
+                        node.func = nullptr;
+                    }
+                    else
+                        out.push_back(*it);
+
+                    nodes.push_back(node);
+                    break;
+                }
+
+                case OpCode::STORE_TEMP:  //the stored value is read elsewhere, so it can no longer be folded or removed
+                    if(nodes.empty())
+                        return 0;
+                    nodes.back().literal = false;
+                    nodes.back().func = nullptr;
+                    out.push_back(*it);
+                    break;
+
+                case OpCode::LOAD_TEMP:
+                    nodes.push_back({out.size(), false, 0.0, nullptr});
+                    out.push_back(*it);
+                    break;
+
+                case OpCode::STORE_RESULT:
+                    if(nodes.empty())
+                        return 0;
+                    nodes.pop_back();
+                    out.push_back(*it);
+                    break;
+            }
+        }
+
+        unsigned removed = program.size() - out.size();
+        program.swap(out);
+        return removed;
+    }
+
+    CseReport eliminate_common_subexpressions(std::vector<Instruction> &program)
+    {
+        CseReport report = {program.size(), program.size(), 0};
+        std::unordered_map<DagKey, unsigned, DagKeyHash> node_ids;
+        std::vector<unsigned> ids(program.size());  //node of the subexpression ending at each instruction
+        std::vector<unsigned> refs;  //number of times each node is an operand of another node (the operands of a repeated node are not counted again)
+        std::vector<unsigned> nodes;  //stack of nodes
+        std::vector<unsigned>::size_type arity;
+        bool stores_results = false;
+
+        //first pass: builds the dag of the program
+        for(std::vector<Instruction>::size_type i = 0; i < program.size(); ++i){
+            const Instruction &ins = program[i];
+            DagKey key = {ins.opcode, 0, 0, {}};
+
+            if(ins.opcode == OpCode::STORE_RESULT){  //uses the value on top of the stack, without producing a node
+                if(nodes.empty())
+                    return report;
+                ++refs[nodes.back()];
+                nodes.pop_back();
+                stores_results = true;
+                continue;
+            }
+
+            switch(ins.opcode){
+                case OpCode::PUSH_VALUE:
+                    std::memcpy(&key.value_bits, &ins.value, sizeof(key.value_bits));
+                    arity = 0;
+                    break;
+                case OpCode::PUSH_OPERAND:
+                    key.index = ins.index;
+                    arity = 0;
+                    break;
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+                    arity = 2;
+                    break;
+                case OpCode::FUNC_OPERATOR:
+                    key.index = ins.index;
+                    arity = ins.n_operands;
+                    break;
+                default:  //already uses temporary slots
+                    return report;
+            }
+
+            if(nodes.size() < arity || (arity == 0 && ins.opcode == OpCode::FUNC_OPERATOR))  //not a valid program, leave it as it is
+                return report;
+
+            key.children.assign(nodes.end() - arity, nodes.end());
+            nodes.resize(nodes.size() - arity);
+
+            std::pair<std::unordered_map<DagKey, unsigned, DagKeyHash>::iterator, bool> found = node_ids.emplace(std::move(key), refs.size());
+            if(found.second){
+                refs.push_back(0);
+                for(std::vector<unsigned>::const_iterator it = found.first->first.children.cbegin(); it != found.first->first.children.cend(); ++it)
+                    ++refs[*it];
+            }
+
+            ids[i] = found.first->second;
+            nodes.push_back(ids[i]);
+        }
+
+        if(nodes.size() != (stores_results ? 0 : 1))  //a program ends with its result on the stack, or with all its results stored
+            return report;
+
+        //second pass: writes the program again, replacing the subexpressions already computed with a LOAD_TEMP
+        std::vector<Instruction> out;
+        std::vector<unsigned> temps;  //temporary slot of each node, NO_TEMP if it is not stored
+        temps.assign(refs.size(), NO_TEMP);
+        std::vector<std::vector<Instruction>::size_type> starts;  //index in out of the first instruction of each value on the stack
+
+        out.reserve(program.size());
+
+        for(std::vector<Instruction>::size_type i = 0; i < program.size(); ++i){
+            const Instruction &ins = program[i];
+            const unsigned id = ids[i];
+
+            if(ins.opcode == OpCode::STORE_RESULT){
+                starts.pop_back();
+                out.push_back(ins);
+                continue;
+            }
+
+            switch(ins.opcode){
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+                    arity = 2;
+                    break;
+                case OpCode::FUNC_OPERATOR:
+                    arity = ins.n_operands;
+                    break;
+                default:
+                    arity = 0;
+            }
+
+            const std::vector<Instruction>::size_type start = (arity > 0) ? starts[starts.size() - arity] : out.size();
+            starts.resize(starts.size() - arity);
+
+            if(temps[id] != NO_TEMP){  //computed before, drops the instructions of its operands
+                out.resize(start);
+                out.push_back({OpCode::LOAD_TEMP, 0, temps[id], 0.0, nullptr});
+            }
+            else{
+                out.push_back(ins);
+                if(arity > 0 && refs[id] > 1){  //used more than once, a single operand or literal is not worth a slot
+                    temps[id] = report.temps++;
+                    out.push_back({OpCode::STORE_TEMP, 0, temps[id], 0.0, nullptr});
+                }
+            }
+
+            starts.push_back(start);
+        }
+
+        if(report.temps == 0)  //nothing to share
+            return report;
+
+        report.optimized_size = out.size();
+        program.swap(out);
+        return report;
+    }
+
+    CseReport eliminate_common_subexpressions(CompiledExpr &compiled_expr)
+    {
+        std::vector<Instruction> program(compiled_expr.instructions());
+        std::vector<std::string> operand_names(compiled_expr.operand_names());
+        CseReport report = eliminate_common_subexpressions(program);
+
+        if(report.temps > 0)
+            compiled_expr.assign(program, operand_names);
+        return report;
+    }
+
+    unsigned optimize(CompiledExpr &compiled_expr, bool simplify_identities)
+    {
+        if(compiled_expr.empty())
+            return 0;
+
+        std::vector<Instruction> program(compiled_expr.instructions());
+        std::vector<std::string> operand_names(compiled_expr.operand_names());
+        unsigned removed = optimize(program, simplify_identities);
+
+        compiled_expr.assign(program, operand_names);
+        return removed;
+    }
+}
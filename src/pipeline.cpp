@@ -0,0 +1,371 @@
+/**
+ * @file pipeline.cpp
+ * @brief Implementation file for the pipeline module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "pipeline.hpp"
+#include "optimizer.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace rpn
+{
+    namespace
+    {
+        const std::string EXCP_INVALID_OPERAND = " --> invalid operand!";
+        const std::string EXCP_UNKNOWN_FORMULA = " --> formula not added!";
+        const std::string EXCP_VALUES_SIZE = " --> wrong number of values!";
+        const std::string EXCP_PIPELINE_FINISHED = "The pipeline has been finished!";
+        const std::string ERROR_INVALID_EXPRESSION = "not a valid expression";
+
+        typedef std::chrono::steady_clock Clock;
+
+        std::uint64_t elapsed_ns(Clock::time_point since);
+        double seconds(const std::atomic<std::uint64_t> &ns);
+        void add(std::atomic<std::uint64_t> &counter, std::uint64_t value);  //single writer: a plain load and store, no read-modify-write
+        void notify(std::atomic<std::uint32_t> &signal);  //wakes up the thread waiting on the signal, if any
+        template<typename T> std::uint64_t push(SpscRing<T> &ring, T &&value, std::atomic<std::uint32_t> &signal, std::atomic<std::uint32_t> &consumer_signal, std::atomic<std::size_t> &max_depth);  //pushes value, waiting on signal while the ring is full, and wakes up the consumer. Returns the nanoseconds spent waiting
+
+
+        std::uint64_t elapsed_ns(Clock::time_point since)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count();
+        }
+
+        double seconds(const std::atomic<std::uint64_t> &ns)
+        {
+            return ns.load(std::memory_order_relaxed) * 1e-9;
+        }
+
+        void add(std::atomic<std::uint64_t> &counter, std::uint64_t value)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void notify(std::atomic<std::uint32_t> &signal)
+        {
+            signal.fetch_add(1, std::memory_order_release);
+            signal.notify_one();
+        }
+
+        template<typename T>
+        std::uint64_t push(SpscRing<T> &ring, T &&value, std::atomic<std::uint32_t> &signal, std::atomic<std::uint32_t> &consumer_signal, std::atomic<std::size_t> &max_depth)
+        {
+            std::uint64_t blocked = 0;
+
+            if(!ring.try_push(std::move(value))){
+                const Clock::time_point start = Clock::now();
+                for(;;){
+                    const std::uint32_t seen = signal.load(std::memory_order_acquire);
+                    if(ring.try_push(std::move(value)))
+                        break;
+                    signal.wait(seen, std::memory_order_acquire);  //the consumer bumps the signal after each pop
+                }
+                blocked = elapsed_ns(start);
+            }
+            notify(consumer_signal);
+
+            const std::size_t depth = ring.size();
+            if(depth > max_depth.load(std::memory_order_relaxed))
+                max_depth.store(depth, std::memory_order_relaxed);
+            return blocked;
+        }
+    }
+
+
+    Pipeline::Pipeline(const std::vector<std::string> &operand_names, const ResultCallback &on_result, std::size_t queue_capacity, bool optimize_formulas)
+        : on_result(on_result), optimize_formulas(optimize_formulas), start(Clock::now()),
+          formula_queue(queue_capacity), parsed_queue(queue_capacity), compiled_queue(queue_capacity), job_queue(queue_capacity)
+    {
+        for(std::vector<std::string>::const_iterator it = operand_names.cbegin(); it != operand_names.cend(); ++it){
+            if(!ctx.add_operand(*it, 0.0))
+                throw std::runtime_error(*it + EXCP_INVALID_OPERAND);
+            columns.add(*it);
+        }
+
+        threads.emplace_back(&Pipeline::parse_stage, this);
+        threads.emplace_back(&Pipeline::compile_stage, this);
+        threads.emplace_back(&Pipeline::evaluate_stage, this);
+    }
+
+    Pipeline::~Pipeline()
+    {
+        try{
+            finish();
+        }
+        catch(...){
+        }
+    }
+
+    std::size_t Pipeline::add_formula(const std::string &infix_expr)
+    {
+        if(threads.empty())
+            throw std::runtime_error(EXCP_PIPELINE_FINISHED);
+
+        FormulaMessage formula = {n_formulas, infix_expr};
+        add(submit_blocked_ns, push(formula_queue, std::move(formula), submit_signal, parse_signal, formula_max_depth));
+        return n_formulas++;
+    }
+
+    std::size_t Pipeline::submit(std::size_t formula, std::vector<double> values, std::size_t n_rows)
+    {
+        if(threads.empty())
+            throw std::runtime_error(EXCP_PIPELINE_FINISHED);
+        if(formula >= n_formulas)
+            throw std::runtime_error(std::to_string(formula) + EXCP_UNKNOWN_FORMULA);
+        if(values.size() != columns.size() * n_rows)
+            throw std::runtime_error(std::to_string(values.size()) + EXCP_VALUES_SIZE);
+
+        JobMessage job = {n_jobs, formula, n_rows, std::move(values)};
+        add(submit_blocked_ns, push(job_queue, std::move(job), submit_signal, evaluate_signal, job_max_depth));
+        return n_jobs++;
+    }
+
+    void Pipeline::wait()
+    {
+        for(;;){
+            const std::size_t done = jobs_done.load(std::memory_order_acquire);
+            if(done == n_jobs)
+                break;
+            jobs_done.wait(done, std::memory_order_acquire);
+        }
+
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            exception.swap(first_exception);
+        }
+        if(exception)
+            std::rethrow_exception(exception);
+    }
+
+    void Pipeline::finish()
+    {
+        if(threads.empty())
+            return;
+
+        stopping.store(true, std::memory_order_release);
+        notify(parse_signal);
+        for(std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+            it->join();
+        threads.clear();
+
+        wait();
+    }
+
+    const std::vector<std::string> &Pipeline::operands() const
+    {
+        return columns.names();
+    }
+
+    PipelineMetrics Pipeline::metrics() const
+    {
+        PipelineMetrics result;
+        result.seconds = elapsed_ns(start) * 1e-9;
+
+        const StageCounters *const counters[] = {&parse_counters, &compile_counters, &evaluate_counters};
+        PipelineStageMetrics *const stages[] = {&result.parse, &result.compile, &result.evaluate};
+        for(unsigned i = 0; i < 3; ++i){
+            stages[i]->processed = counters[i]->processed.load(std::memory_order_relaxed);
+            stages[i]->per_second = result.seconds > 0 ? stages[i]->processed / result.seconds : 0.0;
+            stages[i]->busy_seconds = seconds(counters[i]->busy_ns);
+            stages[i]->blocked_seconds = seconds(counters[i]->blocked_ns);
+        }
+
+        result.formula_queue = {formula_queue.size(), formula_max_depth.load(std::memory_order_relaxed), formula_queue.capacity()};
+        result.parsed_queue = {parsed_queue.size(), parsed_max_depth.load(std::memory_order_relaxed), parsed_queue.capacity()};
+        result.compiled_queue = {compiled_queue.size(), compiled_max_depth.load(std::memory_order_relaxed), compiled_queue.capacity()};
+        result.job_queue = {job_queue.size(), job_max_depth.load(std::memory_order_relaxed), job_queue.capacity()};
+        result.rows = rows_evaluated.load(std::memory_order_relaxed);
+        result.waiting_jobs = n_waiting.load(std::memory_order_relaxed);
+        result.submit_blocked_seconds = seconds(submit_blocked_ns);
+        return result;
+    }
+
+    template<typename In, typename Out>
+    void Pipeline::run_stage(SpscRing<In> &input, std::atomic<std::uint32_t> &signal, std::atomic<std::uint32_t> &producer_signal, const std::atomic<bool> &producer_done, void (Pipeline::*step)(In &, Out &) const, SpscRing<Out> &output, std::atomic<std::uint32_t> &consumer_signal, std::atomic<std::size_t> &output_max_depth, StageCounters &counters)
+    {
+        In in;
+        Out out;
+
+        for(;;){
+            const std::uint32_t seen = signal.load(std::memory_order_acquire);
+            const bool last = producer_done.load(std::memory_order_acquire);  //read before the queue, so that the queue is known to be complete when it is found empty
+            bool popped = false;
+
+            while(input.try_pop(in)){
+                notify(producer_signal);
+                popped = true;
+
+                const Clock::time_point work_start = Clock::now();
+                (this->*step)(in, out);
+                add(counters.busy_ns, elapsed_ns(work_start));
+                add(counters.blocked_ns, push(output, std::move(out), signal, consumer_signal, output_max_depth));
+                add(counters.processed, 1);
+            }
+
+            if(last)
+                break;
+            if(!popped)
+                signal.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    void Pipeline::parse_stage()
+    {
+        run_stage(formula_queue, parse_signal, submit_signal, stopping, &Pipeline::parse, parsed_queue, compile_signal, parsed_max_depth, parse_counters);
+        parse_done.store(true, std::memory_order_release);
+        notify(compile_signal);
+    }
+
+    void Pipeline::compile_stage()
+    {
+        run_stage(parsed_queue, compile_signal, parse_signal, parse_done, &Pipeline::compile, compiled_queue, evaluate_signal, compiled_max_depth, compile_counters);
+        compile_done.store(true, std::memory_order_release);
+        notify(evaluate_signal);
+    }
+
+    void Pipeline::evaluate_stage()
+    {
+        CompiledMessage compiled;
+        JobMessage job;
+
+        for(;;){
+            const std::uint32_t seen = evaluate_signal.load(std::memory_order_acquire);
+            const bool last = compile_done.load(std::memory_order_acquire);  //all the formulas have been compiled, and all the jobs submitted before
+            bool progress = false;
+
+            bool new_formulas = false;
+            while(compiled_queue.try_pop(compiled)){
+                notify(compile_signal);
+                formulas.push_back(std::move(compiled));
+                new_formulas = true;
+            }
+            if(new_formulas){
+                run_waiting_jobs();
+                progress = true;
+            }
+
+            while(waiting_jobs.size() < job_queue.capacity() && job_queue.try_pop(job)){  //the waiting jobs are bounded too, the submitter waits once they are as many as the queue holds
+                notify(submit_signal);
+                progress = true;
+
+                if(job.formula < formulas.size())
+                    evaluate(job);
+                else{
+                    waiting_jobs.push_back(std::move(job));
+                    n_waiting.store(waiting_jobs.size(), std::memory_order_relaxed);
+                }
+            }
+
+            if(last && waiting_jobs.empty() && job_queue.size() == 0)
+                break;
+            if(!progress)
+                evaluate_signal.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    void Pipeline::parse(FormulaMessage &formula, ParsedMessage &parsed) const
+    {
+        SymbolTable symbols;
+
+        parsed.id = formula.id;
+        parsed.program.clear();
+        parsed.names.clear();
+        parsed.error.clear();
+
+        try{
+            if(!infix_to_rpn(ctx, formula.infix_expr, parsed.program, symbols))
+                parsed.error = ERROR_INVALID_EXPRESSION;
+        }
+        catch(const std::runtime_error &e){
+            parsed.error = e.what();
+        }
+        parsed.names = symbols.names();
+    }
+
+    void Pipeline::compile(ParsedMessage &parsed, CompiledMessage &compiled) const
+    {
+        compiled.id = parsed.id;
+        compiled.compiled_expr.clear();
+        compiled.columns.clear();
+        compiled.error = std::move(parsed.error);
+        if(!compiled.error.empty())
+            return;
+
+        if(!compiled.compiled_expr.assign(parsed.program, parsed.names)){
+            compiled.error = ERROR_INVALID_EXPRESSION;
+            return;
+        }
+        if(optimize_formulas){
+            optimize(compiled.compiled_expr);
+            eliminate_common_subexpressions(compiled.compiled_expr);
+        }
+
+        const std::vector<std::string> &names = compiled.compiled_expr.operand_names();
+        for(std::vector<std::string>::const_iterator it = names.cbegin(); it != names.cend(); ++it)
+            compiled.columns.push_back(columns.find(*it));  //always found, the context has no other operands
+    }
+
+    void Pipeline::evaluate(const JobMessage &job)
+    {
+        const Clock::time_point work_start = Clock::now();
+        const CompiledMessage &formula = formulas[job.formula];
+
+        if(results.size() < job.n_rows)
+            results.resize(job.n_rows);
+        if(defined_size < job.n_rows){
+            defined.reset(new bool[job.n_rows]);
+            defined_size = job.n_rows;
+        }
+
+        if(formula.error.empty()){
+            operand_columns.clear();
+            for(std::vector<unsigned>::const_iterator it = formula.columns.cbegin(); it != formula.columns.cend(); ++it)
+                operand_columns.push_back(job.values.data() + *it * job.n_rows);
+            formula.compiled_expr.evaluate_batch(operand_columns.data(), job.n_rows, results.data(), defined.get());
+        }
+        else{
+            std::fill(results.begin(), results.begin() + job.n_rows, 0.0);
+            std::fill(defined.get(), defined.get() + job.n_rows, false);
+        }
+
+        const PipelineResult result = {job.id, job.formula, job.n_rows, results.data(), defined.get(), formula.error};
+        try{
+            on_result(result);
+        }
+        catch(...){
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            if(!first_exception)
+                first_exception = std::current_exception();
+        }
+
+        add(evaluate_counters.busy_ns, elapsed_ns(work_start));
+        add(evaluate_counters.processed, 1);
+        add(rows_evaluated, job.n_rows);
+        jobs_done.store(jobs_done.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        jobs_done.notify_all();
+    }
+
+    std::size_t Pipeline::run_waiting_jobs()
+    {
+        std::size_t n_run = 0;
+
+        for(std::deque<JobMessage>::iterator it = waiting_jobs.begin(); it != waiting_jobs.end();){
+            if(it->formula < formulas.size()){
+                const JobMessage job = std::move(*it);
+                it = waiting_jobs.erase(it);
+                n_waiting.store(waiting_jobs.size(), std::memory_order_relaxed);
+                evaluate(job);
+                ++n_run;
+            }
+            else
+                ++it;
+        }
+        return n_run;
+    }
+}
@@ -0,0 +1,364 @@
+/**
+ * @file profile.cpp
+ * @brief Implementation file for the profiling module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "profile.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace rpn
+{
+    namespace profile
+    {
+        namespace
+        {
+            const unsigned N_PHASES = static_cast<unsigned>(Phase::N_PHASES);
+            const unsigned N_CAUSES = static_cast<unsigned>(Cause::N_CAUSES);
+
+            const char *const PHASE_NAMES[N_PHASES] = {"conversion", "lexing", "literals", "validation", "compilation", "evaluation"};
+            const char *const OPCODE_NAMES[N_OPCODES] = {"push_value", "push_operand", "add", "sub", "mul", "div", "func_operator", "store_temp", "load_temp", "store_result"};
+            const char *const CAUSE_NAMES[N_CAUSES] = {"division_by_zero", "fe_invalid", "fe_divbyzero", "fe_overflow", "fe_underflow"};
+
+            struct AtomicCounter  //written only by the thread that owns it, read by snapshot
+            {
+                std::atomic<std::uint64_t> count{0};
+                std::atomic<std::uint64_t> cycles{0};
+            };
+
+            struct alignas(64) ThreadCounters  //counters of a single thread, on cache lines of their own
+            {
+                AtomicCounter phases[N_PHASES];
+                AtomicCounter opcodes[N_OPCODES];
+                AtomicCounter operators[MAX_OPERATORS];
+                std::atomic<std::uint64_t> undefined[N_CAUSES] = {};
+                std::atomic<std::uint64_t> allocations{0};
+                std::atomic<std::uint64_t> allocated_bytes{0};
+                AtomicCounter rechecks;
+                unsigned active_phases = 0;  //bit i set while phase i is being timed, only used by the owner
+                bool rechecking = false;  //true between enter_recheck and leave_recheck, only used by the owner
+            };
+
+            class Registry  //counters of the running threads, and the totals of the threads that have ended
+            {
+            public:
+                void attach(ThreadCounters *counters);
+                void detach(ThreadCounters *counters);  //adds the counters to the totals of the ended threads
+                Snapshot totals();  //sum of all the counters
+                void reset();
+
+            private:
+                Snapshot sum() const;  //counters of all the threads, to be called with the mutex locked
+
+                std::mutex mutex;
+                std::vector<ThreadCounters *> running;
+                Snapshot ended = {};
+                Snapshot baseline = {};  //totals at the last reset
+            };
+
+            class LocalCounters  //counters of the calling thread, attached to the registry for the life of the thread
+            {
+            public:
+                LocalCounters();
+                ~LocalCounters();
+                ThreadCounters counters;
+            };
+
+            class CountingResource : public std::pmr::memory_resource
+            {
+            private:
+                void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+                void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+                bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+            };
+
+            Registry &registry();  //never destroyed, the threads can end after the static objects
+            ThreadCounters &local();  //counters of the calling thread
+            void add(std::atomic<std::uint64_t> &counter, std::uint64_t value);  //single writer: a plain load and store, no read-modify-write
+            void add_counter(Counter &total, const AtomicCounter &counter);
+            void add_counters(Snapshot &snap, const ThreadCounters &counters);
+            void subtract(Snapshot &snap, const Snapshot &base);
+            void append_counter(std::string &json, const char *name, const Counter &counter, bool first);
+
+
+            void Registry::attach(ThreadCounters *counters)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running.push_back(counters);
+            }
+
+            void Registry::detach(ThreadCounters *counters)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                add_counters(ended, *counters);
+                for(std::vector<ThreadCounters *>::iterator it = running.begin(); it != running.end(); ++it){
+                    if(*it == counters){
+                        running.erase(it);
+                        break;
+                    }
+                }
+            }
+
+            Snapshot Registry::totals()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Snapshot snap = sum();
+                subtract(snap, baseline);
+                return snap;
+            }
+
+            void Registry::reset()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                baseline = sum();
+            }
+
+            Snapshot Registry::sum() const
+            {
+                Snapshot snap = ended;
+                for(std::vector<ThreadCounters *>::const_iterator it = running.cbegin(); it != running.cend(); ++it)
+                    add_counters(snap, **it);
+                return snap;
+            }
+
+            LocalCounters::LocalCounters()
+            {
+                registry().attach(&counters);
+            }
+
+            LocalCounters::~LocalCounters()
+            {
+                registry().detach(&counters);
+            }
+
+            void *CountingResource::do_allocate(std::size_t bytes, std::size_t alignment)
+            {
+                ThreadCounters &counters = local();
+                add(counters.allocations, 1);
+                add(counters.allocated_bytes, bytes);
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+
+            void CountingResource::do_deallocate(void *p, std::size_t bytes, std::size_t alignment)
+            {
+                std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+            }
+
+            bool CountingResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+            {
+                return this == &other;
+            }
+
+            Registry &registry()
+            {
+                static Registry *instance = new Registry();
+                return *instance;
+            }
+
+            ThreadCounters &local()
+            {
+                thread_local LocalCounters instance;
+                return instance.counters;
+            }
+
+            void add(std::atomic<std::uint64_t> &counter, std::uint64_t value)
+            {
+                counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+
+            void add_counter(Counter &total, const AtomicCounter &counter)
+            {
+                total.count += counter.count.load(std::memory_order_relaxed);
+                total.cycles += counter.cycles.load(std::memory_order_relaxed);
+            }
+
+            void add_counters(Snapshot &snap, const ThreadCounters &counters)
+            {
+                for(unsigned i = 0; i < N_PHASES; ++i)
+                    add_counter(snap.phases[i], counters.phases[i]);
+                for(unsigned i = 0; i < N_OPCODES; ++i)
+                    add_counter(snap.opcodes[i], counters.opcodes[i]);
+                for(unsigned i = 0; i < MAX_OPERATORS; ++i)
+                    add_counter(snap.operators[i], counters.operators[i]);
+                for(unsigned i = 0; i < N_CAUSES; ++i)
+                    snap.undefined[i] += counters.undefined[i].load(std::memory_order_relaxed);
+                snap.allocations += counters.allocations.load(std::memory_order_relaxed);
+                snap.allocated_bytes += counters.allocated_bytes.load(std::memory_order_relaxed);
+                add_counter(snap.rechecks, counters.rechecks);
+            }
+
+            void subtract(Snapshot &snap, const Snapshot &base)
+            {
+                for(unsigned i = 0; i < N_PHASES; ++i){
+                    snap.phases[i].count -= base.phases[i].count;
+                    snap.phases[i].cycles -= base.phases[i].cycles;
+                }
+                for(unsigned i = 0; i < N_OPCODES; ++i){
+                    snap.opcodes[i].count -= base.opcodes[i].count;
+                    snap.opcodes[i].cycles -= base.opcodes[i].cycles;
+                }
+                for(unsigned i = 0; i < MAX_OPERATORS; ++i){
+                    snap.operators[i].count -= base.operators[i].count;
+                    snap.operators[i].cycles -= base.operators[i].cycles;
+                }
+                for(unsigned i = 0; i < N_CAUSES; ++i)
+                    snap.undefined[i] -= base.undefined[i];
+                snap.allocations -= base.allocations;
+                snap.allocated_bytes -= base.allocated_bytes;
+                snap.rechecks.count -= base.rechecks.count;
+                snap.rechecks.cycles -= base.rechecks.cycles;
+            }
+
+            void append_counter(std::string &json, const char *name, const Counter &counter, bool first)
+            {
+                if(!first)
+                    json += ",";
+                json += "\"";
+                json += name;
+                json += "\":{\"count\":" + std::to_string(counter.count) + ",\"cycles\":" + std::to_string(counter.cycles) + "}";
+            }
+        }
+
+
+        bool enabled()
+        {
+#ifdef RPN_UTILS_PROFILE
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        Snapshot snapshot()
+        {
+            return registry().totals();
+        }
+
+        std::string to_json(const Snapshot &snap)
+        {
+            std::string json = "{\"enabled\":";
+            json += enabled() ? "true" : "false";
+#if defined(__x86_64__) || defined(__i386__)
+            json += ",\"clock\":\"tsc\"";
+#else
+            json += ",\"clock\":\"ns\"";
+#endif
+
+            json += ",\"phases\":{";
+            for(unsigned i = 0; i < N_PHASES; ++i)
+                append_counter(json, PHASE_NAMES[i], snap.phases[i], i == 0);
+
+            json += "},\"opcodes\":{";
+            for(unsigned i = 0; i < N_OPCODES; ++i)
+                append_counter(json, OPCODE_NAMES[i], snap.opcodes[i], i == 0);
+
+            json += "},\"operators\":{";
+            bool first = true;
+            for(unsigned id = 0; id < operator_count(); ++id){
+                if(snap.operators[id].count == 0)
+                    continue;
+                append_counter(json, operator_name(id).c_str(), snap.operators[id], first);
+                first = false;
+            }
+
+            json += "},\"undefined\":{";
+            for(unsigned i = 0; i < N_CAUSES; ++i){
+                if(i > 0)
+                    json += ",";
+                json += "\"";
+                json += CAUSE_NAMES[i];
+                json += "\":" + std::to_string(snap.undefined[i]);
+            }
+
+            json += "}";
+            append_counter(json, "rechecks", snap.rechecks, false);
+            json += ",\"allocations\":{\"count\":" + std::to_string(snap.allocations) + ",\"bytes\":" + std::to_string(snap.allocated_bytes) + "}}";
+            return json;
+        }
+
+        void reset()
+        {
+            registry().reset();
+        }
+
+        bool enter_phase(Phase phase)
+        {
+            ThreadCounters &counters = local();
+            const unsigned bit = 1u << static_cast<unsigned>(phase);
+            if(counters.active_phases & bit)
+                return false;
+
+            counters.active_phases |= bit;
+            return true;
+        }
+
+        void leave_phase(Phase phase, std::uint64_t cycles)
+        {
+            ThreadCounters &counters = local();
+            AtomicCounter &counter = counters.phases[static_cast<unsigned>(phase)];
+            counters.active_phases &= ~(1u << static_cast<unsigned>(phase));
+            add(counter.count, 1);
+            add(counter.cycles, cycles);
+        }
+
+        void record_instruction(OpCode opcode, unsigned op, std::uint64_t count, std::uint64_t cycles)
+        {
+            ThreadCounters &counters = local();
+            if(counters.rechecking)
+                return;
+
+            AtomicCounter &counter = counters.opcodes[static_cast<unsigned>(opcode)];
+            add(counter.count, count);
+            add(counter.cycles, cycles);
+
+            if(opcode == OpCode::FUNC_OPERATOR && op < MAX_OPERATORS){
+                add(counters.operators[op].count, count);
+                add(counters.operators[op].cycles, cycles);
+            }
+        }
+
+        void record_undefined(Cause cause)  //only DIVISION_BY_ZERO, the flags raised by the operators are recorded by record_undefined_flags
+        {
+            ThreadCounters &counters = local();
+            if(!counters.rechecking)  //the first pass found the same divisions by zero
+                add(counters.undefined[static_cast<unsigned>(cause)], 1);
+        }
+
+        void record_undefined_flags()
+        {
+            ThreadCounters &counters = local();
+            if(std::fetestexcept(FE_INVALID))
+                add(counters.undefined[static_cast<unsigned>(Cause::FE_INVALID_RAISED)], 1);
+            if(std::fetestexcept(FE_DIVBYZERO))
+                add(counters.undefined[static_cast<unsigned>(Cause::FE_DIVBYZERO_RAISED)], 1);
+            if(std::fetestexcept(FE_OVERFLOW))
+                add(counters.undefined[static_cast<unsigned>(Cause::FE_OVERFLOW_RAISED)], 1);
+            if(std::fetestexcept(FE_UNDERFLOW))
+                add(counters.undefined[static_cast<unsigned>(Cause::FE_UNDERFLOW_RAISED)], 1);
+        }
+
+        void enter_recheck()
+        {
+            local().rechecking = true;
+        }
+
+        void leave_recheck(std::uint64_t cycles)
+        {
+            ThreadCounters &counters = local();
+            counters.rechecking = false;
+            add(counters.rechecks.count, 1);
+            add(counters.rechecks.cycles, cycles);
+        }
+
+        std::pmr::memory_resource *counting_resource()
+        {
+            static CountingResource *instance = new CountingResource();
+            return instance;
+        }
+    }
+}
@@ -8,369 +8,476 @@
 
 
 #include "rpn_utils.hpp"
+#include "profile.hpp"
+#include <string_view>
+#include <charconv>
+#include <atomic>
 
 namespace rpn
 {
     namespace
     {
-        //Additional Operands object
-        std::unordered_map<std::string, double> additional_operands;
+        std::atomic<unsigned long> context_versions(0);  //source of the version stamps of all the contexts
+        std::atomic<unsigned long> compiled_stamps(0);  //source of the stamps of the programs assigned to compiled expressions
 
-        //index constants to access the tuple of additional_operators
-        const unsigned short IDX_N_OPERANDS = 0;
-        const unsigned short IDX_PRECEDENCE_VAL = 1;
-        const unsigned short IDX_FUNC_PTR = 2;
+        //Context used by the functions that do not take one
+        Context global_context;
 
         const unsigned short PRECEDENCE_VAL_OTHER = 0;
         const unsigned short PRECEDENCE_VAL_SUM = PRECEDENCE_VAL_OTHER + 1;
         const unsigned short PRECEDENCE_VAL_MULTIPLICATION = PRECEDENCE_VAL_SUM + 1;
         const unsigned short PRECEDENCE_VAL_FUNC_OPERATOR = PRECEDENCE_VAL_MULTIPLICATION + 1;
 
+        const std::size_t LOCAL_STACK_SIZE = 64;  //expressions whose stack never holds more values than this are evaluated on a buffer on the call stack
+        const std::size_t LOCAL_OPERANDS = 64;  //as above, for the operand values gathered by CompiledExpr::evaluate(const Context &)
+        const std::size_t BINDING_CACHE_SIZE = 16;  //bindings kept by each thread, one per compiled expression (by stamp)
+
         //Exceptions
         const std::string EXCP_GENERAL_ERROR = "Something went wrong!";
         const std::string EXCP_INVALID_OPERAND = " --> invalid operand!";
-        const std::string EXCP_MISSING_FUNCTION_ARGUMENT = " --> function argument not found!";
         const std::string EXCP_UNKNOWN_COMPONENT = " --> unknown operand/operator!";
 
         enum class ObjType{NO_TYPE = 0, OPERAND, OPERATOR, OPEN_PARENTHESIS, CLOSE_PARENTHESIS};
 
 
-        bool check_parenthesis(const std::string &infix_expr);  //check that each parenthesis has the corresponding one
-        void adj_expr(std::string &infix_expr);  //removes unnecessary space and tab characters from an expression
-        ObjType getOp(std::string &infix_expr, std::string &obj_value, std::string::size_type &index);  //gets the next operand/operator and updates the index to the next character
-        unsigned short precedence(const std::string &obj_value);  //gets the operator precedence value.
-        bool isAdditionalOperand(const std::string &obj_val); //returns true if the string is an additional operand
-        bool isOperand(const std::string &obj_value);  //returns true if the string is an operand
+        struct Token  //operand, operator or parenthesis read from an infix expression
+        {
+            ObjType type;
+            std::string_view text;  //characters of the token (for the tokens added by the Lexer, a constant string)
+            bool negative;  //true for a numeric operand preceded by a unary minus
+            unsigned short precedence;  //precedence value of an operator (PRECEDENCE_VAL_OTHER for parentheses)
+            unsigned short n_operands;  //number of operands taken by a function operator
+            unsigned op;  //id of a function operator
+            double value;  //value of a numeric operand, already negative if negative is true
+        };
+
+        struct OperandBinding  //addresses of the values of the operands used by a compiled expression in a context
+        {
+            unsigned long expr_stamp = 0;  //stamp of the compiled expression, 0 for a free entry
+            unsigned long ctx_version = 0;  //version of the context: the addresses stay valid as long as its set of names does not change
+            bool complete = false;  //false if the context lacks one of the operands
+            std::vector<const double *> values;  //one for each used slot, in the order of CompiledExpr::used_slots
+        };
+
+        thread_local OperandBinding operand_bindings[BINDING_CACHE_SIZE];
+
+        class Lexer  //splits an infix expression into tokens in a single forward pass. Unary signs are resolved here, a negative block "- something" is returned as the tokens of "(0 - something)"
+        {
+        public:
+            Lexer(const Context &ctx, std::string_view infix_expr, std::pmr::memory_resource *mem);  //the queues of the lexer are allocated from mem
+            bool next(Token &token);  //gets the next token, returns false at the end of the expression or if the expression is not valid
+            bool failed() const;  //returns true if the lexer stopped because the expression is not valid
+
+        private:
+            struct NegativeBlock  //"(0 - " emitted, waiting for the end of the block to emit ")"
+            {
+                unsigned remaining;  //operands (or blocks in parentheses) still to be read
+                std::size_t depth;  //parenthesis depth at which the operands are counted
+            };
+
+            bool read(std::string_view::size_type &pos, Token &token) const;  //reads the token starting at pos and moves pos after it, returns false at the end of the expression
+            void emit(const Token &token, bool real);  //appends a token to the ready queue, real is false for the tokens added by the lexer
+            void operand_read(std::size_t at_depth);  //called when an operand (or a block in parentheses) ends at the passed depth, closes the negative blocks it completes
+            bool fail();
+
+            const Context &ctx;
+            std::string_view expr;
+            std::string_view::size_type pos = 0;
+            ObjType prev_type = ObjType::NO_TYPE;  //type of the last token returned
+            std::size_t depth = 0;  //number of open parentheses
+            std::pmr::vector<NegativeBlock> negatives;
+            std::pmr::vector<Token> ready;  //tokens produced but not yet returned
+            std::pmr::vector<Token>::size_type ready_pos = 0;
+            bool error = false;
+        };
+
+        bool isAdditionalOperand(const Context &ctx, const std::string &obj_val); //returns true if the string is an additional operand
+        bool isOperand(const Context &ctx, const std::string &obj_value);  //returns true if the string is an operand
         bool isSign(char);  //returns true if the character is a sign
-        bool fetch_val(const std::string &infix_expr, std::string &obj_value, std::string::size_type &index); //fetchs the next value (operand, operator, sign, ...) from the infix expression
-        ObjType getType(const std::string &obj_value); //Returns the type (operand, operator, ...) of the passed value
-        void enclose_negative(std::string &infix_expr, std::string::size_type index, const std::string &next_value);  //modifies the expression to handle negative blocks
-        void skipParenthesis(const std::string &infix_expr, std::string::size_type &index);  //given an index pointing to an open parenthesis, skips all characters until it finds a closed parenthesis
-        bool isFuncOperator(const std::string &obj_value);  //returns true if the string is a function operator (ie additional operator)
+        bool isLiteral(const Token &token);  //returns true if the token is a numeric operand
+        bool parse_literal(std::string_view text, double &value);  //parses a numeric literal (optional sign, digits with at most one dot, optional exponent such as e-9), returns false if the text is not a valid number
+        bool isTokenContinuation(std::string_view prev, char next);  //returns true if the lexer could read the end of prev and next as part of the same token when they are not separated
+        template<typename Rpn> void append_token(Rpn &rpn_expr, const Token &token);  //appends the string representing the token to an rpn expression
+        Instruction token_instruction(const Token &token, SymbolTable &symbols);  //returns the instruction that executes the token in a compiled program, adding the additional operands to the symbol table
+        template<typename Output> bool shunting_yard(const Context &ctx, std::string_view infix_expr, std::pmr::memory_resource *mem, Output output);  //converts the infix expression to rpn, passing the tokens of the rpn expression to output in order, with the scratch memory allocated from mem. Returns false if the parentheses do not match
+        bool isFuncOperator(const std::string &obj_value, unsigned &id);  //returns true if the string is a function operator (ie additional operator), storing its id in id
         bool isBasicOperator(const std::string &obj_value);  //returns true if the string is an operator (+, -, *, /)
-        unsigned short get_precedence_func_operator(const std::string &func_operator);  //returns the precedence value of the function operator
-        unsigned short get_operands_func_operator(const std::string &func_operator);  //returns the number of operands requested by the operator
-        bool checkRpn(const std::vector<std::string> &rpn_expr);  //checks if the rpn expression is valid
-        double get_value_additionalOperand(const std::string &obj_val);  //returns the value (double) associated with an additional operand.
-        std::pair<bool, double> eval_func_operator(const std::string &obj_val, const double *operands);  //Evaluates a function operator and returns a <bool, double> pair, where the bool value is true if the operator is defined for the passed operands and the double value is the result of the evaluation.
-
+        unsigned short get_operands_func_operator(unsigned id);  //returns the number of operands requested by the operator
+        bool checkRpn(const Context &ctx, const std::vector<std::string> &rpn_expr);  //checks if the rpn expression is valid
+        bool checkRpn(const Context &ctx, const std::vector<std::string> &rpn_expr, const SymbolTable &symbols);  //checks if the rpn expression is valid, also accepting the operands in the symbol table
+        template<typename Rpn> bool check_rpn_expr(const Context &ctx, const Rpn &rpn_expr, const SymbolTable &symbols, std::size_t &max_depth);  //checkRpn on any container of strings, also computing the maximum number of values on the stack during the evaluation
+        template<typename Rpn> std::pair<bool, double> evaluate_rpn(const Context &ctx, const Rpn &rpn_expr, std::pmr::memory_resource *mem);  //rpn::evaluate on any container of strings, with the stack allocated from mem
+        const std::string &name_key(const std::string &name);  //returns the string used to look up a name of an rpn expression in the tables of operands and operators
+        std::string name_key(const std::pmr::string &name);
+        double get_value_additionalOperand(const Context &ctx, const std::string &obj_val);  //returns the value (double) associated with an additional operand.
+        std::pair<bool, double> eval_func_operator(unsigned id, const double *operands);  //Evaluates a function operator and returns a <bool, double> pair, where the bool value is true if the operator is defined for the passed operands and the double value is the result of the evaluation.
+        bool program_depth(const std::vector<Instruction> &program, unsigned n_operands, unsigned &max_depth, unsigned &n_temps);  //checks a compiled program the same way checkRpn does (a LOAD_TEMP must follow a STORE_TEMP to the same slot) and computes its maximum stack depth and number of temporary slots
+
+
+        bool isAdditionalOperand(const Context &ctx, const std::string &obj_val)
+        {
+            return ctx.has_operand(obj_val);
+        }
 
-        bool check_parenthesis(const std::string &expr)
+        bool isOperand(const Context &ctx, const std::string &obj_val)
         {
-            long open_brackets = 0;
+            if(obj_val.empty())
+                return false;
+            
+            if(isAdditionalOperand(ctx, obj_val))
+                return true;
 
-            for(std::string::const_iterator it = expr.cbegin(); it != expr.cend(); ++it){
-                if(*it == '(')
-                    ++open_brackets;
-                else if(*it == ')'){
-                    if(!open_brackets)
-                        return false;
-                    --open_brackets;
-                }
-            }
+            double value;
+            return parse_literal(obj_val, value);
+        }
 
-            return open_brackets == 0;
+        bool isSign(char c)
+        {
+            return (c == '+' || c == '-') ? true : false;
         }
 
-        void adj_expr(std::string &expr)
+        Lexer::Lexer(const Context &context, std::string_view infix_expr, std::pmr::memory_resource *mem) : ctx(context), expr(infix_expr), negatives(mem), ready(mem)
         {
-            if(expr.empty())
-                return;
+        }
 
-            std::string::size_type i;
+        bool Lexer::next(Token &token)
+        {
+            static const Token ZERO = {ObjType::OPERAND, "0", false, 0, 0, OPERATOR_NPOS, 0.0};
+            static const Token MINUS = {ObjType::OPERATOR, "-", false, PRECEDENCE_VAL_SUM, 0, OPERATOR_NPOS, 0.0};
+            static const Token OPEN = {ObjType::OPEN_PARENTHESIS, "(", false, PRECEDENCE_VAL_OTHER, 0, OPERATOR_NPOS, 0.0};
+
+            while(ready_pos == ready.size() && !error){
+                ready.clear();
+                ready_pos = 0;
+
+                Token curr;
+                if(!read(pos, curr)){  //end of the expression, closes the negative blocks still open
+                    while(!negatives.empty()){
+                        negatives.pop_back();
+                        emit({ObjType::CLOSE_PARENTHESIS, ")", false, PRECEDENCE_VAL_OTHER, 0, OPERATOR_NPOS, 0.0}, false);
+                    }
+                    if(ready.empty())
+                        return false;
+                    break;
+                }
 
-            bool need_space = false;
-            for(i = 0; i < expr.size();){
-                
-                switch(expr[i]){
-                    case '\t':
-                        expr[i] = ' ';
+                if(curr.type == ObjType::OPERATOR && isSign(curr.text.front())){
+                    /*
+                    Synthesizes sign sequences such as "-+---+" into a single sign. If the previous token is an operator
+                    (or there is none) the sign is unary: a plus is ignored, a minus makes the following number negative,
+                    or encloses the following operand/block/function in "(0 - ...)"
+                    */
+                    bool minus = curr.text.front() == '-';
+                    Token following;
+
+                    for(; pos < expr.size() && (isSign(expr[pos]) || expr[pos] == ' ' || expr[pos] == '\t'); ++pos)
+                        if(expr[pos] == '-')
+                            minus = !minus;
+
+                    if(prev_type == ObjType::OPERAND || prev_type == ObjType::CLOSE_PARENTHESIS){  //binary operator
+                        emit(minus ? MINUS : Token({ObjType::OPERATOR, "+", false, PRECEDENCE_VAL_SUM, 0, OPERATOR_NPOS, 0.0}), true);
                         break;
+                    }
 
-                    case '{': case '[':
-                        expr[i] = '(';
-                        break;
-                        
-                    case '}': case ']':
-                        expr[i] = ')';
-                        break;
-                }
+                    if(!minus)  //unary plus
+                        continue;
+
+                    if(!read(pos, following))
+                        return fail();
 
-                if(expr[i] == ' '){
-                    if(!need_space)
-                        expr.erase(i, 1);
-                    else{
-                        need_space = false;
-                        ++i;
+                    if(following.type == ObjType::OPERAND && isLiteral(following)){  //negative number
+                        following.negative = true;
+                        following.value = -following.value;
+                        emit(following, true);
                     }
+                    else if(following.type == ObjType::OPERAND || following.type == ObjType::OPEN_PARENTHESIS){  //operand or block in parentheses
+                        negatives.push_back({1, depth});
+                        emit(OPEN, false);
+                        emit(ZERO, false);
+                        emit(MINUS, false);
+                        emit(following, true);
+                    }
+                    else if(following.type == ObjType::OPERATOR && following.n_operands > 0){  //function operator, the block ends after its operands
+                        negatives.push_back({following.n_operands, depth});
+                        emit(OPEN, false);
+                        emit(ZERO, false);
+                        emit(MINUS, false);
+                        emit(following, true);
+                    }
+                    else
+                        return fail();
                 }
-                else{
-                    std::string::size_type j;
-                    for(j = i + 1; j < expr.size() && expr[j] == ' '; ++j)
-                        ;
-                    std::string::size_type space_between = (j - i) - 1;
-                    if(space_between > 0 && ((islower(expr[i]) && islower(expr[j])) || (isdigit(expr[i]) && (isdigit(expr[j]) || expr[j] == '.'))))
-                        need_space = true;
-                    std::string::size_type space_to_remove = space_between - ((need_space) ? 1 : 0);
-                    if(space_to_remove > 0)
-                        expr.erase(i + 1, space_to_remove);
-                    ++i;
-                }
+                else
+                    emit(curr, true);
             }
+
+            if(error)
+                return false;
+
+            token = ready[ready_pos++];
+            prev_type = token.type;
+            return true;
         }
-        
-        ObjType getOp(std::string &expr, std::string &obj_val, std::string::size_type &index)
+
+        bool Lexer::failed() const
         {
-            static std::string actual_val("");  //to keep the current value for the next call
-            obj_val.clear();
+            return error;
+        }
 
-            const std::string prev_val(actual_val); //prev_val 
-            
-            bool res = fetch_val(expr, obj_val, index);  //fetchs the actual_value
-            actual_val = obj_val;
-
-            if(!res)
-                return ObjType::NO_TYPE;
-
-            if(isOperand(obj_val))
-                return ObjType::OPERAND;
-            else if(isSign(obj_val.front())){
-                /*
-                If it is a sign we must check if the previous value is an operator,
-                in this case if the sign is positive we can ignore it, otherwise we
-                must modify the expression in order to transform the:
-                - something
-                in
-                (0 - something)
-                */
-
-                std::string next_val;
-                std::string::size_type next_index = index;
-
-                if(!fetch_val(expr, next_val, next_index))
-                    return ObjType::NO_TYPE; //there is an error in the infix expression
-
-                ObjType prev_val_type = getType(prev_val);
-
-                if(isSign(next_val.front())){  //synthesizes subexpressions such as "-+---+"
-                    char curr_sign = obj_val.front();
-
-                    do{
-                        char next_sign = next_val.front();
-                        expr.erase(index - 1, 2);
-                        if(curr_sign == next_sign)
-                            expr.insert(index - 1, "+");
-                        else
-                            expr.insert(index - 1, "-");
-
-                        next_index -= 1;
-                        curr_sign = expr[index - 1];
-
-                    }while(fetch_val(expr, next_val, next_index) && isSign(next_val.front()));
-                    obj_val = curr_sign;
-                }
+        bool Lexer::read(std::string_view::size_type &index, Token &token) const
+        {
+            RPN_PROFILE_PHASE(LEXING);
+            while(index < expr.size() && (expr[index] == ' ' || expr[index] == '\t'))
+                ++index;
 
-                if(prev_val_type == ObjType::OPERATOR || prev_val_type == ObjType::OPEN_PARENTHESIS || prev_val_type == ObjType::NO_TYPE){
-                    if(obj_val.front() == '+')
-                        obj_val = next_val;
-                    else{
-                        if(isOperand(next_val))
-                            obj_val.append(next_val);
-                        else{
-                            actual_val = "(";
-                            enclose_negative(expr, index - 1, next_val);
-                            return ObjType::OPEN_PARENTHESIS;
-                        }
-                    }
-                    actual_val = obj_val;
-                    index = next_index;
+            if(index >= expr.size())
+                return false;
+
+            std::string_view::size_type begin = index;
+            token = {ObjType::NO_TYPE, std::string_view(), false, PRECEDENCE_VAL_OTHER, 0, OPERATOR_NPOS, 0.0};
+
+            if(islower(expr[index])){
+                while(index < expr.size() && islower(expr[index]))
+                    ++index;
+                token.text = expr.substr(begin, index - begin);
+            }
+            else if(isdigit(expr[index]) || expr[index] == '.'){
+                while(index < expr.size() && (isdigit(expr[index]) || expr[index] == '.'))
+                    ++index;
+
+                if(index < expr.size() && (expr[index] == 'e' || expr[index] == 'E')){  //exponent, only if digits follow
+                    std::string_view::size_type exp = index + 1;
+                    if(exp < expr.size() && isSign(expr[exp]))
+                        ++exp;
+                    if(exp < expr.size() && isdigit(expr[exp]))
+                        for(index = exp; index < expr.size() && isdigit(expr[index]); ++index)
+                            ;
                 }
-                return getType(obj_val);
+
+                token.text = expr.substr(begin, index - begin);
+                if(!parse_literal(token.text, token.value))
+                    throw std::runtime_error(std::string(token.text) + EXCP_INVALID_OPERAND);
+                token.type = ObjType::OPERAND;
+                return true;
             }
-            else if(isBasicOperator(obj_val) || isFuncOperator(obj_val))
-                return ObjType::OPERATOR;
-            
-            switch(obj_val.front()){
-                case '(':
-                    return ObjType::OPEN_PARENTHESIS;
-                    break;
-                case ')':
-                    return ObjType::CLOSE_PARENTHESIS;
-                    break;
-                default:
-                    throw std::runtime_error(obj_val + EXCP_UNKNOWN_COMPONENT);
+            else
+                token.text = expr.substr(index++, 1);
+
+            switch(token.text.front()){
+                case '(': case '[': case '{':
+                    token.type = ObjType::OPEN_PARENTHESIS;
+                    return true;
+                case ')': case ']': case '}':
+                    token.type = ObjType::CLOSE_PARENTHESIS;
+                    return true;
+            }
+
+            std::string name(token.text);
+
+            if(isOperand(ctx, name))
+                token.type = ObjType::OPERAND;
+            else if(isBasicOperator(name)){
+                token.type = ObjType::OPERATOR;
+                token.precedence = (isSign(name.front())) ? PRECEDENCE_VAL_SUM : PRECEDENCE_VAL_MULTIPLICATION;
+            }
+            else{
+                unsigned id = find_operator(name);
+                if(id == OPERATOR_NPOS)
+                    throw std::runtime_error(name + EXCP_UNKNOWN_COMPONENT);
+
+                token.type = ObjType::OPERATOR;
+                token.precedence = PRECEDENCE_VAL_FUNC_OPERATOR + operator_table[id].precedence;
+                token.n_operands = operator_table[id].n_operands;
+                token.op = id;
             }
+
+            return true;
         }
 
-        unsigned short precedence(const std::string &obj_val)
+        void Lexer::emit(const Token &token, bool real)
         {
+            ready.push_back(token);
 
-            const unsigned short DEFAULT_PRECEDENDE_FUNC_OPERATOR = 3;
-            if(isFuncOperator(obj_val))
-                return PRECEDENCE_VAL_FUNC_OPERATOR + get_precedence_func_operator(obj_val);
-            
-            switch(obj_val.front()){
-                case '+': case '-':
-                    return PRECEDENCE_VAL_SUM;
+            if(!real)
+                return;
+
+            switch(token.type){
+                case ObjType::OPERAND:
+                    operand_read(depth);
                     break;
-                case '*': case '/':
-                    return PRECEDENCE_VAL_MULTIPLICATION;
+                case ObjType::OPEN_PARENTHESIS:
+                    ++depth;
+                    break;
+                case ObjType::CLOSE_PARENTHESIS:
+                    if(depth > 0)  //unbalanced parentheses are reported by infix_to_rpn
+                        operand_read(--depth);
                     break;
                 default:
-                    return PRECEDENCE_VAL_OTHER;
                     break;
             }
         }
 
-        bool isAdditionalOperand(const std::string &obj_val)
+        void Lexer::operand_read(std::size_t at_depth)
         {
-            return additional_operands.find(obj_val) != additional_operands.cend();
+            for(std::pmr::vector<NegativeBlock>::iterator it = negatives.begin(); it != negatives.end(); ++it)
+                if(it->depth == at_depth && it->remaining > 0)
+                    --it->remaining;
+
+            while(!negatives.empty() && negatives.back().remaining == 0){
+                negatives.pop_back();
+                ready.push_back({ObjType::CLOSE_PARENTHESIS, ")", false, PRECEDENCE_VAL_OTHER, 0, OPERATOR_NPOS, 0.0});
+            }
         }
 
-        bool isOperand(const std::string &obj_val)
+        bool Lexer::fail()
         {
-            if(obj_val.empty())
-                return false;
-            
-            if(isAdditionalOperand(obj_val))
-                return true;
+            error = true;
+            return false;
+        }
 
-            std::string::size_type i = 0;
+        bool isTokenContinuation(std::string_view prev, char next)
+        {
+            char last = prev.back();
+            bool last_numeric = isdigit(last) || last == '.';
+            bool next_numeric = isdigit(next) || next == '.';
+            bool last_exp = last == 'e' || last == 'E';
 
-            if(isSign(obj_val.front()) && obj_val.size() > 1)
-                ++i;
+            if((islower(last) && islower(next)) || (last_numeric && next_numeric))
+                return true;
 
-            for(; i < obj_val.size(); ++i)
-                if(!isdigit(obj_val[i]) && obj_val[i] != '.')
-                    return false;
-            
-            return true;
+            //the parts of a number in scientific notation: "2 e5", "2e -5", "2e- 5"
+            if((last_numeric && (next == 'e' || next == 'E')) || (last_exp && (next_numeric || isSign(next))))
+                return true;
+            return isSign(last) && next_numeric && prev.size() >= 2 && (prev[prev.size() - 2] == 'e' || prev[prev.size() - 2] == 'E');
         }
 
-        bool isSign(char c)
+        bool isLiteral(const Token &token)
         {
-            return (c == '+' || c == '-') ? true : false;
+            return token.type == ObjType::OPERAND && (isdigit(token.text.front()) || token.text.front() == '.');
         }
 
-        bool fetch_val(const std::string &expr, std::string &curr_val, std::string::size_type &index)
-        {   
-            curr_val.clear();
-
-            if(index < expr.size() && expr[index] == ' ')
-                ++index;
-
-            if(index >= expr.size())
+        bool parse_literal(std::string_view text, double &value)
+        {
+            RPN_PROFILE_PHASE(LITERALS);
+            std::string_view number = text;
+            if(!number.empty() && isSign(number.front()))
+                number.remove_prefix(1);
+            if(number.empty() || !(isdigit(number.front()) || number.front() == '.'))  //also excludes inf, nan and a second sign
                 return false;
 
+            const char *first = (text.front() == '-') ? text.data() : number.data();  //from_chars accepts '-' but not '+'
+            const char *last = text.data() + text.size();
+            std::from_chars_result res = std::from_chars(first, last, value);
+            return res.ec == std::errc() && res.ptr == last;
+        }
 
-            if(islower(expr[index])){
-                while(index < expr.size() && islower(expr[index]))
-                    curr_val.push_back(expr[index++]);
-            }
-            else if(isdigit(expr[index]) || expr[index] == '.'){
-                curr_val.push_back(expr[index]);
-                ++index;
+        Instruction token_instruction(const Token &token, SymbolTable &symbols)
+        {
+            Instruction ins = {OpCode::PUSH_VALUE, 0, 0, 0.0, nullptr};
 
-                while(index < expr.size() && (isdigit(expr[index]) || expr[index] == '.'))
-                    curr_val.push_back(expr[index++]);
-                if(std::count(curr_val.begin(), curr_val.end(), '.') > 1)
-                    throw std::runtime_error(curr_val + EXCP_INVALID_OPERAND);
+            if(token.type == ObjType::OPERAND){
+                if(isLiteral(token))
+                    ins.value = token.value;
+                else{
+                    ins.opcode = OpCode::PUSH_OPERAND;
+                    ins.index = symbols.add(std::string(token.text));
+                }
+            }
+            else if(token.n_operands > 0){
+                ins.opcode = OpCode::FUNC_OPERATOR;
+                ins.n_operands = token.n_operands;
+                ins.index = token.op;
+                ins.func = operator_table[token.op].func;
             }
             else{
-                curr_val.push_back(expr[index++]);
+                switch(token.text.front()){
+                    case '+':
+                        ins.opcode = OpCode::ADD;
+                        break;
+                    case '-':
+                        ins.opcode = OpCode::SUB;
+                        break;
+                    case '*':
+                        ins.opcode = OpCode::MUL;
+                        break;
+                    case '/':
+                        ins.opcode = OpCode::DIV;
+                        break;
+                }
             }
 
-            return true;
-        }
-
-        ObjType getType(const std::string &obj_value)
-        {
-            if(obj_value.empty())
-                return ObjType::NO_TYPE;
-            else if(isOperand(obj_value))
-                return ObjType::OPERAND;
-            else if(isBasicOperator(obj_value) || isFuncOperator(obj_value))
-                return ObjType::OPERATOR;
-            else if(obj_value == "(")
-                return ObjType::OPEN_PARENTHESIS;
-            else if(obj_value == ")")
-                return ObjType::CLOSE_PARENTHESIS;
-            else
-                return ObjType::NO_TYPE;
+            return ins;
         }
 
-        void enclose_negative(std::string &expr, std::string::size_type index, const std::string &next_val)
+        template<typename Output> bool shunting_yard(const Context &ctx, std::string_view infix_expr, std::pmr::memory_resource *mem, Output output)
         {
-            const std::string prefix = "(0";  //prefix to add to the block
-            const std::string suffix = ")";  //suffix to append to the block
-
-            expr.insert(index, prefix);  //Now index point to '('
-            
-            index += (prefix.size() + 1); //+1 so it points one character after the '-'
+            std::pmr::vector<Token> op(mem);
+            Lexer lexer(ctx, infix_expr, mem);
+            Token token;
 
-            ObjType next_val_type = getType(next_val);
+            op.reserve(infix_expr.size() / 2 + 1);
 
+            while(lexer.next(token)){
+                switch(token.type){
+                    case ObjType::OPERAND:
+                        output(token);
+                        break;
+                    
+                    case ObjType::OPERATOR:
+                        while(!op.empty() && token.precedence < op.back().precedence){
+                            output(op.back());
+                            op.pop_back();
+                        }
+                        op.push_back(token);
+                        break;
 
-            //May have only 2 cases either '(' or an operator (function).
-
-            if(next_val_type == ObjType::OPEN_PARENTHESIS){
-                skipParenthesis(expr, index);
-            }
-            else{  //operator (function) case
-                unsigned short n_operands_required = get_operands_func_operator(next_val);
-                std::string tmp_val;
-                ObjType tmp_val_type; 
-
-                for(unsigned operands_found = 0; operands_found < n_operands_required; ++operands_found){
-                    bool found_operand = false;
-                    while(!found_operand && fetch_val(expr, tmp_val, index)){
-                        tmp_val_type = getType(tmp_val);
-                        if(tmp_val_type == ObjType::OPERAND || tmp_val_type == ObjType::OPEN_PARENTHESIS)
-                            found_operand = true;
-                    }
+                    case ObjType::OPEN_PARENTHESIS:
+                        op.push_back(token);
+                        break;
+                    
+                    case ObjType::CLOSE_PARENTHESIS:
+                        while(!op.empty() && op.back().type != ObjType::OPEN_PARENTHESIS){
+                            output(op.back());
+                            op.pop_back();
+                        }
 
-                    if(!found_operand)  //if it doesn't find the function argument
-                        throw std::runtime_error(next_val + EXCP_MISSING_FUNCTION_ARGUMENT);
+                        if(op.empty())  //there is no corresponding open parenthesis
+                            return false;
+                        op.pop_back();
+                        break;
 
-                    switch(tmp_val_type){
-                        case ObjType::OPEN_PARENTHESIS:  //the function argument is a block in parentheses
-                            --index; //because index points to a character after '(' because of fetch_val
-                            skipParenthesis(expr, index);
-                            break;
-                        case ObjType::OPERAND:  //the function argument is an operand
-                            //nothing to do here, because fetch_val has already positioned index so that it points one character after the operand
-                            break;
-                    }
+                    default:
+                        return false;
                 }
+            }
 
+            while(!op.empty()){
+                if(op.back().type == ObjType::OPEN_PARENTHESIS)  //there is no corresponding close parenthesis
+                    return false;
+                output(op.back());
+                op.pop_back();
             }
-            expr.insert(index, suffix);
+
+            return !lexer.failed();
         }
 
-        void skipParenthesis(const std::string &expr, std::string::size_type &index)
+        template<typename Rpn> void append_token(Rpn &rpn_expr, const Token &token)
         {
-            if(expr[index] != '(')
-                return;
-            
-            ++index;
-
-            for(unsigned inner_parenthesis = 0; index < expr.size() && (expr[index] != ')' || inner_parenthesis); ++index){
-                if(expr[index] == '(')
-                    ++inner_parenthesis;
-                else if(expr[index] == ')')
-                    --inner_parenthesis;
-            }
+            rpn_expr.emplace_back();
+            typename Rpn::value_type &str = rpn_expr.back();
+            str.reserve(token.text.size() + 1);
+            if(token.negative)
+                str.push_back('-');
+            str.append(token.text);
         }
 
-        bool isFuncOperator(const std::string &obj_val)
+        bool isFuncOperator(const std::string &obj_val, unsigned &id)
         {
             if(obj_val.empty())
                 return false;
             
-            if(additional_operators.find(obj_val) != additional_operators.cend())
-                return true;
-            
-            return false;
+            id = find_operator(obj_val);
+            return id != OPERATOR_NPOS;
         }
 
         bool isBasicOperator(const std::string &obj_val){
@@ -387,233 +494,782 @@ namespace rpn
             }
         }
 
-        unsigned short get_precedence_func_operator(const std::string &obj_val)
+        unsigned short get_operands_func_operator(unsigned id)
         {
-            if(additional_operators.find(obj_val) != additional_operators.cend())
-                return std::get<IDX_PRECEDENCE_VAL>(additional_operators.at(obj_val));
+            if(id < operator_count())
+                return operator_table[id].n_operands;
 
             throw std::runtime_error(EXCP_GENERAL_ERROR);
         }
 
-        unsigned short get_operands_func_operator(const std::string &obj_val)
+        bool checkRpn(const Context &ctx, const std::vector<std::string> &rpn_expr)
         {
-            if(additional_operators.find(obj_val) != additional_operators.cend())
-                return std::get<IDX_N_OPERANDS>(additional_operators.at(obj_val));
+            return checkRpn(ctx, rpn_expr, SymbolTable());
+        }
 
-            throw std::runtime_error(EXCP_GENERAL_ERROR);
+        bool checkRpn(const Context &ctx, const std::vector<std::string> &rpn_expr, const SymbolTable &symbols)
+        {
+            std::size_t max_depth;
+            return check_rpn_expr(ctx, rpn_expr, symbols, max_depth);
         }
 
-        bool checkRpn(const std::vector<std::string> &rpn_expr)
+        template<typename Rpn> bool check_rpn_expr(const Context &ctx, const Rpn &rpn_expr, const SymbolTable &symbols, std::size_t &max_depth)
         {
+            RPN_PROFILE_PHASE(VALIDATION);
             long checker = 0;
+            max_depth = 0;
+
+            for(typename Rpn::const_iterator it = rpn_expr.cbegin(); it != rpn_expr.cend(); ++it){
+                const std::string &name = name_key(*it);
+                unsigned id;
 
-            for(std::vector<std::string>::const_iterator it = rpn_expr.cbegin(); it != rpn_expr.cend(); ++it){
-                if(isOperand(*it))
+                if(isOperand(ctx, name) || symbols.find(name) != SymbolTable::NPOS)
                     ++checker;
-                else if(isBasicOperator(*it))  //because all basic operators (+, -, *, /) take 2 operands
+                else if(isBasicOperator(name))  //because all basic operators (+, -, *, /) take 2 operands
                     --checker;
-                else if(isFuncOperator(*it))  //we should check how many operands a func operator take
-                    checker -= (get_operands_func_operator(*it) - 1);
+                else if(isFuncOperator(name, id))  //we should check how many operands a func operator take
+                    checker -= (get_operands_func_operator(id) - 1);
                 else
                     return false;
 
                 if(checker <= 0)
                     return false;
+                if(static_cast<std::size_t>(checker) > max_depth)  //only operands increase the depth
+                    max_depth = checker;
             }
 
             return checker == 1;
         }
 
-        double get_value_additionalOperand(const std::string &obj_val)
+        double get_value_additionalOperand(const Context &ctx, const std::string &obj_val)
         {
-            if(!isAdditionalOperand(obj_val))
+            if(!isAdditionalOperand(ctx, obj_val))
                 throw std::runtime_error(EXCP_GENERAL_ERROR);
 
-            return additional_operands.at(obj_val);
+            return ctx.get_all_operands().at(obj_val);
+        }
+
+        const std::string &name_key(const std::string &name)
+        {
+            return name;
+        }
+
+        std::string name_key(const std::pmr::string &name)
+        {
+            return std::string(name.data(), name.size());
         }
 
-        std::pair<bool, double> eval_func_operator(const std::string &obj_val, const double *operands)
+        template<typename Rpn> std::pair<bool, double> evaluate_rpn(const Context &ctx, const Rpn &expr, std::pmr::memory_resource *mem)
         {
-            if(additional_operators.find(obj_val) == additional_operators.cend())
+            RPN_PROFILE_PHASE(EVALUATION);
+            std::size_t max_depth;
+            if(!check_rpn_expr(ctx, expr, SymbolTable(), max_depth))
+                return std::make_pair(false, 0.0);
+            
+            double local_stack[LOCAL_STACK_SIZE];
+            std::pmr::vector<double> heap_stack(mem);
+            double *stack = local_stack;
+
+            if(max_depth > LOCAL_STACK_SIZE){
+                heap_stack.resize(max_depth);
+                stack = heap_stack.data();
+            }
+
+            double *top = stack;  //points one position past the value on top of the stack
+
+            for(typename Rpn::const_iterator it = expr.cbegin(); it != expr.cend(); ++it){
+                const std::string &name = name_key(*it);
+                double tmp;
+                unsigned id;
+
+                if(isAdditionalOperand(ctx, name))
+                    *top++ = get_value_additionalOperand(ctx, name);
+                else if(parse_literal(name, tmp))
+                    *top++ = tmp;
+                else if(isBasicOperator(name)){
+                    --top;
+
+                    switch(name.front()){
+                        case '+':
+                            top[-1] += top[0];
+                            break;
+
+                        case '-':
+                            top[-1] -= top[0];
+                            break;
+                        
+                        case '*':
+                            top[-1] *= top[0];
+                            break;
+                        
+                        case '/':
+                            if(top[0] == 0){
+                                RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+                                return std::make_pair(false, 0.0);
+                            }
+                            top[-1] /= top[0];
+                            break;
+                    }
+                }
+                else if(isFuncOperator(name, id)){
+                    top -= get_operands_func_operator(id) - 1;  //top[-1] is now the first operand of the function
+                    std::pair<bool, double> result = eval_func_operator(id, top - 1);
+
+                    if(!result.first){
+                        RPN_PROFILE_UNDEFINED_FLAGS();
+                        return std::make_pair(false, 0.0);
+                    }
+                    top[-1] = result.second;
+                }
+            }
+
+            if(top - stack != 1)
+                throw std::runtime_error(EXCP_GENERAL_ERROR);
+            
+            return std::make_pair(true, top[-1]);
+        }
+
+        std::pair<bool, double> eval_func_operator(unsigned id, const double *operands)
+        {
+            if(id >= operator_count())
                 throw std::runtime_error(EXCP_GENERAL_ERROR);
             
-            operator_func wfunc = std::get<IDX_FUNC_PTR>(additional_operators.at(obj_val));
             double result;
             bool defined = true;
             
             std::feclearexcept(FE_ALL_EXCEPT);
-            result = (*wfunc)(operands);
+            result = call_operator(id, operands);
 
             if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW))
                 defined = false;
         
             return std::make_pair(defined, result);
         }
+
+        bool program_depth(const std::vector<Instruction> &program, unsigned n_operands, unsigned &max_depth, unsigned &n_temps)
+        {
+            RPN_PROFILE_PHASE(VALIDATION);
+            long checker = 0;
+            std::vector<bool> stored;  //temporary slots already written
+            max_depth = 0;
+            n_temps = 0;
+
+            for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+                switch(it->opcode){
+                    case OpCode::PUSH_VALUE:
+                        ++checker;
+                        break;
+
+                    case OpCode::PUSH_OPERAND:
+                        if(it->index >= n_operands)
+                            return false;
+                        ++checker;
+                        break;
+
+                    case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+                        --checker;
+                        break;
+
+                    case OpCode::FUNC_OPERATOR:
+                        if(it->index >= operator_count() || it->n_operands != operator_table[it->index].n_operands || it->func != operator_table[it->index].func)
+                            return false;
+                        checker -= (it->n_operands - 1);
+                        break;
+
+                    case OpCode::STORE_TEMP:
+                        if(it->index >= program.size())  //a program never needs more slots than instructions
+                            return false;
+                        if(it->index >= stored.size())
+                            stored.resize(it->index + 1, false);
+                        stored[it->index] = true;
+                        break;
+
+                    case OpCode::LOAD_TEMP:
+                        if(it->index >= stored.size() || !stored[it->index])
+                            return false;
+                        ++checker;
+                        break;
+
+                    default:
+                        return false;
+                }
+
+                if(checker <= 0)
+                    return false;
+                if(static_cast<unsigned long>(checker) > max_depth)
+                    max_depth = checker;
+            }
+
+            n_temps = stored.size();
+            return checker == 1;
+        }
     }
 
     
     bool infix_to_rpn(const std::string &infix_expr, std::vector<std::string> &rpn_expr)
     {
-        std::stack<std::string> op;
+        return infix_to_rpn(global_context, infix_expr, rpn_expr);
+    }
+
+    bool infix_to_rpn(const Context &ctx, const std::string &infix_expr, std::vector<std::string> &rpn_expr)
+    {
+        RPN_PROFILE_PHASE(CONVERSION);
         rpn_expr.clear();
-        std::string m_infix_expr(infix_expr);
-        adj_expr(m_infix_expr);
-        ObjType type;
-        std::string obj_val;
 
-        std::string::size_type index = 0;
+        bool valid = shunting_yard(ctx, infix_expr, profile::heap_resource(), [&rpn_expr](const Token &token){
+            append_token(rpn_expr, token);
+        });
 
-        while((type = getOp(m_infix_expr, obj_val, index)) != ObjType::NO_TYPE){
-            switch(type){
-                case ObjType::OPERAND:
-                    rpn_expr.push_back(obj_val);
-                    break;
-                
-                case ObjType::OPERATOR:
-                    while(!op.empty() && precedence(obj_val) < precedence(op.top())){
-                        rpn_expr.push_back(op.top());
-                        op.pop();
-                    }
-                    op.push(obj_val);
-                    break;
+        if(!valid || !checkRpn(ctx, rpn_expr)){
+            rpn_expr.clear();
+            return false;
+        }
+        return true;
+    }
 
-                case ObjType::OPEN_PARENTHESIS:
-                    op.push("(");
+    bool infix_to_rpn(const std::string &infix_expr, std::pmr::vector<std::pmr::string> &rpn_expr)
+    {
+        return infix_to_rpn(global_context, infix_expr, rpn_expr);
+    }
+
+    bool infix_to_rpn(const Context &ctx, const std::string &infix_expr, std::pmr::vector<std::pmr::string> &rpn_expr)
+    {
+        RPN_PROFILE_PHASE(CONVERSION);
+        rpn_expr.clear();
+
+        bool valid = shunting_yard(ctx, infix_expr, rpn_expr.get_allocator().resource(), [&rpn_expr](const Token &token){
+            append_token(rpn_expr, token);
+        });
+
+        std::size_t max_depth;
+        if(!valid || !check_rpn_expr(ctx, rpn_expr, SymbolTable(), max_depth)){
+            rpn_expr.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool infix_to_rpn(const std::string &infix_expr, std::vector<Instruction> &rpn_program, SymbolTable &symbols)
+    {
+        return infix_to_rpn(global_context, infix_expr, rpn_program, symbols);
+    }
+
+    bool infix_to_rpn(const Context &ctx, const std::string &infix_expr, std::vector<Instruction> &rpn_program, SymbolTable &symbols)
+    {
+        RPN_PROFILE_PHASE(CONVERSION);
+        unsigned depth, n_temps;
+        rpn_program.clear();
+
+        bool valid = shunting_yard(ctx, infix_expr, profile::heap_resource(), [&rpn_program, &symbols](const Token &token){
+            rpn_program.push_back(token_instruction(token, symbols));
+        });
+
+        if(!valid || !program_depth(rpn_program, symbols.size(), depth, n_temps)){
+            rpn_program.clear();
+            return false;
+        }
+        return true;
+    }
+
+    std::string normalize_infix(const std::string &infix_expr)
+    {
+        std::string normalized;
+        normalized.reserve(infix_expr.size());
+        bool separated = false;  //true if separators have been skipped after the last character copied
+
+        for(std::string::const_iterator it = infix_expr.cbegin(); it != infix_expr.cend(); ++it){
+            char c = *it;
+            switch(c){
+                case ' ': case '\t':
+                    separated = true;
+                    continue;
+
+                case '[': case '{':
+                    c = '(';
                     break;
-                
-                case ObjType::CLOSE_PARENTHESIS:
-                    while(!op.empty() && op.top() != "("){
-                        rpn_expr.push_back(op.top());
-                        op.pop();
-                    }
 
-                    op.pop();
+                case ']': case '}':
+                    c = ')';
                     break;
             }
+
+            if(separated && !normalized.empty() && isTokenContinuation(normalized, c))
+                normalized += ' ';
+            separated = false;
+            normalized += c;
+        }
+
+        return normalized;
+    }
+
+    std::pair<bool, double> evaluate(const std::vector<std::string> &expr)
+    {
+        return evaluate(global_context, expr);
+    }
+
+    std::pair<bool, double> evaluate(const Context &ctx, const std::vector<std::string> &expr)
+    {
+        return evaluate_rpn(ctx, expr, profile::heap_resource());
+    }
+
+    std::pair<bool, double> evaluate(const std::pmr::vector<std::pmr::string> &expr)
+    {
+        return evaluate(global_context, expr);
+    }
+
+    std::pair<bool, double> evaluate(const Context &ctx, const std::pmr::vector<std::pmr::string> &expr)
+    {
+        return evaluate_rpn(ctx, expr, expr.get_allocator().resource());
+    }
+
+    bool add_operand(const std::string &op_name, double op_value)
+    {
+        return global_context.add_operand(op_name, op_value);
+    }
+
+    bool remove_operand(const std::string &op_name)
+    {
+        return global_context.remove_operand(op_name);
+    }
+
+    double get_operand(const std::string &op_name)
+    {
+        return global_context.get_operand(op_name);
+    }
+
+    const std::unordered_map<std::string, double> &get_all_operands()
+    {
+        return global_context.get_all_operands();
+    }
+
+    void clear_all_operands()
+    {
+        global_context.clear_all_operands();
+    }
+
+    unsigned long operands_version()
+    {
+        return global_context.version();
+    }
+
+    Context::Context() : version_stamp(++context_versions)
+    {
+    }
+
+    Context::Context(const Context &other) : operands(other.operands), version_stamp(++context_versions)
+    {
+    }
+
+    Context::Context(Context &&other) noexcept : operands(std::move(other.operands)), version_stamp(++context_versions)
+    {
+        other.operands.clear();
+        other.version_stamp = ++context_versions;
+    }
+
+    Context &Context::operator=(const Context &other)
+    {
+        if(this != &other){
+            operands = other.operands;
+            version_stamp = ++context_versions;
         }
+        return *this;
+    }
 
-        while(!op.empty()){
-            rpn_expr.push_back(op.top());
-            op.pop();
+    Context &Context::operator=(Context &&other) noexcept
+    {
+        if(this != &other){
+            operands = std::move(other.operands);
+            version_stamp = ++context_versions;
+            other.operands.clear();
+            other.version_stamp = ++context_versions;
         }
+        return *this;
+    }
 
-        if(!checkRpn(rpn_expr)){
-            rpn_expr.clear();
+    bool Context::add_operand(const std::string &op_name, double op_value)
+    {
+        if(std::isinf(op_value) || std::isnan(op_value))
             return false;
-        }
+        
+        for(std::string::const_iterator it = op_name.cbegin(); it != op_name.cend(); ++it)
+            if(!islower(*it))
+                return false;
+        
+        if(operands.insert_or_assign(op_name, op_value).second)
+            version_stamp = ++context_versions;
         return true;
     }
 
-    std::pair<bool, double> evaluate(const std::vector<std::string> &expr)
+    bool Context::remove_operand(const std::string &op_name)
     {
-        if(!checkRpn(expr))
-            return std::make_pair(false, 0.0);
-        
-        bool isDefined = true;
-        std::stack<double> operands;
+        if(operands.erase(op_name) == 0)
+            return false;
 
-        for(std::vector<std::string>::const_iterator it = expr.cbegin(); isDefined && it != expr.cend(); ++it){
-            if(isOperand(*it)){
-                double tmp;
-                if(isAdditionalOperand(*it))
-                    tmp = get_value_additionalOperand(*it);
-                else
-                    tmp = std::stod(*it);
-                
-                operands.push(tmp);
-            }
-            else if(isBasicOperator(*it)){
-                double op2 = operands.top();
-                operands.pop();
-                double op1 = operands.top();
-                operands.pop();
+        version_stamp = ++context_versions;
+        return true;
+    }
 
-                double result;
+    double Context::get_operand(const std::string &op_name) const
+    {
+        std::unordered_map<std::string, double>::const_iterator it = operands.find(op_name);
+        return (it != operands.cend()) ? it->second : 0.0;
+    }
 
+    bool Context::has_operand(const std::string &op_name) const
+    {
+        return operands.find(op_name) != operands.cend();
+    }
+
+    const std::unordered_map<std::string, double> &Context::get_all_operands() const
+    {
+        return operands;
+    }
+
+    void Context::clear_all_operands()
+    {
+        if(operands.empty())
+            return;
+
+        operands.clear();
+        version_stamp = ++context_versions;
+    }
+
+    unsigned long Context::version() const
+    {
+        return version_stamp;
+    }
+
+    bool compile(const std::vector<std::string> &rpn_expr, CompiledExpr &compiled_expr)
+    {
+        return compile(global_context, rpn_expr, compiled_expr);
+    }
+
+    bool compile(const Context &ctx, const std::vector<std::string> &rpn_expr, CompiledExpr &compiled_expr)
+    {
+        SymbolTable symbols;
+        return compile(ctx, rpn_expr, symbols, compiled_expr);
+    }
+
+    bool compile(const std::vector<std::string> &rpn_expr, SymbolTable &symbols, CompiledExpr &compiled_expr)
+    {
+        return compile(global_context, rpn_expr, symbols, compiled_expr);
+    }
+
+    bool compile(const Context &ctx, const std::vector<std::string> &rpn_expr, SymbolTable &symbols, CompiledExpr &compiled_expr)
+    {
+        RPN_PROFILE_PHASE(COMPILATION);
+        compiled_expr.clear();
+
+        if(!checkRpn(ctx, rpn_expr, symbols))
+            return false;
+
+        std::vector<Instruction> program;
+        program.reserve(rpn_expr.size());
+
+        for(std::vector<std::string>::const_iterator it = rpn_expr.cbegin(); it != rpn_expr.cend(); ++it){
+            Instruction ins = {OpCode::PUSH_VALUE, 0, 0, 0.0, nullptr};
+
+            if(symbols.find(*it) != SymbolTable::NPOS || isAdditionalOperand(ctx, *it)){
+                ins.opcode = OpCode::PUSH_OPERAND;
+                ins.index = symbols.add(*it);
+            }
+            else if(isOperand(ctx, *it))
+                parse_literal(*it, ins.value);
+            else if(isBasicOperator(*it)){
                 switch(it->front()){
                     case '+':
-                        result = op1 + op2;
+                        ins.opcode = OpCode::ADD;
                         break;
-
                     case '-':
-                        result = op1 - op2;
+                        ins.opcode = OpCode::SUB;
                         break;
-                    
                     case '*':
-                        result = op1 * op2;
+                        ins.opcode = OpCode::MUL;
                         break;
-                    
                     case '/':
-                        if(op2 == 0)
-                            isDefined = false;
-                        result = op1 / op2;
+                        ins.opcode = OpCode::DIV;
                         break;
                 }
-
-                operands.push(result);
             }
-            else if(isFuncOperator(*it)){
-                unsigned short n_operands_required = get_operands_func_operator(*it);
-                std::vector<double> op(n_operands_required);
+            else{  //checkRpn has already verified that it is a function operator
+                ins.opcode = OpCode::FUNC_OPERATOR;
+                ins.index = find_operator(*it);
+                ins.n_operands = operator_table[ins.index].n_operands;
+                ins.func = operator_table[ins.index].func;
+            }
 
-                for(unsigned short i = n_operands_required - 1; i < n_operands_required; --i){
-                    op[i] = operands.top();
-                    operands.pop();
-                }
-                std::pair<bool, double> result = eval_func_operator(*it, op.data());
+            program.push_back(ins);
+        }
 
-                if(!result.first)
-                    isDefined = false;
-                else
-                    operands.push(result.second);
+        return compiled_expr.assign(program, symbols.names());
+    }
+
+    std::pair<bool, double> CompiledExpr::evaluate() const
+    {
+        return evaluate(global_context);
+    }
+
+    std::pair<bool, double> CompiledExpr::evaluate(const Context &ctx) const
+    {
+        if(program.empty())
+            return std::make_pair(false, 0.0);
+
+        OperandBinding &binding = operand_bindings[stamp % BINDING_CACHE_SIZE];
+        if(binding.expr_stamp != stamp || binding.ctx_version != ctx.version()){  //looks up the operands again (the elements of the map of the context do not move until one is erased, which changes the version)
+            const std::unordered_map<std::string, double> &ctx_operands = ctx.get_all_operands();
+            binding.expr_stamp = stamp;
+            binding.ctx_version = ctx.version();
+            binding.complete = true;
+            binding.values.clear();
+
+            for(std::vector<unsigned>::const_iterator slot = used_slots.cbegin(); slot != used_slots.cend(); ++slot){
+                std::unordered_map<std::string, double>::const_iterator it = ctx_operands.find(operands[*slot]);
+                if(it == ctx_operands.cend()){  //the operand has been removed after the compilation
+                    binding.complete = false;
+                    break;
+                }
+                binding.values.push_back(&it->second);
             }
         }
-        
-        if(!isDefined)
+        if(!binding.complete)
             return std::make_pair(false, 0.0);
 
-        if(operands.size() != 1)
-            throw std::runtime_error(EXCP_GENERAL_ERROR);
-        
-        return std::make_pair(true, operands.top());
+        double local_values[LOCAL_OPERANDS];
+        std::vector<double> heap_values;
+        double *operand_values = local_values;
+        if(operands.size() > LOCAL_OPERANDS){
+            heap_values.resize(operands.size());
+            operand_values = heap_values.data();
+        }
+
+        for(std::size_t i = 0; i < used_slots.size(); ++i)  //the slots not used are never read
+            operand_values[used_slots[i]] = *binding.values[i];
+
+        return evaluate(operand_values);
     }
 
-    bool add_operand(const std::string &op_name, double op_value)
+    std::pair<bool, double> CompiledExpr::evaluate(const double *operand_values) const
     {
-        if(std::isinf(op_value) || std::isnan(op_value))
-            return false;
-        
-        for(std::string::const_iterator it = op_name.cbegin(); it != op_name.cend(); ++it)
-            if(!islower(*it))
-                return false;
-        
-        additional_operands[op_name] = op_value;
-        return true;
+        return evaluate(operand_values, profile::heap_resource());
     }
 
-    bool remove_operand(const std::string &op_name)
+    std::pair<bool, double> CompiledExpr::evaluate(const double *operand_values, std::pmr::memory_resource *scratch) const
     {
-        if(!isAdditionalOperand(op_name))
+        RPN_PROFILE_PHASE(EVALUATION);
+        if(program.empty())
+            return std::make_pair(false, 0.0);
+
+        if(check == FpCheck::DEFERRED && calls_functions){  //without function operators there is nothing to check
+            std::feclearexcept(FE_ALL_EXCEPT);
+            std::pair<bool, double> result = run(operand_values, false, scratch);
+            if(!std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW))
+                return result;
+
+            RPN_PROFILE_RECHECK();
+            return run(operand_values, true, scratch);
+        }
+
+        return run(operand_values, true, scratch);
+    }
+
+    std::pair<bool, double> CompiledExpr::run(const double *operand_values, bool check_each, std::pmr::memory_resource *scratch) const
+    {
+        double local_stack[LOCAL_STACK_SIZE];
+        std::pmr::vector<double> heap_stack(scratch);
+        double *stack = local_stack;
+
+        if(depth + n_temps > LOCAL_STACK_SIZE){
+            heap_stack.resize(depth + n_temps);
+            stack = heap_stack.data();
+        }
+
+        double *temp_values = stack + depth;  //values of the temporary slots
+        double *top = stack;  //points one position past the value on top of the stack
+
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            RPN_PROFILE_INSTRUCTION(*it, 1);
+
+            switch(it->opcode){
+                case OpCode::PUSH_VALUE:
+                    *top++ = it->value;
+                    break;
+
+                case OpCode::PUSH_OPERAND:
+                    *top++ = operand_values[it->index];
+                    break;
+
+                case OpCode::ADD:
+                    --top;
+                    top[-1] += top[0];
+                    break;
+
+                case OpCode::SUB:
+                    --top;
+                    top[-1] -= top[0];
+                    break;
+
+                case OpCode::MUL:
+                    --top;
+                    top[-1] *= top[0];
+                    break;
+
+                case OpCode::DIV:
+                    --top;
+                    if(top[0] == 0){
+                        RPN_PROFILE_UNDEFINED(DIVISION_BY_ZERO);
+                        return std::make_pair(false, 0.0);
+                    }
+                    top[-1] /= top[0];
+                    break;
+
+                case OpCode::FUNC_OPERATOR:
+                    top -= it->n_operands - 1;  //top[-1] is now the first operand of the function
+                    if(!check_each){
+                        top[-1] = call_operator(it->index, top - 1);
+                        break;
+                    }
+
+                    std::feclearexcept(FE_ALL_EXCEPT);
+                    top[-1] = call_operator(it->index, top - 1);
+                    if(std::fetestexcept(FE_INVALID | FE_DIVBYZERO | FE_UNDERFLOW | FE_OVERFLOW)){
+                        RPN_PROFILE_UNDEFINED_FLAGS();
+                        return std::make_pair(false, 0.0);
+                    }
+                    break;
+
+                case OpCode::STORE_TEMP:
+                    temp_values[it->index] = top[-1];
+                    break;
+
+                case OpCode::LOAD_TEMP:
+                    *top++ = temp_values[it->index];
+                    break;
+
+                case OpCode::STORE_RESULT:  //not accepted by assign
+                    break;
+            }
+        }
+
+        return std::make_pair(true, top[-1]);
+    }
+
+    bool CompiledExpr::assign(const std::vector<Instruction> &new_program, const std::vector<std::string> &operand_names)
+    {
+        RPN_PROFILE_PHASE(COMPILATION);
+        unsigned new_depth, new_temps;
+
+        if(!program_depth(new_program, operand_names.size(), new_depth, new_temps)){
+            clear();
             return false;
-        
-        additional_operands.erase(op_name);
+        }
+
+        program = new_program;
+        operands = operand_names;
+        depth = new_depth;
+        n_temps = new_temps;
+        stamp = ++compiled_stamps;
+
+        used_slots.clear();
+        calls_functions = false;
+        std::vector<bool> used(operands.size(), false);
+        for(std::vector<Instruction>::const_iterator it = program.cbegin(); it != program.cend(); ++it){
+            if(it->opcode == OpCode::PUSH_OPERAND && !used[it->index]){
+                used[it->index] = true;
+                used_slots.push_back(it->index);
+            }
+            else if(it->opcode == OpCode::FUNC_OPERATOR)
+                calls_functions = true;
+        }
         return true;
     }
 
-    double get_operand(const std::string &op_name)
+    void CompiledExpr::clear()
     {
-        if(!isAdditionalOperand(op_name))
-            return 0.0;
-        return additional_operands[op_name];
+        program.clear();
+        operands.clear();
+        used_slots.clear();
+        depth = 0;
+        n_temps = 0;
+        calls_functions = false;
+        stamp = 0;
     }
 
-    const std::unordered_map<std::string, double> &get_all_operands()
+    bool CompiledExpr::empty() const
     {
-        return additional_operands;
+        return program.empty();
     }
 
-    void clear_all_operands()
+    const std::vector<Instruction> &CompiledExpr::instructions() const
+    {
+        return program;
+    }
+
+    const std::vector<std::string> &CompiledExpr::operand_names() const
+    {
+        return operands;
+    }
+
+    unsigned CompiledExpr::max_depth() const
+    {
+        return depth;
+    }
+
+    unsigned CompiledExpr::temps() const
+    {
+        return n_temps;
+    }
+
+    void CompiledExpr::set_fp_check(FpCheck mode)
+    {
+        check = mode;
+    }
+
+    FpCheck CompiledExpr::fp_check() const
+    {
+        return check;
+    }
+
+    bool CompiledExpr::has_func_operators() const
+    {
+        return calls_functions;
+    }
+
+    unsigned SymbolTable::add(const std::string &op_name)
+    {
+        std::unordered_map<std::string, unsigned>::const_iterator it = slots.find(op_name);
+        if(it != slots.cend())
+            return it->second;
+
+        unsigned slot = slot_names.size();
+        slots[op_name] = slot;
+        slot_names.push_back(op_name);
+        return slot;
+    }
+
+    unsigned SymbolTable::find(const std::string &op_name) const
+    {
+        std::unordered_map<std::string, unsigned>::const_iterator it = slots.find(op_name);
+        return (it != slots.cend()) ? it->second : NPOS;
+    }
+
+    const std::string &SymbolTable::name(unsigned slot) const
+    {
+        return slot_names.at(slot);
+    }
+
+    const std::vector<std::string> &SymbolTable::names() const
+    {
+        return slot_names;
+    }
+
+    unsigned SymbolTable::size() const
+    {
+        return slot_names.size();
+    }
+
+    void SymbolTable::clear()
     {
-        additional_operands.clear();
+        slots.clear();
+        slot_names.clear();
     }
 }
\ No newline at end of file
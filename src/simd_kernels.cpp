@@ -0,0 +1,390 @@
+/**
+ * @file simd_kernels.cpp
+ * @brief Implementation file for the internal library simd_kernels
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "simd_kernels.hpp"
+#include <cmath>
+
+#if defined(__GNUC__) && defined(__SSE2__)  //always on x86-64; a 32-bit x86 build uses the SSE2 kernels only when built for SSE2 (-msse2), as they run without a runtime check
+#define RPN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace rpn
+{
+    namespace simd
+    {
+        namespace
+        {
+            inline double scaled(double alpha, double x)  //alpha * x, 0 if x is 0 whatever alpha is
+            {
+                return (x != 0) ? alpha * x : 0.0;
+            }
+
+#ifdef RPN_SIMD_X86
+            bool has_avx2()
+            {
+                static const bool avx2 = __builtin_cpu_supports("avx2");
+                return avx2;
+            }
+
+            //AVX2 kernels, 4 values at a time
+
+            __attribute__((target("avx2"))) void add_avx2(double *a, const double *b, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4)
+                    _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+                for(; i < n; ++i)
+                    a[i] += b[i];
+            }
+
+            __attribute__((target("avx2"))) void sub_avx2(double *a, const double *b, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4)
+                    _mm256_storeu_pd(a + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+                for(; i < n; ++i)
+                    a[i] -= b[i];
+            }
+
+            __attribute__((target("avx2"))) void mul_avx2(double *a, const double *b, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4)
+                    _mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+                for(; i < n; ++i)
+                    a[i] *= b[i];
+            }
+
+            __attribute__((target("avx2"))) void div_avx2(double *a, const double *b, std::size_t n, bool *defined)
+            {
+                const __m256d zero = _mm256_setzero_pd();
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4){
+                    __m256d vb = _mm256_loadu_pd(b + i);
+                    int zeros = _mm256_movemask_pd(_mm256_cmp_pd(vb, zero, _CMP_EQ_OQ));
+                    if(zeros)
+                        for(int j = 0; j < 4; ++j)
+                            if(zeros & (1 << j))
+                                defined[i + j] = false;
+                    _mm256_storeu_pd(a + i, _mm256_div_pd(_mm256_loadu_pd(a + i), vb));
+                }
+                for(; i < n; ++i){
+                    if(b[i] == 0)
+                        defined[i] = false;
+                    a[i] /= b[i];
+                }
+            }
+
+            __attribute__((target("avx2"))) void scale_avx2(double *a, double alpha, std::size_t n)
+            {
+                const __m256d va = _mm256_set1_pd(alpha);
+                const __m256d zero = _mm256_setzero_pd();
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4){
+                    __m256d x = _mm256_loadu_pd(a + i);
+                    _mm256_storeu_pd(a + i, _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_NEQ_UQ), _mm256_mul_pd(va, x)));
+                }
+                for(; i < n; ++i)
+                    a[i] = scaled(alpha, a[i]);
+            }
+
+            __attribute__((target("avx2"))) void axpby_avx2(double *a, double alpha, const double *b, double beta, std::size_t n)
+            {
+                const __m256d va = _mm256_set1_pd(alpha);
+                const __m256d vb = _mm256_set1_pd(beta);
+                const __m256d zero = _mm256_setzero_pd();
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4){
+                    __m256d x = _mm256_loadu_pd(a + i);
+                    __m256d y = _mm256_loadu_pd(b + i);
+                    __m256d ax = _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_NEQ_UQ), _mm256_mul_pd(va, x));
+                    __m256d by = _mm256_and_pd(_mm256_cmp_pd(y, zero, _CMP_NEQ_UQ), _mm256_mul_pd(vb, y));
+                    _mm256_storeu_pd(a + i, _mm256_add_pd(ax, by));
+                }
+                for(; i < n; ++i)
+                    a[i] = scaled(alpha, a[i]) + scaled(beta, b[i]);
+            }
+
+            __attribute__((target("avx2"))) void sqr_avx2(const double *in, double *out, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4){
+                    __m256d v = _mm256_loadu_pd(in + i);
+                    _mm256_storeu_pd(out + i, _mm256_mul_pd(v, v));
+                }
+                for(; i < n; ++i)
+                    out[i] = in[i] * in[i];
+            }
+
+            __attribute__((target("avx2"))) void cube_avx2(const double *in, double *out, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4){
+                    __m256d v = _mm256_loadu_pd(in + i);
+                    _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_mul_pd(v, v), v));
+                }
+                for(; i < n; ++i)
+                    out[i] = in[i] * in[i] * in[i];
+            }
+
+            __attribute__((target("avx2"))) void sqrt_avx2(const double *in, double *out, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 4 <= n; i += 4)
+                    _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_loadu_pd(in + i)));
+                for(; i < n; ++i)
+                    out[i] = std::sqrt(in[i]);
+            }
+
+            //SSE2 kernels, 2 values at a time (SSE2 is always available on x86-64)
+
+            __attribute__((target("sse2"))) void add_sse2(double *a, const double *b, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2)
+                    _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+                for(; i < n; ++i)
+                    a[i] += b[i];
+            }
+
+            __attribute__((target("sse2"))) void sub_sse2(double *a, const double *b, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2)
+                    _mm_storeu_pd(a + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+                for(; i < n; ++i)
+                    a[i] -= b[i];
+            }
+
+            __attribute__((target("sse2"))) void mul_sse2(double *a, const double *b, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2)
+                    _mm_storeu_pd(a + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+                for(; i < n; ++i)
+                    a[i] *= b[i];
+            }
+
+            __attribute__((target("sse2"))) void div_sse2(double *a, const double *b, std::size_t n, bool *defined)
+            {
+                const __m128d zero = _mm_setzero_pd();
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2){
+                    __m128d vb = _mm_loadu_pd(b + i);
+                    int zeros = _mm_movemask_pd(_mm_cmpeq_pd(vb, zero));
+                    if(zeros & 1)
+                        defined[i] = false;
+                    if(zeros & 2)
+                        defined[i + 1] = false;
+                    _mm_storeu_pd(a + i, _mm_div_pd(_mm_loadu_pd(a + i), vb));
+                }
+                for(; i < n; ++i){
+                    if(b[i] == 0)
+                        defined[i] = false;
+                    a[i] /= b[i];
+                }
+            }
+
+            __attribute__((target("sse2"))) void scale_sse2(double *a, double alpha, std::size_t n)
+            {
+                const __m128d va = _mm_set1_pd(alpha);
+                const __m128d zero = _mm_setzero_pd();
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2){
+                    __m128d x = _mm_loadu_pd(a + i);
+                    _mm_storeu_pd(a + i, _mm_and_pd(_mm_cmpneq_pd(x, zero), _mm_mul_pd(va, x)));
+                }
+                for(; i < n; ++i)
+                    a[i] = scaled(alpha, a[i]);
+            }
+
+            __attribute__((target("sse2"))) void axpby_sse2(double *a, double alpha, const double *b, double beta, std::size_t n)
+            {
+                const __m128d va = _mm_set1_pd(alpha);
+                const __m128d vb = _mm_set1_pd(beta);
+                const __m128d zero = _mm_setzero_pd();
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2){
+                    __m128d x = _mm_loadu_pd(a + i);
+                    __m128d y = _mm_loadu_pd(b + i);
+                    __m128d ax = _mm_and_pd(_mm_cmpneq_pd(x, zero), _mm_mul_pd(va, x));
+                    __m128d by = _mm_and_pd(_mm_cmpneq_pd(y, zero), _mm_mul_pd(vb, y));
+                    _mm_storeu_pd(a + i, _mm_add_pd(ax, by));
+                }
+                for(; i < n; ++i)
+                    a[i] = scaled(alpha, a[i]) + scaled(beta, b[i]);
+            }
+
+            __attribute__((target("sse2"))) void sqr_sse2(const double *in, double *out, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2){
+                    __m128d v = _mm_loadu_pd(in + i);
+                    _mm_storeu_pd(out + i, _mm_mul_pd(v, v));
+                }
+                for(; i < n; ++i)
+                    out[i] = in[i] * in[i];
+            }
+
+            __attribute__((target("sse2"))) void cube_sse2(const double *in, double *out, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2){
+                    __m128d v = _mm_loadu_pd(in + i);
+                    _mm_storeu_pd(out + i, _mm_mul_pd(_mm_mul_pd(v, v), v));
+                }
+                for(; i < n; ++i)
+                    out[i] = in[i] * in[i] * in[i];
+            }
+
+            __attribute__((target("sse2"))) void sqrt_sse2(const double *in, double *out, std::size_t n)
+            {
+                std::size_t i = 0;
+                for(; i + 2 <= n; i += 2)
+                    _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_loadu_pd(in + i)));
+                for(; i < n; ++i)
+                    out[i] = std::sqrt(in[i]);
+            }
+#endif
+        }
+
+
+        void add(double *a, const double *b, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                add_avx2(a, b, n);
+            else
+                add_sse2(a, b, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                a[i] += b[i];
+#endif
+        }
+
+        void sub(double *a, const double *b, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                sub_avx2(a, b, n);
+            else
+                sub_sse2(a, b, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                a[i] -= b[i];
+#endif
+        }
+
+        void mul(double *a, const double *b, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                mul_avx2(a, b, n);
+            else
+                mul_sse2(a, b, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                a[i] *= b[i];
+#endif
+        }
+
+        void div(double *a, const double *b, std::size_t n, bool *defined)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                div_avx2(a, b, n, defined);
+            else
+                div_sse2(a, b, n, defined);
+#else
+            for(std::size_t i = 0; i < n; ++i){
+                if(b[i] == 0)
+                    defined[i] = false;
+                a[i] /= b[i];
+            }
+#endif
+        }
+
+        void scale(double *a, double alpha, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                scale_avx2(a, alpha, n);
+            else
+                scale_sse2(a, alpha, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                a[i] = scaled(alpha, a[i]);
+#endif
+        }
+
+        void axpby(double *a, double alpha, const double *b, double beta, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                axpby_avx2(a, alpha, b, beta, n);
+            else
+                axpby_sse2(a, alpha, b, beta, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                a[i] = scaled(alpha, a[i]) + scaled(beta, b[i]);
+#endif
+        }
+
+        void sqr(const double *in, double *out, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                sqr_avx2(in, out, n);
+            else
+                sqr_sse2(in, out, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                out[i] = in[i] * in[i];
+#endif
+        }
+
+        void cube(const double *in, double *out, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                cube_avx2(in, out, n);
+            else
+                cube_sse2(in, out, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                out[i] = in[i] * in[i] * in[i];
+#endif
+        }
+
+        void sqrt(const double *in, double *out, std::size_t n)
+        {
+#ifdef RPN_SIMD_X86
+            if(has_avx2())
+                sqrt_avx2(in, out, n);
+            else
+                sqrt_sse2(in, out, n);
+#else
+            for(std::size_t i = 0; i < n; ++i)
+                out[i] = std::sqrt(in[i]);
+#endif
+        }
+
+        func_kernel find_kernel(operator_func func)
+        {
+            if(func == wfunc_sqr)
+                return sqr;
+            if(func == wfunc_cube)
+                return cube;
+            if(func == wfunc_sqrt)
+                return sqrt;
+            return nullptr;
+        }
+    }
+}
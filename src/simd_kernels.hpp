@@ -0,0 +1,41 @@
+/**
+ * @file simd_kernels.hpp
+ * @brief Header file for the internal library simd_kernels
+ * 
+ * Internal library used by rpn_utils library to evaluate some operators on whole blocks of values.
+ * On x86 processors the kernels use AVX2 (when available at runtime) or SSE2 instructions, on the other processors a plain loop
+ * 
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+#include <cstddef>
+#include "additional_operators.hpp"
+
+namespace rpn
+{
+    namespace simd
+    {
+        typedef void (*func_kernel) (const double *in, double *out, std::size_t n);  //computes out[i] = f(in[i]) for a function operator f that takes one operand
+
+        void add(double *a, const double *b, std::size_t n);  //a[i] = a[i] + b[i]
+        void sub(double *a, const double *b, std::size_t n);  //a[i] = a[i] - b[i]
+        void mul(double *a, const double *b, std::size_t n);  //a[i] = a[i] * b[i]
+        void div(double *a, const double *b, std::size_t n, bool *defined);  //a[i] = a[i] / b[i], sets defined[i] to false where b[i] == 0
+        void scale(double *a, double alpha, std::size_t n);  //a[i] = alpha * a[i], where a product with a[i] == 0 is 0 even if alpha is infinite or NaN
+        void axpby(double *a, double alpha, const double *b, double beta, std::size_t n);  //a[i] = alpha * a[i] + beta * b[i], with the products as in scale
+
+        void sqr(const double *in, double *out, std::size_t n);  //out[i] = in[i] * in[i], same result as wfunc_sqr
+        void cube(const double *in, double *out, std::size_t n);  //out[i] = in[i] * in[i] * in[i], same result as wfunc_cube
+        void sqrt(const double *in, double *out, std::size_t n);  //out[i] = sqrt(in[i]), same result as wfunc_sqrt
+
+        func_kernel find_kernel(operator_func func);  //returns the kernel that computes the function operator passed, or nullptr if there is no kernel for it
+    }
+}
+
+#endif
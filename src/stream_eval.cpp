@@ -0,0 +1,382 @@
+/**
+ * @file stream_eval.cpp
+ * @brief Implementation file for the streaming evaluation module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "stream_eval.hpp"
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RPN_STREAM_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace rpn
+{
+    namespace
+    {
+        //Exceptions
+        const std::string EXCP_FIELD_COUNT = " --> wrong number of fields!";
+        const std::string EXCP_INVALID_NUMBER = " --> invalid number!";
+
+        bool is_blank(char c);  //returns true for the characters ignored around a field
+        bool parse_field(const char *first, const char *last, double &value);  //parses a field of a CSV file (blanks around the number and a leading '+' are accepted), returns false if it is not a number
+        double load_little_endian(const char *bytes);  //returns the double stored little-endian at bytes
+        void store_little_endian(double value, char *bytes);  //stores value little-endian at bytes
+        void write_csv_field(std::ostream &out, const std::string &text);  //writes text as a CSV field, quoted if needed
+
+
+        bool is_blank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        bool parse_field(const char *first, const char *last, double &value)
+        {
+            while(first != last && is_blank(*first))
+                ++first;
+            while(last != first && is_blank(last[-1]))
+                --last;
+            if(first != last && *first == '+' && last - first > 1 && last[-1] != '+')
+                ++first;
+
+            std::from_chars_result result = std::from_chars(first, last, value);
+            return first != last && result.ec == std::errc() && result.ptr == last;
+        }
+
+        double load_little_endian(const char *bytes)
+        {
+            double value;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+            char swapped[sizeof(value)];
+            for(std::size_t i = 0; i < sizeof(value); ++i)
+                swapped[i] = bytes[sizeof(value) - 1 - i];
+            std::memcpy(&value, swapped, sizeof(value));
+#else
+            std::memcpy(&value, bytes, sizeof(value));
+#endif
+            return value;
+        }
+
+        void store_little_endian(double value, char *bytes)
+        {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+            char native[sizeof(value)];
+            std::memcpy(native, &value, sizeof(value));
+            for(std::size_t i = 0; i < sizeof(value); ++i)
+                bytes[i] = native[sizeof(value) - 1 - i];
+#else
+            std::memcpy(bytes, &value, sizeof(value));
+#endif
+        }
+
+        void write_csv_field(std::ostream &out, const std::string &text)
+        {
+            if(text.find_first_of(",\"\n") == std::string::npos){
+                out << text;
+                return;
+            }
+
+            out << '"';
+            for(std::string::const_iterator it = text.cbegin(); it != text.cend(); ++it){
+                if(*it == '"')
+                    out << '"';
+                out << *it;
+            }
+            out << '"';
+        }
+    }
+
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::open(const std::string &path)
+    {
+        close();
+
+#ifdef RPN_STREAM_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+
+        struct stat info;
+        if(fstat(fd, &info) != 0){
+            ::close(fd);
+            return false;
+        }
+
+        length = static_cast<std::size_t>(info.st_size);
+        if(length > 0){
+            void *mem = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mem != MAP_FAILED){
+                madvise(mem, length, MADV_SEQUENTIAL);
+                bytes = static_cast<const char *>(mem);
+                mapped = true;
+            }
+        }
+        ::close(fd);
+
+        if(mapped || length == 0)
+            return true;
+#endif
+
+        std::ifstream file(path, std::ios::binary);  //the file cannot be mapped, it is read in memory
+        if(!file)
+            return false;
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+#ifdef RPN_STREAM_MMAP
+        if(mapped)
+            munmap(const_cast<char *>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+        mapped = false;
+        buffer.clear();
+    }
+
+    const char *MappedFile::data() const
+    {
+        return bytes;
+    }
+
+    std::size_t MappedFile::size() const
+    {
+        return length;
+    }
+
+
+    bool StreamEvaluator::open(const std::string &path)
+    {
+        if(!input.open(path))
+            return false;
+
+        const char *first = input.data();
+        const char *last = first + input.size();
+        const char *end_of_line = std::find(first, last, '\n');
+        if(first == last)  //no header
+            return false;
+
+        std::vector<std::string> names;
+        for(const char *field = first; ; ){
+            const char *comma = std::find(field, end_of_line, ',');
+            const char *name_first = field;
+            const char *name_last = comma;
+            while(name_first != name_last && is_blank(*name_first))
+                ++name_first;
+            while(name_last != name_first && is_blank(name_last[-1]))
+                --name_last;
+            names.emplace_back(name_first, name_last);
+
+            if(comma == end_of_line)
+                break;
+            field = comma + 1;
+        }
+
+        format = StreamFormat::CSV;
+        data_start = (end_of_line == last) ? input.size() : (end_of_line - first) + 1;
+        column_names.clear();
+        ctx.clear_all_operands();
+        set.clear();
+        texts.clear();
+
+        for(std::vector<std::string>::const_iterator it = names.cbegin(); it != names.cend(); ++it){
+            column_names.push_back(*it);
+            ctx.add_operand(*it, 0.0);  //fails for the names that cannot be operands
+        }
+        used.assign(column_names.size(), false);
+        return true;
+    }
+
+    bool StreamEvaluator::open(const std::string &path, const std::vector<std::string> &names)
+    {
+        if(names.empty() || !input.open(path) || input.size() % (names.size() * sizeof(double)) != 0)
+            return false;
+
+        format = StreamFormat::BINARY;
+        data_start = 0;
+        column_names = names;
+        ctx.clear_all_operands();
+        set.clear();
+        texts.clear();
+
+        for(std::vector<std::string>::const_iterator it = names.cbegin(); it != names.cend(); ++it)
+            ctx.add_operand(*it, 0.0);
+        used.assign(column_names.size(), false);
+        return true;
+    }
+
+    const std::vector<std::string> &StreamEvaluator::columns() const
+    {
+        return column_names;
+    }
+
+    bool StreamEvaluator::add_expression(const std::string &infix_expr)
+    {
+        if(!set.add(ctx, infix_expr))
+            return false;
+
+        texts.push_back(infix_expr);
+        used.assign(column_names.size(), false);
+        for(unsigned slot = 0; slot < set.symbols().size(); ++slot){
+            std::vector<std::string>::const_iterator it = std::find(column_names.cbegin(), column_names.cend(), set.symbols().name(slot));
+            used[it - column_names.cbegin()] = true;
+        }
+        return true;
+    }
+
+    std::size_t StreamEvaluator::expressions() const
+    {
+        return set.size();
+    }
+
+    StreamStats StreamEvaluator::run(std::ostream &out, StreamFormat output_format)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const std::size_t n_results = set.size();
+        StreamStats stats = {0, 0.0, 0.0};
+
+        std::vector<std::vector<double>> block(column_names.size(), std::vector<double>(BLOCK_ROWS));
+        std::vector<const double *> operand_columns;  //columns of the block in the order of the slots of the set
+        for(unsigned slot = 0; slot < set.symbols().size(); ++slot){
+            std::vector<std::string>::const_iterator it = std::find(column_names.cbegin(), column_names.cend(), set.symbols().name(slot));
+            operand_columns.push_back(block[it - column_names.cbegin()].data());
+        }
+
+        std::vector<double> results(n_results * BLOCK_ROWS);
+        std::unique_ptr<bool[]> defined(new bool[n_results * BLOCK_ROWS]);
+        std::vector<double *> result_columns;
+        std::vector<bool *> defined_columns;
+        for(std::size_t k = 0; k < n_results; ++k){
+            result_columns.push_back(results.data() + k * BLOCK_ROWS);
+            defined_columns.push_back(defined.get() + k * BLOCK_ROWS);
+        }
+
+        if(output_format == StreamFormat::CSV && n_results > 0){
+            for(std::size_t k = 0; k < n_results; ++k){
+                if(k > 0)
+                    out << ',';
+                write_csv_field(out, texts[k]);
+            }
+            out << '\n';
+        }
+
+        std::size_t pos = data_start;
+        std::size_t line = 2;  //line of the file of the next row, for the error messages
+        std::string text;  //a block of output
+        std::vector<char> binary_row(n_results * sizeof(double));
+        char number[64];
+
+        for(;;){
+            const std::size_t n = (format == StreamFormat::CSV) ? parse_csv_block(pos, line, block) : read_binary_block(pos, block);
+            if(n == 0)
+                break;
+
+            set.evaluate_batch(operand_columns.data(), n, result_columns.data(), defined_columns.data());
+            stats.rows += n;
+
+            if(output_format == StreamFormat::BINARY){
+                for(std::size_t r = 0; r < n; ++r){
+                    for(std::size_t k = 0; k < n_results; ++k)
+                        store_little_endian(defined_columns[k][r] ? result_columns[k][r] : std::numeric_limits<double>::quiet_NaN(), binary_row.data() + k * sizeof(double));
+                    out.write(binary_row.data(), binary_row.size());
+                }
+                continue;
+            }
+
+            text.clear();
+            for(std::size_t r = 0; r < n; ++r){
+                for(std::size_t k = 0; k < n_results; ++k){
+                    if(k > 0)
+                        text.push_back(',');
+                    if(defined_columns[k][r]){
+                        std::to_chars_result result = std::to_chars(number, number + sizeof(number), result_columns[k][r]);
+                        text.append(number, result.ptr);
+                    }
+                }
+                text.push_back('\n');
+            }
+            out.write(text.data(), text.size());
+        }
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.rows_per_second = (stats.seconds > 0) ? stats.rows / stats.seconds : 0.0;
+        return stats;
+    }
+
+    std::size_t StreamEvaluator::parse_csv_block(std::size_t &pos, std::size_t &line, std::vector<std::vector<double>> &block) const
+    {
+        const char *data = input.data();
+        const char *last = data + input.size();
+        const char *cursor = data + pos;
+        std::size_t n = 0;
+
+        while(n < BLOCK_ROWS && cursor != last){
+            const char *end_of_line = static_cast<const char *>(std::memchr(cursor, '\n', last - cursor));
+            if(end_of_line == nullptr)
+                end_of_line = last;
+
+            const char *field = cursor;
+            const char *line_end = end_of_line;
+            while(line_end != field && is_blank(line_end[-1]))
+                --line_end;
+
+            if(line_end != field){  //empty lines are skipped
+                for(std::size_t column = 0; column < column_names.size(); ++column){
+                    const char *comma = (column + 1 < column_names.size()) ? static_cast<const char *>(std::memchr(field, ',', line_end - field)) : line_end;
+                    if(comma == nullptr || (column + 1 == column_names.size() && std::memchr(field, ',', line_end - field) != nullptr))
+                        throw std::runtime_error("line " + std::to_string(line) + EXCP_FIELD_COUNT);
+
+                    if(used[column] && !parse_field(field, comma, block[column][n]))
+                        throw std::runtime_error("line " + std::to_string(line) + ", column " + column_names[column] + EXCP_INVALID_NUMBER);
+                    field = comma + 1;
+                }
+                ++n;
+            }
+
+            ++line;
+            cursor = (end_of_line == last) ? last : end_of_line + 1;
+        }
+
+        pos = cursor - data;
+        return n;
+    }
+
+    std::size_t StreamEvaluator::read_binary_block(std::size_t &pos, std::vector<std::vector<double>> &block) const
+    {
+        const std::size_t row_size = column_names.size() * sizeof(double);
+        const std::size_t n = std::min(BLOCK_ROWS, (input.size() - pos) / row_size);
+        const char *row = input.data() + pos;
+
+        for(std::size_t r = 0; r < n; ++r, row += row_size)
+            for(std::size_t column = 0; column < column_names.size(); ++column)
+                if(used[column])
+                    block[column][r] = load_little_endian(row + column * sizeof(double));
+
+        pos += n * row_size;
+        return n;
+    }
+}
@@ -0,0 +1,220 @@
+/**
+ * @file thread_pool.cpp
+ * @brief Implementation file for the parallel evaluation module of the rpn_utils library
+ * @author ernestocesario
+ * @date 2023-02-21
+ * @license Apache License 2.0
+ */
+
+
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace rpn
+{
+    namespace
+    {
+        thread_local bool inside_task = false;  //true while the thread runs an iteration of parallel_for
+
+        void offset_columns(const double *const *columns, std::size_t n_columns, std::size_t first, std::vector<const double *> &chunk_columns);  //points chunk_columns to the rows of columns starting at first
+
+
+        void offset_columns(const double *const *columns, std::size_t n_columns, std::size_t first, std::vector<const double *> &chunk_columns)
+        {
+            chunk_columns.resize(n_columns);
+            for(std::size_t i = 0; i < n_columns; ++i)
+                chunk_columns[i] = columns[i] + first;
+        }
+    }
+
+
+    ThreadPool::ThreadPool(unsigned n_threads) : n_threads(n_threads)
+    {
+        if(this->n_threads == 0)
+            this->n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        queues.reset(new Queue[this->n_threads]);
+        for(unsigned i = 1; i < this->n_threads; ++i)  //thread 0 is the one calling parallel_for
+            workers.emplace_back(&ThreadPool::worker, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stopping = true;
+        }
+        start_cv.notify_all();
+
+        for(std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+            it->join();
+    }
+
+    unsigned ThreadPool::threads() const
+    {
+        return n_threads;
+    }
+
+    void ThreadPool::parallel_for(std::size_t n_tasks, const std::function<void(std::size_t)> &task)
+    {
+        if(n_tasks == 0)
+            return;
+
+        if(inside_task){  //nested call: the threads of the pool may all be busy with the outer loop, and run_mutex is held by it
+            std::exception_ptr exception;
+            for(std::size_t i = 0; i < n_tasks; ++i){
+                try{
+                    task(i);
+                }
+                catch(...){
+                    if(!exception)
+                        exception = std::current_exception();
+                }
+            }
+            if(exception)
+                std::rethrow_exception(exception);
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        current_task = &task;
+        first_exception = nullptr;
+        remaining.store(n_tasks);
+
+        for(unsigned i = 0; i < n_threads; ++i){  //contiguous ranges of about the same size
+            std::lock_guard<std::mutex> lock(queues[i].mutex);
+            queues[i].first = n_tasks * i / n_threads;
+            queues[i].last = n_tasks * (i + 1) / n_threads;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            ++generation;
+        }
+        start_cv.notify_all();
+
+        run_tasks(0);
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+        done_cv.wait(lock, [this]{ return remaining.load() == 0; });
+        current_task = nullptr;
+
+        if(first_exception)
+            std::rethrow_exception(first_exception);
+    }
+
+    void ThreadPool::worker(unsigned self)
+    {
+        unsigned long seen = 0;
+
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lock(state_mutex);
+                start_cv.wait(lock, [this, seen]{ return stopping || generation != seen; });
+                if(stopping)
+                    return;
+                seen = generation;
+            }
+            run_tasks(self);
+        }
+    }
+
+    void ThreadPool::run_tasks(unsigned self)
+    {
+        std::size_t task_index;
+
+        while(take(self, task_index)){
+            try{
+                inside_task = true;
+                (*current_task)(task_index);
+                inside_task = false;
+            }
+            catch(...){
+                inside_task = false;
+                std::lock_guard<std::mutex> lock(state_mutex);
+                if(!first_exception)
+                    first_exception = std::current_exception();
+            }
+            task_done();
+        }
+    }
+
+    bool ThreadPool::take(unsigned self, std::size_t &task_index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[self].mutex);
+            if(queues[self].first < queues[self].last){
+                task_index = queues[self].first++;
+                return true;
+            }
+        }
+
+        for(unsigned k = 1; k < n_threads; ++k){  //the own range is over, steals the second half of the range of another thread
+            Queue &victim = queues[(self + k) % n_threads];
+            std::size_t first, last;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if(victim.first == victim.last)
+                    continue;
+                first = victim.first + (victim.last - victim.first) / 2;
+                last = victim.last;
+                victim.last = first;
+            }
+
+            task_index = first;
+            if(last - first > 1){
+                std::lock_guard<std::mutex> lock(queues[self].mutex);
+                queues[self].first = first + 1;
+                queues[self].last = last;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void ThreadPool::task_done()
+    {
+        if(remaining.fetch_sub(1) == 1){  //the last iteration, wakes up parallel_for
+            std::lock_guard<std::mutex> lock(state_mutex);
+            done_cv.notify_all();
+        }
+    }
+
+
+    void parallel_evaluate_batch(ThreadPool &pool, const CompiledExpr &compiled_expr, const double *const *operand_columns, std::size_t n_rows, double *results, bool *defined)
+    {
+        const std::size_t n_operands = compiled_expr.operand_names().size();
+        const std::size_t n_chunks = (n_rows + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+
+        pool.parallel_for(n_chunks, [&](std::size_t chunk){
+            const std::size_t first = chunk * PARALLEL_CHUNK_ROWS;
+            const std::size_t n = std::min(PARALLEL_CHUNK_ROWS, n_rows - first);
+            std::vector<const double *> chunk_columns;
+
+            offset_columns(operand_columns, n_operands, first, chunk_columns);
+            compiled_expr.evaluate_batch(chunk_columns.data(), n, results + first, defined + first);
+        });
+    }
+
+    void parallel_evaluate_batch(ThreadPool &pool, const ExpressionSet &expression_set, const double *const *operand_columns, std::size_t n_rows, double *const *result_columns, bool *const *defined_columns)
+    {
+        const std::size_t n_operands = expression_set.symbols().size();
+        const std::size_t n_results = expression_set.size();
+        const std::size_t n_chunks = (n_rows + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+
+        pool.parallel_for(n_chunks, [&](std::size_t chunk){
+            const std::size_t first = chunk * PARALLEL_CHUNK_ROWS;
+            const std::size_t n = std::min(PARALLEL_CHUNK_ROWS, n_rows - first);
+            std::vector<const double *> chunk_columns;
+            std::vector<double *> chunk_results(n_results);
+            std::vector<bool *> chunk_defined(n_results);
+
+            offset_columns(operand_columns, n_operands, first, chunk_columns);
+            for(std::size_t k = 0; k < n_results; ++k){
+                chunk_results[k] = result_columns[k] + first;
+                chunk_defined[k] = defined_columns[k] + first;
+            }
+            expression_set.evaluate_batch(chunk_columns.data(), n, chunk_results.data(), chunk_defined.data());
+        });
+    }
+}
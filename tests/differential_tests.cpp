@@ -0,0 +1,511 @@
+/**
+ * @file differential_tests.cpp
+ * @brief Differential tests of the evaluators of the rpn_utils library
+ *
+ * Random infix expressions on the operands x, y and z are converted with infix_to_rpn and evaluated on random values
+ * by rpn::evaluate, whose results are the reference. Every other evaluator (CompiledExpr, JitExpr, the SIMD batch
+ * evaluation, ExpressionSet, the programs of a bytecode file and static_expr) must give the same results: both
+ * undefined, or both defined with the same value. A few more suites check behaviours that random expressions do not
+ * reach (for example the invalidation of the ExprCache entries), and the static_expr suite checks that the operator
+ * table of static_expr.hpp lists the operators of the additional_operators table.
+ * Usage: rpn_tests suite_name (one of the names of the suites table), the exit status is nonzero if a check fails
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "rpn_utils.hpp"
+#include "jit.hpp"
+#include "expression_set.hpp"
+#include "bytecode.hpp"
+#include "static_expr.hpp"
+#include "expr_cache.hpp"
+
+
+namespace rpn
+{
+    namespace
+    {
+        const unsigned SEED = 20230221;
+        const unsigned N_EXPRESSIONS = 400;  //random expressions checked by each suite
+        const unsigned N_ROWS = 80;  //rows of operand values of each expression, more than a block of rows of the batch evaluation
+        const unsigned MAX_DEPTH = 5;  //maximum nesting of the random expressions
+        const unsigned SET_SIZE = 40;  //expressions of each ExpressionSet
+        const unsigned MAX_REPORTED = 10;  //failures printed by each suite
+        const unsigned N_OPERANDS = 3;
+        const char *const operand_names[N_OPERANDS] = {"x", "y", "z"};  //slot i of every program is operand_names[i]
+
+        struct TestCase  //random expression with the operand values of its rows and the results of rpn::evaluate on them
+        {
+            std::string infix_expr;
+            std::vector<std::string> rpn_expr;
+            std::vector<double> columns[N_OPERANDS];  //columns[i][r] is the value of operand_names[i] on row r
+            std::vector<std::pair<bool, double>> expected;  //results of rpn::evaluate, one per row
+        };
+
+        class Checker  //counts the checks and the failures of a suite, printing the first failures
+        {
+        public:
+            explicit Checker(const char *suite);
+            void check(bool passed, const std::string &what);
+            void check_result(const std::pair<bool, double> &result, const TestCase &test, unsigned row, const char *evaluator);  //compares the result with the one of rpn::evaluate on the row
+            int status() const;  //prints the summary of the suite and returns the exit status of the program
+
+        private:
+            const char *suite;
+            unsigned long n_checks;
+            unsigned long n_failures;
+        };
+
+        struct Suite
+        {
+            const char *name;
+            int (*run) ();
+        };
+
+        std::string random_expression(std::mt19937 &gen, unsigned depth);  //random infix expression using operators of every kind
+        double random_value(std::mt19937 &gen);  //mostly uniform in [-4, 4], sometimes a small integer (0 included) to reach the points where the operators are not defined
+        std::pair<bool, double> reference_evaluate(const std::vector<std::string> &rpn_expr, const double *operand_values);  //rpn::evaluate with the additional operands set to operand_values
+        const std::vector<TestCase> &test_cases();  //random expressions, the same ones for every suite
+        void row_values(const TestCase &test, unsigned row, double *operand_values);  //copies the values of the row, indexed by slot
+        SymbolTable operand_slots();  //symbol table with the slots of operand_names
+        bool compile_test(const TestCase &test, CompiledExpr &compiled_expr);  //compiles the rpn expression with the slots of operand_names
+
+        int test_compiled_expr();
+        int test_jit();
+        int test_simd_batch();
+        int test_expression_set();
+        int test_bytecode();
+        int test_static_expr();
+        int test_expr_cache();
+        double cache_test_operator(const double *argv);  //operator registered by test_expr_cache
+
+        template<StaticString Expr> void check_static_expr(Checker &checker, std::mt19937 &gen);  //compares static_expr<Expr> with rpn::evaluate on random rows
+
+        const Suite suites[] = {
+            {"compiled_expr", test_compiled_expr},
+            {"jit", test_jit},
+            {"simd_batch", test_simd_batch},
+            {"expression_set", test_expression_set},
+            {"bytecode", test_bytecode},
+            {"static_expr", test_static_expr},
+            {"expr_cache", test_expr_cache}
+        };
+
+
+        Checker::Checker(const char *suite) : suite(suite), n_checks(0), n_failures(0)
+        {
+        }
+
+        void Checker::check(bool passed, const std::string &what)
+        {
+            ++n_checks;
+            if(passed)
+                return;
+
+            if(++n_failures <= MAX_REPORTED)
+                std::cerr << suite << ": FAILED " << what << std::endl;
+        }
+
+        void Checker::check_result(const std::pair<bool, double> &result, const TestCase &test, unsigned row, const char *evaluator)
+        {
+            const std::pair<bool, double> &expected = test.expected[row];
+            bool passed = (result.first == expected.first);
+            if(passed && expected.first)
+                passed = (result.second == expected.second) || (std::isnan(result.second) && std::isnan(expected.second));
+
+            if(passed){
+                ++n_checks;
+                return;
+            }
+
+            std::string what = std::string(evaluator) + " on \"" + test.infix_expr + "\" with";
+            for(unsigned i = 0; i < N_OPERANDS; ++i)
+                what += std::string(" ") + operand_names[i] + " = " + std::to_string(test.columns[i][row]);
+            what += ": got (" + std::to_string(result.first) + ", " + std::to_string(result.second) + "), expected (" + std::to_string(expected.first) + ", " + std::to_string(expected.second) + ")";
+            check(false, what);
+        }
+
+        int Checker::status() const
+        {
+            std::cout << suite << ": " << n_checks - n_failures << " of " << n_checks << " checks passed" << std::endl;
+            return (n_failures == 0 && n_checks > 0) ? 0 : 1;
+        }
+
+        std::string random_expression(std::mt19937 &gen, unsigned depth)
+        {
+            static const char *const literals[] = {"0", "1", "2", "0.5", "2.5", "3", "10", "1e-3", "123.25"};
+            static const char *const unary_operators[] = {"sqrt", "cbrt", "sqr", "cube", "log", "ln", "sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh", "asinh", "acosh", "atanh"};
+            static const char *const binary_operators[] = {"root", "logb"};
+            const unsigned n_literals = sizeof(literals) / sizeof(literals[0]);
+            const unsigned n_unary = sizeof(unary_operators) / sizeof(unary_operators[0]);
+            const unsigned n_binary = sizeof(binary_operators) / sizeof(binary_operators[0]);
+
+            std::uniform_int_distribution<unsigned> kind(0, 9);
+            const unsigned k = (depth == 0) ? kind(gen) % 2 : kind(gen);
+
+            switch(k){
+                case 0:
+                    return operand_names[std::uniform_int_distribution<unsigned>(0, N_OPERANDS - 1)(gen)];
+                case 1:
+                    return literals[std::uniform_int_distribution<unsigned>(0, n_literals - 1)(gen)];
+                case 2: case 3: case 4:{
+                    static const char *const arithmetic[] = {" + ", " - ", " * ", " / "};
+                    return "(" + random_expression(gen, depth - 1) + arithmetic[std::uniform_int_distribution<unsigned>(0, 3)(gen)] + random_expression(gen, depth - 1) + ")";
+                }
+                case 5:
+                    return "-(" + random_expression(gen, depth - 1) + ")";
+                case 6: case 7:
+                    return std::string(unary_operators[std::uniform_int_distribution<unsigned>(0, n_unary - 1)(gen)]) + " (" + random_expression(gen, depth - 1) + ")";
+                case 8:
+                    return std::string(binary_operators[std::uniform_int_distribution<unsigned>(0, n_binary - 1)(gen)]) + " (" + random_expression(gen, depth - 1) + ") (" + random_expression(gen, depth - 1) + ")";
+                default:
+                    return "(" + random_expression(gen, depth - 1) + ") ^ (" + random_expression(gen, depth - 1) + ")";
+            }
+        }
+
+        double random_value(std::mt19937 &gen)
+        {
+            if(std::uniform_int_distribution<unsigned>(0, 7)(gen) == 0)
+                return std::uniform_int_distribution<int>(-2, 2)(gen);
+            return std::uniform_real_distribution<double>(-4.0, 4.0)(gen);
+        }
+
+        std::pair<bool, double> reference_evaluate(const std::vector<std::string> &rpn_expr, const double *operand_values)
+        {
+            for(unsigned i = 0; i < N_OPERANDS; ++i)
+                add_operand(operand_names[i], operand_values[i]);
+            return evaluate(rpn_expr);
+        }
+
+        const std::vector<TestCase> &test_cases()
+        {
+            static std::vector<TestCase> tests;
+            if(!tests.empty())
+                return tests;
+
+            std::mt19937 gen(SEED);
+            for(unsigned i = 0; i < N_OPERANDS; ++i)
+                add_operand(operand_names[i], 0.0);
+
+            while(tests.size() < N_EXPRESSIONS){
+                TestCase test;
+                test.infix_expr = random_expression(gen, std::uniform_int_distribution<unsigned>(1, MAX_DEPTH)(gen));
+                if(!infix_to_rpn(test.infix_expr, test.rpn_expr)){
+                    std::cerr << "the random expression \"" << test.infix_expr << "\" is not valid" << std::endl;
+                    continue;
+                }
+
+                for(unsigned i = 0; i < N_OPERANDS; ++i)
+                    for(unsigned r = 0; r < N_ROWS; ++r)
+                        test.columns[i].push_back(random_value(gen));
+
+                for(unsigned r = 0; r < N_ROWS; ++r){
+                    double operand_values[N_OPERANDS];
+                    row_values(test, r, operand_values);
+                    test.expected.push_back(reference_evaluate(test.rpn_expr, operand_values));
+                }
+                tests.push_back(test);
+            }
+            return tests;
+        }
+
+        void row_values(const TestCase &test, unsigned row, double *operand_values)
+        {
+            for(unsigned i = 0; i < N_OPERANDS; ++i)
+                operand_values[i] = test.columns[i][row];
+        }
+
+        SymbolTable operand_slots()
+        {
+            SymbolTable symbols;
+            for(unsigned i = 0; i < N_OPERANDS; ++i)
+                symbols.add(operand_names[i]);
+            return symbols;
+        }
+
+        bool compile_test(const TestCase &test, CompiledExpr &compiled_expr)
+        {
+            SymbolTable symbols = operand_slots();
+            return compile(test.rpn_expr, symbols, compiled_expr);
+        }
+
+        int test_compiled_expr()
+        {
+            Checker checker("compiled_expr");
+            const std::vector<TestCase> &tests = test_cases();
+            Context ctx;
+
+            for(std::vector<TestCase>::const_iterator it = tests.cbegin(); it != tests.cend(); ++it){
+                CompiledExpr compiled_expr;
+                checker.check(compile_test(*it, compiled_expr), "compile of \"" + it->infix_expr + "\"");
+                if(compiled_expr.empty())
+                    continue;
+
+                for(unsigned r = 0; r < N_ROWS; ++r){
+                    double operand_values[N_OPERANDS];
+                    row_values(*it, r, operand_values);
+                    for(unsigned i = 0; i < N_OPERANDS; ++i)
+                        ctx.add_operand(operand_names[i], operand_values[i]);
+
+                    compiled_expr.set_fp_check(FpCheck::PER_OPERATOR);
+                    checker.check_result(compiled_expr.evaluate(operand_values), *it, r, "CompiledExpr::evaluate");
+                    checker.check_result(compiled_expr.evaluate(ctx), *it, r, "CompiledExpr::evaluate(ctx)");
+                    compiled_expr.set_fp_check(FpCheck::DEFERRED);
+                    checker.check_result(compiled_expr.evaluate(operand_values), *it, r, "CompiledExpr::evaluate (deferred check)");
+                }
+            }
+            return checker.status();
+        }
+
+        int test_jit()
+        {
+            Checker checker("jit");
+            const std::vector<TestCase> &tests = test_cases();
+
+            for(std::vector<TestCase>::const_iterator it = tests.cbegin(); it != tests.cend(); ++it){
+                CompiledExpr compiled_expr;
+                JitExpr jit_expr;
+                if(!compile_test(*it, compiled_expr))
+                    continue;
+                jit_expr.assign(compiled_expr);
+
+                for(unsigned r = 0; r < N_ROWS; ++r){
+                    double operand_values[N_OPERANDS];
+                    row_values(*it, r, operand_values);
+                    checker.check_result(jit_expr.evaluate(operand_values), *it, r, jit_expr.native() ? "JitExpr::evaluate (native)" : "JitExpr::evaluate (interpreter)");
+                }
+            }
+            return checker.status();
+        }
+
+        int test_simd_batch()
+        {
+            Checker checker("simd_batch");
+            const std::vector<TestCase> &tests = test_cases();
+            const FpCheck modes[] = {FpCheck::PER_OPERATOR, FpCheck::DEFERRED};
+
+            for(std::vector<TestCase>::const_iterator it = tests.cbegin(); it != tests.cend(); ++it){
+                CompiledExpr compiled_expr;
+                if(!compile_test(*it, compiled_expr))
+                    continue;
+
+                const double *operand_columns[N_OPERANDS];
+                for(unsigned i = 0; i < N_OPERANDS; ++i)
+                    operand_columns[i] = it->columns[i].data();
+
+                for(unsigned m = 0; m < 2; ++m){
+                    double results[N_ROWS];
+                    bool defined[N_ROWS];
+                    compiled_expr.set_fp_check(modes[m]);
+                    compiled_expr.evaluate_batch(operand_columns, N_ROWS, results, defined);
+
+                    for(unsigned r = 0; r < N_ROWS; ++r)
+                        checker.check_result(std::make_pair(defined[r], results[r]), *it, r, (m == 0) ? "CompiledExpr::evaluate_batch" : "CompiledExpr::evaluate_batch (deferred check)");
+                }
+            }
+            return checker.status();
+        }
+
+        int test_expression_set()
+        {
+            Checker checker("expression_set");
+            const std::vector<TestCase> &tests = test_cases();
+
+            for(std::size_t first = 0; first < tests.size(); first += SET_SIZE){
+                const std::size_t last = std::min<std::size_t>(first + SET_SIZE, tests.size());
+                ExpressionSet expression_set;
+                for(std::size_t k = first; k < last; ++k)
+                    checker.check(expression_set.add(tests[k].infix_expr), "ExpressionSet::add of \"" + tests[k].infix_expr + "\"");
+                if(expression_set.size() != last - first)
+                    continue;
+
+                const SymbolTable &symbols = expression_set.symbols();
+                for(unsigned r = 0; r < N_ROWS; ++r){  //every expression has its own values, so the set is evaluated once per expression and row
+                    for(std::size_t k = first; k < last; ++k){
+                        std::vector<double> operand_values(symbols.size(), 0.0);
+                        for(unsigned i = 0; i < N_OPERANDS; ++i)
+                            if(symbols.find(operand_names[i]) != SymbolTable::NPOS)
+                                operand_values[symbols.find(operand_names[i])] = tests[k].columns[i][r];
+
+                        double results[SET_SIZE];
+                        bool defined[SET_SIZE];
+                        expression_set.evaluate(operand_values.data(), results, defined);
+                        checker.check_result(std::make_pair(defined[k - first], results[k - first]), tests[k], r, "ExpressionSet::evaluate");
+                    }
+                }
+
+                for(std::size_t k = first; k < last; ++k){
+                    std::vector<const double *> operand_columns(symbols.size());
+                    for(unsigned i = 0; i < N_OPERANDS; ++i)
+                        if(symbols.find(operand_names[i]) != SymbolTable::NPOS)
+                            operand_columns[symbols.find(operand_names[i])] = tests[k].columns[i].data();
+
+                    std::vector<double> result_values(SET_SIZE * N_ROWS);
+                    std::unique_ptr<bool[]> defined_values(new bool[SET_SIZE * N_ROWS]);
+                    double *result_columns[SET_SIZE];
+                    bool *defined_columns[SET_SIZE];
+                    for(unsigned j = 0; j < SET_SIZE; ++j){
+                        result_columns[j] = result_values.data() + j * N_ROWS;
+                        defined_columns[j] = defined_values.get() + j * N_ROWS;
+                    }
+
+                    expression_set.evaluate_batch(operand_columns.data(), N_ROWS, result_columns, defined_columns);
+                    for(unsigned r = 0; r < N_ROWS; ++r)
+                        checker.check_result(std::make_pair(defined_columns[k - first][r], result_columns[k - first][r]), tests[k], r, "ExpressionSet::evaluate_batch");
+                }
+            }
+            return checker.status();
+        }
+
+        int test_bytecode()
+        {
+            Checker checker("bytecode");
+            const std::vector<TestCase> &tests = test_cases();
+            const std::string path = "rpn_tests_bytecode.rpnb";  //in the working directory of the test
+
+            BytecodeWriter writer;
+            for(std::vector<TestCase>::const_iterator it = tests.cbegin(); it != tests.cend(); ++it){
+                CompiledExpr compiled_expr;
+                compile_test(*it, compiled_expr);
+                checker.check(writer.add(compiled_expr, it->infix_expr), "BytecodeWriter::add of \"" + it->infix_expr + "\"");
+            }
+            checker.check(writer.write(path), "BytecodeWriter::write");
+
+            BytecodeFile file;
+            checker.check(file.open(path) == BytecodeStatus::OK, "BytecodeFile::open");
+            checker.check(file.size() == tests.size(), "BytecodeFile::size");
+            checker.check(file.verify(), "BytecodeFile::verify");
+
+            for(std::size_t k = 0; k < file.size() && k < tests.size(); ++k){
+                const TestCase &test = tests[k];
+                checker.check(file.source(k) == test.infix_expr, "BytecodeFile::source of \"" + test.infix_expr + "\"");
+
+                std::vector<double> operand_values(file.operands(k), 0.0);
+                for(unsigned r = 0; r < N_ROWS; ++r){
+                    for(unsigned slot = 0; slot < file.operands(k); ++slot)
+                        for(unsigned i = 0; i < N_OPERANDS; ++i)
+                            if(file.operand_name(k, slot) == operand_names[i])
+                                operand_values[slot] = test.columns[i][r];
+                    checker.check_result(file.evaluate(k, operand_values.data()), test, r, "BytecodeFile::evaluate");
+                }
+            }
+
+            file.close();
+            std::remove(path.c_str());
+            return checker.status();
+        }
+
+        template<StaticString Expr> void check_static_expr(Checker &checker, std::mt19937 &gen)
+        {
+            const static_expr<Expr> expr;
+            TestCase test;
+            test.infix_expr = std::string(Expr.view());
+            checker.check(infix_to_rpn(test.infix_expr, test.rpn_expr), "infix_to_rpn of \"" + test.infix_expr + "\"");
+
+            for(unsigned r = 0; r < N_ROWS; ++r){
+                double operand_values[N_OPERANDS];
+                double slot_values[N_OPERANDS + 1] = {};  //one more, so that the array is never empty
+                for(unsigned i = 0; i < N_OPERANDS; ++i){
+                    operand_values[i] = random_value(gen);
+                    test.columns[i].push_back(operand_values[i]);
+                }
+                test.expected.push_back(reference_evaluate(test.rpn_expr, operand_values));
+
+                for(unsigned slot = 0; slot < expr.operands; ++slot)
+                    for(unsigned i = 0; i < N_OPERANDS; ++i)
+                        if(expr.operand_name(slot) == operand_names[i])
+                            slot_values[slot] = operand_values[i];
+                checker.check_result(expr(slot_values), test, r, "static_expr");
+            }
+        }
+
+        int test_static_expr()
+        {
+            Checker checker("static_expr");
+            std::mt19937 gen(SEED);
+
+            checker.check(detail::n_static_operators == n_additional_operators, "static_operators and additional_operators have the same size");
+            for(std::size_t k = 0; k < n_additional_operators; ++k){  //the static table must copy the additional_operators table
+                const AdditionalOperator &op = additional_operators[k];
+                const unsigned i = detail::find_static_operator(op.name);
+                checker.check(i != OPERATOR_NPOS, std::string("operator ") + op.name + " in static_operators");
+                if(i != OPERATOR_NPOS){
+                    checker.check(detail::static_operators[i].n_operands == op.n_operands, std::string("number of operands of the static ") + op.name);
+                    checker.check(detail::static_operators[i].precedence == op.precedence, std::string("precedence of the static ") + op.name);
+                }
+            }
+
+            for(unsigned i = 0; i < N_OPERANDS; ++i)
+                add_operand(operand_names[i], 0.0);
+
+            check_static_expr<"x * 2.5 + sin (y)">(checker, gen);
+            check_static_expr<"root 3 (x + 8) - logb 2 (x * x + 1)">(checker, gen);
+            check_static_expr<"-(x * y) / (z - 0.5)">(checker, gen);
+            check_static_expr<"sqr -(y) + cube (z) - sqrt (x)">(checker, gen);
+            check_static_expr<"ln (x) * cosh (y) / tanh (z)">(checker, gen);
+            check_static_expr<"(x) ^ (y) + asin (z)">(checker, gen);
+            check_static_expr<"(x + y) * (x + y) - acos (z / 3)">(checker, gen);
+            check_static_expr<"--+-3 / (y - 0.5) + atanh (x / 4)">(checker, gen);
+            check_static_expr<"log (z) / log (2) - 1e-3 * x">(checker, gen);
+            check_static_expr<"123.25 - (1 / 3)">(checker, gen);
+            return checker.status();
+        }
+
+        double cache_test_operator(const double *argv)
+        {
+            return argv[0] * 2;
+        }
+
+        int test_expr_cache()
+        {
+            Checker checker("expr_cache");
+            ExprCache cache(16);
+            ExprCache ctx_cache(16);  //separate, so that the entries of each cache are always converted with the same version of the operands
+            Context ctx;
+
+            add_operand("x", 3.0);
+            ctx.add_operand("x", 3.0);
+            checker.check(cache.get("cachetwice (x)") == nullptr, "ExprCache::get of an expression with an operator not registered yet");
+            checker.check(cache.get("cachetwice (x)") == nullptr && cache.hits() == 1, "ExprCache::get of the same invalid expression is a hit");
+            checker.check(ctx_cache.get(ctx, "cachetwice (x)") == nullptr, "ExprCache::get (context) of an expression with an operator not registered yet");
+            checker.check(ctx_cache.get(ctx, "cachetwice (x)") == nullptr && ctx_cache.hits() == 1, "ExprCache::get (context) of the same invalid expression is a hit");
+
+            checker.check(register_operator("cachetwice", 1, 1, cache_test_operator), "register_operator");
+
+            std::shared_ptr<const CompiledExpr> expr = cache.get("cachetwice (x)");
+            checker.check(expr != nullptr && expr->evaluate() == std::make_pair(true, 6.0), "ExprCache::get after register_operator");
+            checker.check(cache.get("cachetwice (x)") == expr, "ExprCache::get of the same valid expression returns the cached one");
+            expr = ctx_cache.get(ctx, "cachetwice (x)");
+            checker.check(expr != nullptr && expr->evaluate(ctx) == std::make_pair(true, 6.0), "ExprCache::get (context) after register_operator");
+            return checker.status();
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    const std::size_t n_suites = sizeof(rpn::suites) / sizeof(rpn::suites[0]);
+
+    if(argc != 2){
+        std::cerr << "Usage: rpn_tests suite_name" << std::endl;
+        return 2;
+    }
+
+    for(std::size_t i = 0; i < n_suites; ++i)
+        if(std::strcmp(argv[1], rpn::suites[i].name) == 0)
+            return rpn::suites[i].run();
+
+    std::cerr << "Unknown suite " << argv[1] << std::endl;
+    return 2;
+}
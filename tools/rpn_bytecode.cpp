@@ -0,0 +1,123 @@
+/**
+ * @file rpn_bytecode.cpp
+ * @brief Command line tool that converts a file of infix expressions to a bytecode file
+ *
+ * Usage: rpn_bytecode [--operands name1,name2,...] [--optimize] input_file output_file
+ * The input file holds one infix expression per line; the k-th program of the output file is the expression of the
+ * k-th line (a line that is not a valid expression gives a program that is never defined). Every name listed with
+ * --operands can be used as a variable by the expressions
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "bytecode.hpp"
+#include "optimizer.hpp"
+
+
+namespace
+{
+    void print_usage()
+    {
+        std::cerr << "Usage: rpn_bytecode [--operands name1,name2,...] [--optimize] input_file output_file" << std::endl;
+    }
+
+    std::vector<std::string> split_names(const std::string &list)
+    {
+        std::vector<std::string> names;
+        std::string::size_type first = 0;
+
+        for(;;){
+            std::string::size_type comma = list.find(',', first);
+            names.push_back(list.substr(first, comma - first));
+            if(comma == std::string::npos)
+                break;
+            first = comma + 1;
+        }
+        return names;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    rpn::Context ctx;
+    bool optimize = false;
+    int arg = 1;
+
+    for(; arg < argc && std::string(argv[arg]).compare(0, 2, "--") == 0; ++arg){
+        const std::string option = argv[arg];
+
+        if(option == "--operands" && arg + 1 < argc){
+            const std::vector<std::string> names = split_names(argv[++arg]);
+            for(std::vector<std::string>::const_iterator it = names.cbegin(); it != names.cend(); ++it){
+                if(!ctx.add_operand(*it, 0.0)){
+                    std::cerr << "Not a valid operand name: " << *it << std::endl;
+                    return 1;
+                }
+            }
+        }
+        else if(option == "--optimize")
+            optimize = true;
+        else{
+            print_usage();
+            return 1;
+        }
+    }
+
+    if(argc - arg != 2){
+        print_usage();
+        return 1;
+    }
+
+    const std::string input_file = argv[arg];
+    const std::string output_file = argv[arg + 1];
+    std::ifstream input(input_file);
+    if(!input){
+        std::cerr << "Cannot read " << input_file << std::endl;
+        return 1;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    rpn::BytecodeWriter writer;
+    std::size_t line_number = 0;
+    std::size_t n_invalid = 0;
+    std::string line;
+
+    while(std::getline(input, line)){
+        ++line_number;
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        std::vector<rpn::Instruction> program;
+        rpn::SymbolTable symbols;
+        rpn::CompiledExpr compiled_expr;
+
+        try{
+            if(rpn::infix_to_rpn(ctx, line, program, symbols) && compiled_expr.assign(program, symbols.names()) && optimize)
+                rpn::optimize(compiled_expr);
+        }
+        catch(const std::runtime_error &e){
+            compiled_expr.clear();
+            std::cerr << input_file << ":" << line_number << ": " << e.what() << std::endl;
+        }
+
+        if(!writer.add(compiled_expr, line))
+            ++n_invalid;
+    }
+
+    if(!writer.write(output_file)){
+        std::cerr << "Cannot write " << output_file << std::endl;
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << writer.size() << " programs (" << n_invalid << " not valid) in " << seconds << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file rpn_stream.cpp
+ * @brief Command line tool that evaluates infix expressions on every row of a CSV or binary file
+ *
+ * Usage: rpn_stream [--binary col1,col2,...] [--output-binary] input_file expression...
+ * The results are written to the standard output, the number of rows and the rows per second to the standard error
+ *
+ * @author ernestocesario
+ * @date 2023-02-21
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "stream_eval.hpp"
+
+
+namespace
+{
+    void print_usage()
+    {
+        std::cerr << "Usage: rpn_stream [--binary col1,col2,...] [--output-binary] input_file expression..." << std::endl;
+    }
+
+    std::vector<std::string> split_names(const std::string &list)
+    {
+        std::vector<std::string> names;
+        std::string::size_type first = 0;
+
+        for(;;){
+            std::string::size_type comma = list.find(',', first);
+            names.push_back(list.substr(first, comma - first));
+            if(comma == std::string::npos)
+                break;
+            first = comma + 1;
+        }
+        return names;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> binary_columns;
+    rpn::StreamFormat output_format = rpn::StreamFormat::CSV;
+    int arg = 1;
+
+    for(; arg < argc && std::string(argv[arg]).compare(0, 2, "--") == 0; ++arg){
+        const std::string option = argv[arg];
+
+        if(option == "--binary" && arg + 1 < argc)
+            binary_columns = split_names(argv[++arg]);
+        else if(option == "--output-binary")
+            output_format = rpn::StreamFormat::BINARY;
+        else{
+            print_usage();
+            return 1;
+        }
+    }
+
+    if(argc - arg < 2){
+        print_usage();
+        return 1;
+    }
+
+    rpn::StreamEvaluator stream;
+    const std::string input_file = argv[arg++];
+    const bool opened = binary_columns.empty() ? stream.open(input_file) : stream.open(input_file, binary_columns);
+
+    if(!opened){
+        std::cerr << "Cannot read " << input_file << std::endl;
+        return 1;
+    }
+
+    try{
+        for(; arg < argc; ++arg){
+            if(!stream.add_expression(argv[arg])){
+                std::cerr << "The infix expression is not valid: " << argv[arg] << std::endl;
+                return 1;
+            }
+        }
+
+        std::ios::sync_with_stdio(false);
+        rpn::StreamStats stats = stream.run(std::cout, output_format);
+        std::cout.flush();
+
+        std::cerr << stats.rows << " rows in " << stats.seconds << " s (" << stats.rows_per_second << " rows/s)" << std::endl;
+    }
+    catch(const std::runtime_error &e){
+        std::cerr << input_file << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}